@@ -3,23 +3,118 @@
 #include "MidiHelpers.h"
 #include "RD8Pattern.h"
 #include "Sysex.h"
+#include "Settings.h"
+
+#include <boost/format.hpp>
 
 namespace midikraft {
 
 	BehringerRD8::BehringerRD8()
 	{
+		metrics_ = std::make_unique<RD8Metrics>();
 		globalSettings_ = std::make_shared<RD8GlobalSettings>(this);
+		transport_ = std::make_shared<RD8MidiControllerTransport>(this);
+		requests_ = std::make_unique<RD8RequestMultiplexer>(this);
+		livePattern_ = std::make_shared<RD8Pattern::PatternData>();
+		liveMirror_ = std::make_unique<RD8LiveMirror>(this, livePattern_, RD8LiveMirror::Options());
+	}
+
+	BehringerRD8::~BehringerRD8()
+	{
+		// Make sure no callback of a running transaction refers to us anymore
+		liveMirror_.reset();
+		requests_.reset();
+	}
+
+	RD8RequestMultiplexer & BehringerRD8::requests()
+	{
+		return *requests_;
+	}
+
+	RD8Metrics & BehringerRD8::metrics() const
+	{
+		return *metrics_;
+	}
+
+	void BehringerRD8::setLiveMirror(bool on)
+	{
+		if (on) {
+			liveMirror_->start();
+		}
+		else {
+			liveMirror_->stop();
+		}
+	}
+
+	RD8LiveMirror & BehringerRD8::liveMirror()
+	{
+		return *liveMirror_;
+	}
+
+	std::shared_ptr<RD8MidiTransport> BehringerRD8::transport() const
+	{
+		return std::atomic_load(&transport_);
+	}
+
+	void BehringerRD8::setTransport(std::shared_ptr<RD8MidiTransport> transport)
+	{
+		std::atomic_store(&transport_, transport);
+		// This might be another device
+		invalidateGlobalSettingsCache();
 	}
 
 	std::vector<juce::MidiMessage> BehringerRD8::deviceDetect(int channel)
 	{
+		if (broadcastDetection_) {
+			// The calls are staged: the first asks the device ID found on this port before alone, or all 16 if there is none.
+			// The second asks all others if the known ID didn't answer, the rest send nothing
+			std::vector<juce::MidiMessage> result;
+			if (channel <= 0) {
+				detectAnswered_ = false;
+				loadDetectionPortDevice();
+				fallbackSent_ = !hasKnownDevice_;
+				if (hasKnownDevice_) {
+					result.push_back(MidiHelpers::sysexMessage(createSysexMessage(knownDevice_.deviceID, RD8_FIRMWARE_MESSAGE, RD8_REQUEST)));
+				}
+				else {
+					for (uint8 deviceID = 0; deviceID < 16; deviceID++) {
+						result.push_back(MidiHelpers::sysexMessage(createSysexMessage(deviceID, RD8_FIRMWARE_MESSAGE, RD8_REQUEST)));
+					}
+				}
+			}
+			else if (!detectAnswered_ && !fallbackSent_) {
+				// It didn't answer, so the device ID has changed. Ask all others in one go
+				fallbackSent_ = true;
+				for (uint8 deviceID = 0; deviceID < 16; deviceID++) {
+					if (deviceID != knownDevice_.deviceID) {
+						result.push_back(MidiHelpers::sysexMessage(createSysexMessage(deviceID, RD8_FIRMWARE_MESSAGE, RD8_REQUEST)));
+					}
+				}
+			}
+			lastDetectProbes_ = (int) result.size();
+			// The messages are sent right after we return them. In a burst the answering probe may leave later than the first,
+			// so the roundtrip measured from here is an upper bound, which is good enough for the deadline
+			detectSentAtMS_ = result.empty() ? 0 : Time::getMillisecondCounter();
+			return result;
+		}
 		// The channel is really the device ID, but as it is easy to change with my software, don't rely on the fact that it could be 0!
-		return { MidiHelpers::sysexMessage(createSysexMessage((uint8) channel, RD8_FIRMWARE_MESSAGE, RD8_REQUEST)) };
+		auto result = std::vector<juce::MidiMessage>({ MidiHelpers::sysexMessage(createSysexMessage((uint8) channel, RD8_FIRMWARE_MESSAGE, RD8_REQUEST)) });
+		detectSentAtMS_ = Time::getMillisecondCounter();
+		return result;
 	}
 
 	int BehringerRD8::deviceDetectSleepMS()
 	{
-		return 120;
+		if (broadcastDetection_ && lastDetectProbes_ == 0) {
+			// Nothing was sent in this round, all device IDs have been asked or the known device has answered already
+			return 0;
+		}
+		// Until we have seen a device answer, be conservative. Else allow twice the measured roundtrip plus some slack for the MIDI driver
+		int roundtrip = measuredRoundtripMS_;
+		if (roundtrip < 0) {
+			return 120;
+		}
+		return jlimit(20, 120, 2 * roundtrip + 10);
 	}
 
 	MidiChannel BehringerRD8::channelIfValidDeviceResponse(const MidiMessage &message)
@@ -28,9 +123,29 @@ namespace midikraft {
 			auto messageID = getMessageID(message);
 			if (messageID.messageType == RD8_FIRMWARE_MESSAGE && messageID.messageID == RD8_REPLY) {
 				if (message.getSysExDataSize() > 13) {
+					// Measure the roundtrip, smoothing over the previous measurements
+					uint32 sentAtMS = detectSentAtMS_.exchange(0);
+					if (sentAtMS != 0) {
+						int roundtrip = (int) (Time::getMillisecondCounter() - sentAtMS);
+						int previous = measuredRoundtripMS_;
+						measuredRoundtripMS_ = previous < 0 ? roundtrip : (3 * previous + roundtrip) / 4;
+					}
+					detectAnswered_ = true;
+					// Found again, maybe after a reconnect. What we knew of its settings might be outdated
+					invalidateGlobalSettingsCache();
+
 					// 7, 8, 9, 10 are reserved according to the manual
 					deviceID_ = message.getSysExData()[4];
 					version_ = FirmwareVersion({ message.getSysExData()[11], message.getSysExData()[12], message.getSysExData()[13] });
+					std::string port;
+					{
+						ScopedLock lock(detectionPortLock_);
+						port = probedPort_;
+					}
+					if (!port.empty()) {
+						storeKnownDevice(port, { deviceID_, version_, measuredRoundtripMS_ });
+					}
+					// Else the device is first detected, and stored once the port it was found on is known, see getMidiChannelsFromDevice
 					getMidiChannelsFromDevice();
 					return MidiChannel::fromZeroBase(deviceID_); // Again, this is the device ID and not the MIDI channel
 				}
@@ -41,9 +156,76 @@ namespace midikraft {
 
 	bool BehringerRD8::needsChannelSpecificDetection()
 	{
+		// Also in broadcast mode, where deviceDetect stages its calls. Which port is probed is only known when they are made
 		return true;
 	}
 
+	void BehringerRD8::setDetectionPort(std::string const &midiOutput)
+	{
+		ScopedLock lock(detectionPortLock_);
+		detectionPort_ = midiOutput;
+	}
+
+	void BehringerRD8::loadDetectionPortDevice()
+	{
+		std::string port;
+		{
+			ScopedLock lock(detectionPortLock_);
+			// Without a port set by the host, assume the device is looked for where it was detected before
+			probedPort_ = detectionPort_.empty() ? midiOutput() : detectionPort_;
+			port = probedPort_;
+		}
+		hasKnownDevice_ = loadKnownDevice(port, knownDevice_) && knownDevice_.deviceID < 16;
+		if (hasKnownDevice_) {
+			if (measuredRoundtripMS_ < 0) {
+				measuredRoundtripMS_ = knownDevice_.roundtripMS;
+			}
+			if (version_.major == 0 && version_.minor == 0 && version_.patch == 0) {
+				// Until the device answers, address requests to it as it was last time
+				deviceID_ = knownDevice_.deviceID;
+				version_ = knownDevice_.version;
+			}
+		}
+	}
+
+	void BehringerRD8::setBroadcastDetection(bool broadcast)
+	{
+		broadcastDetection_ = broadcast;
+	}
+
+	bool BehringerRD8::isBroadcastDetection() const
+	{
+		return broadcastDetection_;
+	}
+
+	bool BehringerRD8::loadKnownDevice(std::string const &port, KnownDevice &outDevice)
+	{
+		if (port.empty()) {
+			return false;
+		}
+		// Stored as "deviceID major minor patch roundtripMS", older entries have no roundtrip
+		auto stored = String(Settings::instance().get("RD8 known device " + port, "")).trim();
+		StringArray parts;
+		parts.addTokens(stored, " ", "");
+		if (parts.size() != 4 && parts.size() != 5) {
+			return false;
+		}
+		outDevice.deviceID = (uint8) parts[0].getIntValue();
+		outDevice.version = FirmwareVersion({ (uint8) parts[1].getIntValue(), (uint8) parts[2].getIntValue(), (uint8) parts[3].getIntValue() });
+		outDevice.roundtripMS = parts.size() == 5 ? parts[4].getIntValue() : -1;
+		return true;
+	}
+
+	void BehringerRD8::storeKnownDevice(std::string const &port, KnownDevice const &device)
+	{
+		if (port.empty()) {
+			return;
+		}
+		auto value = (boost::format("%d %d %d %d %d") % (int) device.deviceID % (int) device.version.major % (int) device.version.minor % (int) device.version.patch
+			% device.roundtripMS).str();
+		Settings::instance().set("RD8 known device " + port, value);
+	}
+
 	std::string BehringerRD8::getName() const
 	{
 		return "Behringer RD8";
@@ -82,6 +264,8 @@ namespace midikraft {
 		if (dataFile->dataTypeID() == SETTINGS) {
 			auto settings = std::dynamic_pointer_cast<RD8GlobalSettings>(dataFile);
 			if (settings) {
+				// The file might come from the library as well as from the device, so the shadow copy of the device settings is
+				// left alone. It is only set from what the device sent or was sent
 				globalSettings_ = settings;
 				// Put all of the values into a ValueTree that we will observe
 				globalSettingsTree_ = ValueTree("RD8SETTINGS");
@@ -112,27 +296,94 @@ namespace midikraft {
 	void BehringerRD8::valueTreePropertyChanged(ValueTree& treeWhosePropertyHasChanged, const Identifier& property)
 	{
 		// Poke the value into the data
-		globalSettings_->pokeSetting(String(property.getCharPointer()).toStdString(), (uint8)(int)treeWhosePropertyHasChanged.getProperty(property));
+		globalSettings_->pokeSetting(property.getCharPointer().getAddress(), (uint8)(int)treeWhosePropertyHasChanged.getProperty(property));
 
-		// Construct MIDI message for this update
-		auto update = globalSettings_->dataToSysex();
+		// Then debounced send the new settings to the RD8, unless it has them already
+		auto deviceSettings = currentDeviceSettings();
+		if (deviceSettings && deviceSettings->data() == globalSettings_->data()) {
+			return;
+		}
+		sendGlobalSettings(*globalSettings_, true);
+	}
+
+	void BehringerRD8::editGlobalSettings(MidiController *controller, SettingsEdit edit, std::function<void(bool changed)> onCommitted, std::function<void()> onFailed)
+	{
+		auto runEdit = [this, edit, onCommitted](RD8GlobalSettings const &deviceState) {
+			RD8SettingsTransaction transaction(this, deviceState);
+			if (edit(transaction)) {
+				bool changed = transaction.commit();
+				if (onCommitted) {
+					onCommitted(changed);
+				}
+			}
+		};
+
+		auto cached = currentDeviceSettings();
+		if (cached) {
+			// No need to read back what we know already
+			runEdit(*cached);
+		}
+		else {
+			globalSettingsOperation(controller, [runEdit](std::shared_ptr<RD8GlobalSettings> settings) {
+				runEdit(*settings);
+			}, onFailed);
+		}
+	}
+
+	void BehringerRD8::sendGlobalSettings(RD8GlobalSettings const &settings, bool debounced)
+	{
+		setDeviceSettings(settings);
+		auto update = settings.dataToSysex();
 		if (update.size() == 1) {
-			// Then debounced send the new settings to the RD8
-			MidiController::instance()->getMidiOutput(midiOutput())->sendMessageDebounced(update[0], 200);
+			if (debounced) {
+				transport()->sendDebounced(update[0], 200);
+			}
+			else {
+				transport()->send(update);
+			}
 		}
 	}
 
+	std::shared_ptr<RD8GlobalSettings> BehringerRD8::currentDeviceSettings()
+	{
+		ScopedLock lock(deviceSettingsLock_);
+		if (deviceSettings_ && Time::getMillisecondCounter() - deviceSettingsTimeMS_ > kDeviceSettingsMaxAgeMS) {
+			// Someone might have changed a setting on the device in the meantime
+			deviceSettings_.reset();
+		}
+		return deviceSettings_;
+	}
+
+	void BehringerRD8::setDeviceSettings(RD8GlobalSettings const &settings)
+	{
+		ScopedLock lock(deviceSettingsLock_);
+		deviceSettings_ = std::make_shared<RD8GlobalSettings>(settings);
+		deviceSettingsTimeMS_ = Time::getMillisecondCounter();
+	}
+
+	void BehringerRD8::invalidateGlobalSettingsCache()
+	{
+		ScopedLock lock(deviceSettingsLock_);
+		deviceSettings_.reset();
+	}
+
 	std::vector<uint8> BehringerRD8::createSysexMessage(uint8 deviceID, uint8 messageType, uint8 messageID) const {
 		return std::vector<uint8>({ 0x00, 0x20, BEHRINGER_ID, RD8_ID, deviceID, messageType, messageID });
 	}
 
 	std::vector<uint8> BehringerRD8::createRequestMessage(MessageID id) const {
-		auto message = createSysexMessage(deviceID_, id.messageType, id.messageID);
-		std::vector<uint8> data({ 0x30, 0x00, 0x00, 0x00 /* 4 magic bytes */, version_.major, version_.minor, version_.patch });
-		message.insert(message.end(), data.begin(), data.end());
+		std::vector<uint8> message(kRequestHeaderSize);
+		writeRequestHeader(id, message.data());
 		return message;
 	}
 
+	size_t BehringerRD8::writeRequestHeader(MessageID id, uint8 *out) const {
+		uint8 const header[kRequestHeaderSize] = { 0x00, 0x20, BEHRINGER_ID, RD8_ID, deviceID_, id.messageType, id.messageID,
+			0x30, 0x00, 0x00, 0x00 /* 4 magic bytes */, version_.major, version_.minor, version_.patch };
+		memcpy(out, header, kRequestHeaderSize);
+		return kRequestHeaderSize;
+	}
+
 	BehringerRD8::MessageID BehringerRD8::getMessageID(MidiMessage const &midiMessage) const {
 		if (isOwnSysex(midiMessage)) {
 			if (midiMessage.getSysExDataSize() > 6) {
@@ -201,85 +452,93 @@ namespace midikraft {
 
 	bool BehringerRD8::isDataFile(const MidiMessage &message, int dataTypeID) const
 	{
-		switch (dataTypeID) {
-		case STORED_PATTERN: {
-			RD8StoredPattern pattern(this);
-			return pattern.isDataDump(message);
-		}
-		case LIVE_PATTERN: {
-			RD8LivePattern pattern(this);
-			return pattern.isDataDump(message);
-		}
-		case STORED_SONG: {
-			RD8StoredSong song(this);
-			return song.isDataDump(message);
-		}
-		case LIVE_SONG: {
-			RD8LiveSong song(this);
-			return song.isDataDump(message);
-		}
-		case SETTINGS: {
-			RD8GlobalSettings settings(this);
-			return settings.isDataDump(message);
-		}
-		default:
-			jassert(false);
-			return false;
-		}
+		jassert(dataTypeID >= STORED_PATTERN && dataTypeID <= SETTINGS);
+		return message.isSysEx() && dataTypeOfSysex(message.getSysExData(), (size_t) message.getSysExDataSize()) == dataTypeID;
 	}
 
 	std::vector<std::shared_ptr<DataFile>> BehringerRD8::loadData(std::vector<MidiMessage> messages, int dataTypeID) const
+	{
+		return loadDataFiles(messages, dataTypeID);
+	}
+
+	std::vector<std::shared_ptr<DataFile>> BehringerRD8::loadDataFiles(std::vector<MidiMessage> const &messages, int dataTypeID) const
 	{
 		std::vector<std::shared_ptr<DataFile>> result;
 		for (const auto& message : messages) {
 			if (isDataFile(message, dataTypeID)) {
-				std::shared_ptr<RD8DataFile> data;
-				auto ID = getMessageID(message);
-				switch (ID.messageID) {
-				case RD8_LIVE_PATTERN_RESPONSE:
-					data = std::make_shared<RD8LivePattern>(this);
-					if (data->dataFromSysex({ message })) {
-						//Sysex::saveSysexIntoNewFile(R"(d:\christof\music\Behringer-RD8\sysex)", "LivePattern", { message });
-						result.push_back(data);
-					}
-					break;
-				case RD8_STORED_PATTERN_RESPONSE:
-					data = std::make_shared<RD8StoredPattern>(this);
-					//Sysex::saveSysexIntoNewFile(R"(d:\christof\music\Behringer-RD8\sysex)", "StoredPattern", { message });
-					if (data->dataFromSysex({ message })) {
-						result.push_back(data);
-					}
-					break;
-				case RD8_LIVE_SONG_RESPONSE:
-					data = std::make_shared<RD8LiveSong>(this);
-					//Sysex::saveSysexIntoNewFile(R"(d:\christof\music\Behringer-RD8\sysex)", "LiveSong", { message });
-					if (data->dataFromSysex({ message })) {
-						result.push_back(data);
-					}
-					break;
-				case RD8_STORED_SONG_RESPONSE:
-					data = std::make_shared<RD8StoredSong>(this);
-					//Sysex::saveSysexIntoNewFile(R"(d:\christof\music\Behringer-RD8\sysex)", "StoredSong", { message });
-					if (data->dataFromSysex({ message })) {
-						result.push_back(data);
-					}
-					break;
-				case RD8_GLOBAL_SETTINGS_RESPONSE: {
-					auto settingsData = std::make_shared<RD8GlobalSettings>(this);
-					//Sysex::saveSysexIntoNewFile(R"(d:\christof\music\Behringer-RD8\sysex)", "GlobalSettingsDump", { message });
-					if (settingsData->dataFromSysex({ message })) {
-						result.push_back(settingsData);
-					}
-					break;
-				}
+				auto data = dataFileFromSysex(message.getSysExData(), (size_t) message.getSysExDataSize());
+				if (data) {
+					//Sysex::saveSysexIntoNewFile(R"(d:\christof\music\Behringer-RD8\sysex)", data->name(), { message });
+					result.push_back(data);
 				}
 			}
 		}
 		return result;
 	}
 
+	int BehringerRD8::dataTypeOfSysex(uint8 const *sysexData, size_t size)
+	{
+		// Same header check as isOwnSysex and getMessageID, but without the need for a MidiMessage
+		if (size <= 6 || sysexData[0] != 0x00 || sysexData[1] != 0x20 || sysexData[2] != BEHRINGER_ID || sysexData[3] != RD8_ID || sysexData[5] != RD8_DATA_MESSAGE) {
+			return -1;
+		}
+		switch (sysexData[6]) {
+		case RD8_STORED_PATTERN_RESPONSE: return STORED_PATTERN;
+		case RD8_STORED_SONG_RESPONSE: return STORED_SONG;
+		case RD8_LIVE_PATTERN_RESPONSE: return LIVE_PATTERN;
+		case RD8_LIVE_SONG_RESPONSE: return LIVE_SONG;
+		case RD8_GLOBAL_SETTINGS_RESPONSE: return SETTINGS;
+		default:
+			return -1;
+		}
+	}
+
+	std::shared_ptr<RD8DataFile> BehringerRD8::dataFileFromSysex(uint8 const *sysexData, size_t size) const
+	{
+		int dataType = dataTypeOfSysex(sysexData, size);
+		std::shared_ptr<RD8DataFile> data;
+		switch (dataType) {
+		case STORED_PATTERN: data = std::make_shared<RD8StoredPattern>(this); break;
+		case LIVE_PATTERN: data = std::make_shared<RD8LivePattern>(this); break;
+		case STORED_SONG: data = std::make_shared<RD8StoredSong>(this); break;
+		case LIVE_SONG: data = std::make_shared<RD8LiveSong>(this); break;
+		case SETTINGS: data = std::make_shared<RD8GlobalSettings>(this); break;
+		default:
+			return nullptr;
+		}
+		return data->dataFromSysexData(sysexData, size) ? data : nullptr;
+	}
+
+	std::shared_ptr<RD8BulkFetch> BehringerRD8::fetchAllDataItems(int dataTypeID, RD8BulkFetch::ProgressCallback progress, RD8BulkFetch::FinishedCallback finished, RD8BulkFetch::Options options)
+	{
+		std::vector<int> itemNos;
+		for (int i = 0; i < numberOfDataItemsPerType(dataTypeID); i++) {
+			itemNos.push_back(i);
+		}
+		auto fetch = std::make_shared<RD8BulkFetch>(this, *requests_, dataTypeID, itemNos, options);
+		fetch->start(progress, finished);
+		return fetch;
+	}
+
+	std::shared_ptr<RD8BulkRestore> BehringerRD8::restoreDataFiles(std::vector<std::shared_ptr<DataFile>> const &dataFiles, RD8BulkRestore::ProgressCallback progress,
+		RD8BulkRestore::FinishedCallback finished, RD8BulkRestore::Options options)
+	{
+		auto restore = std::make_shared<RD8BulkRestore>(this, *requests_, options);
+		for (auto const &dataFile : dataFiles) {
+			if (!restore->addDataFile(dataFile)) {
+				jassertfalse; // Only stored patterns, stored songs and settings can be restored
+			}
+		}
+		restore->start(progress, finished);
+		return restore;
+	}
+
 	std::shared_ptr<StepSequencerPattern> BehringerRD8::activePattern()
 	{
+		// Only known while mirroring the device
+		if (!liveMirror_->hasPattern()) {
+			return nullptr;
+		}
 		return livePattern_;
 	}
 
@@ -295,7 +554,16 @@ namespace midikraft {
 
 	void BehringerRD8::getMidiChannelsFromDevice() {
 		globalSettingsOperation(MidiController::instance(), [this](std::shared_ptr<RD8GlobalSettings> settings) {
-			uint8 rxChannel = settings->peekSetting("MIDI RX Channel");
+			bool firstDetected;
+			{
+				ScopedLock lock(detectionPortLock_);
+				firstDetected = probedPort_.empty();
+			}
+			if (firstDetected && !midiOutput().empty()) {
+				// Detection has set the port by now, remember the device for the next detection
+				storeKnownDevice(midiOutput(), { deviceID_, version_, measuredRoundtripMS_ });
+			}
+			uint8 rxChannel = settings->peek(RD8GlobalSettings::MidiRxChannel);
 			if (rxChannel == 16) {
 				setChannel(MidiChannel::omniChannel());
 			}
@@ -306,59 +574,49 @@ namespace midikraft {
 			else {
 				setChannel(MidiChannel::fromZeroBase(rxChannel));
 			}
-			uint8 txChannel = settings->peekSetting("MIDI TX Channel");
+			uint8 txChannel = settings->peek(RD8GlobalSettings::MidiTxChannel);
 			if (txChannel == 16) {
 				outputChannel_ = MidiChannel::omniChannel();
 			}
 			else {
 				outputChannel_ = MidiChannel::fromZeroBase(txChannel);
 			}
+		}, []() {
+			// The device didn't answer, keep the channels we have. The next detection will ask again
 		});
 	}
 
-	void BehringerRD8::globalSettingsOperation(MidiController *controller, std::function<void(std::shared_ptr<RD8GlobalSettings> settingsData)> operation)
+	void BehringerRD8::globalSettingsOperation(MidiController *controller, std::function<void(std::shared_ptr<RD8GlobalSettings> settingsData)> operation,
+		std::function<void()> onFailed)
 	{
 		ignoreUnused(controller);
-		if (!roundtripHandle_.isNull()) {
-			// Another action is still active, don't interrupt it
-			jassert(false);
-			return;
-		}
-		MidiController::instance()->enableMidiInput(midiInput());
-		MidiController::instance()->addMessageHandler(roundtripHandle_, [this, operation](MidiInput *source, const MidiMessage &message) {
-			ignoreUnused(source);
-			if (isDataFile(message, SETTINGS)) {
-				auto settingsData = std::make_shared<RD8GlobalSettings>(this);
-				if (settingsData->dataFromSysex({ message })) {
-					operation(settingsData);
+		requests_->send(requestDataItem(0, SETTINGS), RD8RequestMultiplexer::CorrelationKey::forDataItem(SETTINGS, 0), 1000,
+			[this, operation, onFailed](RD8RequestMultiplexer::Result result, MidiMessage const &message) {
+			auto settingsData = std::make_shared<RD8GlobalSettings>(this);
+			if (result != RD8RequestMultiplexer::Result::Success || !settingsData->dataFromSysexData(message.getSysExData(), (size_t) message.getSysExDataSize())) {
+				// The device didn't answer, let the caller know
+				if (onFailed) {
+					onFailed();
 				}
-				MidiController::instance()->removeMessageHandler(roundtripHandle_);
-				roundtripHandle_ = MidiController::makeNoneHandle();
+				return;
 			}
+			setDeviceSettings(*settingsData);
+			operation(settingsData);
 		});
-		auto buffer = MidiHelpers::bufferFromMessages(requestDataItem(0, SETTINGS));
-		MidiController::instance()->getMidiOutput(midiOutput())->sendBlockOfMessagesNow(buffer);
 	}
 
 	void BehringerRD8::changeInputChannel(MidiController *controller, MidiChannel channel, std::function<void()> onFinished)
 	{
-		globalSettingsOperation(controller, [this, channel, onFinished](std::shared_ptr<RD8GlobalSettings> settings) {
-			bool success;
-			if (channel.isOmni()) {
-				success = settings->pokeSetting("MIDI RX Channel", 16);
-			}
-			else {
-				success = settings->pokeSetting("MIDI RX Channel", (uint8) channel.toZeroBasedInt());
-			}
-
-			if (success) {
-				// Persist the new input channel in the SimpleDiscoverableDevice base class
-				setChannel(channel);
-				// Send an update message to the device. Sadly, this is the whole settings page with the new channel patched in
-				auto updatedMessage = MidiHelpers::bufferFromMessages(settings->dataToSysex());
-				MidiController::instance()->getMidiOutput(midiOutput())->sendBlockOfMessagesNow(updatedMessage);
-				onFinished();
-			}
+		editGlobalSettings(controller, [channel](RD8SettingsTransaction &settings) {
+			return settings.set(RD8GlobalSettings::MidiRxChannel, channel.isOmni() ? (uint8) 16 : (uint8) channel.toZeroBasedInt());
+		}, [this, channel, onFinished](bool changed) {
+			ignoreUnused(changed);
+			// Persist the new input channel in the SimpleDiscoverableDevice base class
+			setChannel(channel);
+			onFinished();
+		}, [onFinished]() {
+			// The device didn't answer, the channel stays as it was
+			onFinished();
 		});
 	}
 
@@ -385,23 +643,16 @@ namespace midikraft {
 
 	void BehringerRD8::changeOutputChannel(MidiController *controller, MidiChannel newChannel, std::function<void()> onFinished)
 	{
-		globalSettingsOperation(controller, [this, newChannel, onFinished](std::shared_ptr<RD8GlobalSettings> settings) {
-			bool success;
-			if (newChannel.isOmni()) {
-				success = settings->pokeSetting("MIDI TX Channel", 16);
-			}
-			else {
-				success = settings->pokeSetting("MIDI TX Channel", (uint8) newChannel.toZeroBasedInt());
-			}
-
-			if (success) {
-				// Persist the new output channel in the SimpleDiscoverableDevice base class
-				outputChannel_ = newChannel;
-				// Send an update message to the device. Sadly, this is the whole settings page with the new channel patched in
-				auto updatedMessage = MidiHelpers::bufferFromMessages(settings->dataToSysex());
-				MidiController::instance()->getMidiOutput(midiOutput())->sendBlockOfMessagesNow(updatedMessage);
-				onFinished();
-			}
+		editGlobalSettings(controller, [newChannel](RD8SettingsTransaction &settings) {
+			return settings.set(RD8GlobalSettings::MidiTxChannel, newChannel.isOmni() ? (uint8) 16 : (uint8) newChannel.toZeroBasedInt());
+		}, [this, newChannel, onFinished](bool changed) {
+			ignoreUnused(changed);
+			// Persist the new output channel
+			outputChannel_ = newChannel;
+			onFinished();
+		}, [onFinished]() {
+			// The device didn't answer, the channel stays as it was
+			onFinished();
 		});
 	}
 
@@ -429,30 +680,9 @@ namespace midikraft {
 	std::shared_ptr<midikraft::DataFile> BehringerRD8::patchFromPatchData(const Synth::PatchData &data, MidiProgramNumber place) const
 	{
 		ignoreUnused(place);
-		MidiMessage sysex = MidiHelpers::sysexMessage(data);
-		if (isDataFile(sysex, STORED_PATTERN)) {
-			auto pattern = std::make_unique<RD8StoredPattern>(this);
-			if (pattern->dataFromSysex({ sysex })) {
-				return pattern;
-			}
-		} 
-		if (isDataFile(sysex, LIVE_PATTERN)) {
-			auto pattern = std::make_unique<RD8LivePattern>(this);
-			if (pattern->dataFromSysex({ sysex })) {
-				return pattern;
-			}
-		}
-		if (isDataFile(sysex, STORED_SONG)) {
-			auto pattern = std::make_unique<RD8StoredSong>(this);
-			if (pattern->dataFromSysex({ sysex })) {
-				return pattern;
-			}
-		}
-		if (isDataFile(sysex, LIVE_SONG)) {
-			auto pattern = std::make_unique<RD8LiveSong>(this);
-			if (pattern->dataFromSysex({ sysex })) {
-				return pattern;
-			}
+		// Patterns and songs only, the global settings are not stored as patches
+		if (dataTypeOfSysex(data.data(), data.size()) != SETTINGS) {
+			return dataFileFromSysex(data.data(), data.size());
 		}
 		return nullptr;
 	}
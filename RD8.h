@@ -9,7 +9,15 @@
 
 #include "MidiController.h"
 
+#include <atomic>
+
 #include "RD8Pattern.h"
+#include "RD8RequestMultiplexer.h"
+#include "RD8BulkFetch.h"
+#include "RD8BulkRestore.h"
+#include "RD8SettingsTransaction.h"
+#include "RD8LiveMirror.h"
+#include "RD8Metrics.h"
 
 namespace midikraft {
 
@@ -55,6 +63,7 @@ namespace midikraft {
 		};
 
 		BehringerRD8();
+		virtual ~BehringerRD8() override;
 
 		virtual std::shared_ptr<DataFile> patchFromPatchData(const Synth::PatchData &data, MidiProgramNumber place) const override;
 		virtual bool isOwnSysex(MidiMessage const &message) const override;
@@ -65,12 +74,25 @@ namespace midikraft {
 		virtual MidiChannel channelIfValidDeviceResponse(const MidiMessage &message) override;
 		virtual bool needsChannelSpecificDetection() override;
 
+		// Detection mode that sends the firmware request to all 16 device IDs at once, and waits only as long as the measured
+		// roundtrip time requires. If a device was found on the probed port before, its ID is asked alone first
+		void setBroadcastDetection(bool broadcast);
+		bool isBroadcastDetection() const;
+
+		// The MIDI output the next deviceDetect calls are sent to, as the detection loop doesn't tell us. The device found there
+		// is remembered for that port. If the host doesn't set it, midiOutput() is used, i.e. the port the device was detected
+		// on before. On the very first detection that is not known yet, so all 16 device IDs are asked, and the device is
+		// remembered for the port detection settles on
+		void setDetectionPort(std::string const &midiOutput);
+
 		// Implementation of NamedDevice interface
 		virtual std::string getName() const override;
 
 		// Helper functions
 		std::vector<uint8> createSysexMessage(uint8 deviceID, uint8 messageType, uint8 messageID) const;
 		std::vector<uint8> createRequestMessage(MessageID id) const;
+		static constexpr size_t kRequestHeaderSize = 14;
+		size_t writeRequestHeader(MessageID id, uint8 *out) const; // Same as createRequestMessage, into kRequestHeaderSize bytes of memory
 		MessageID getMessageID(MidiMessage const &midiMessage) const;
 
 		// DataFileLoadCapability
@@ -80,6 +102,20 @@ namespace midikraft {
 		virtual std::vector<std::shared_ptr<DataFile>> loadData(std::vector<MidiMessage> messages, int dataTypeID) const override;
 		std::vector<DataFileDescription> dataTypeNames() const override;
 
+		// Copy-free parse path. The data type is determined from the header bytes only, and the data file is built directly from the sysex data
+		static int dataTypeOfSysex(uint8 const *sysexData, size_t size); // -1 if this is no RD8 data file
+		std::shared_ptr<RD8DataFile> dataFileFromSysex(uint8 const *sysexData, size_t size) const;
+		std::vector<std::shared_ptr<DataFile>> loadDataFiles(std::vector<MidiMessage> const &messages, int dataTypeID) const;
+
+		// Fetch all items of a data type with several requests in flight. Keep the returned object alive until finished
+		std::shared_ptr<RD8BulkFetch> fetchAllDataItems(int dataTypeID, RD8BulkFetch::ProgressCallback progress, RD8BulkFetch::FinishedCallback finished,
+			RD8BulkFetch::Options options = RD8BulkFetch::Options());
+
+		// Upload stored patterns, songs and settings to the slots they came from, paced and optionally verified.
+		// Keep the returned object alive until finished
+		std::shared_ptr<RD8BulkRestore> restoreDataFiles(std::vector<std::shared_ptr<DataFile>> const &dataFiles, RD8BulkRestore::ProgressCallback progress,
+			RD8BulkRestore::FinishedCallback finished, RD8BulkRestore::Options options = RD8BulkRestore::Options());
+
 		// Implementation of sequencer interface
 		virtual int numberOfSongs() const; // override;
 		virtual int numberOfPatternsPerSong() const; // override;
@@ -113,22 +149,73 @@ namespace midikraft {
 		DataFileLoadCapability * loader() override;
 		int settingsDataFileType() const override;
 
+		// Settings transactions. The settings are only read from the device if there is no copy known to be current,
+		// and only sent back if the edit changed something. onFailed is called instead if the device doesn't answer.
+		// The copy counts as current for kDeviceSettingsMaxAgeMS after it was read or sent, so a burst of edits reads once,
+		// but a change made on the front panel of the device since then is not overwritten. Detection and a new transport drop it
+		static constexpr uint32 kDeviceSettingsMaxAgeMS = 2000;
+		typedef std::function<bool(RD8SettingsTransaction &transaction)> SettingsEdit;
+		void editGlobalSettings(MidiController *controller, SettingsEdit edit, std::function<void(bool changed)> onCommitted, std::function<void()> onFailed = nullptr);
+		void sendGlobalSettings(RD8GlobalSettings const &settings, bool debounced); // Updates the shadow copy
+		void invalidateGlobalSettingsCache(); // Call if the settings might have been changed at the device
+
+		// All request/response transactions with the device go through this
+		RD8RequestMultiplexer &requests();
+
+		// The MIDI I/O for these transactions, by default the MidiController with the ports the device was detected on
+		std::shared_ptr<RD8MidiTransport> transport() const;
+		void setTransport(std::shared_ptr<RD8MidiTransport> transport);
+
+		// Counters and latency histograms of the transactions and the decoding
+		RD8Metrics &metrics() const;
+
+		// Live mirror mode, keeps the activePattern() up to date with the edit buffer of the device
+		void setLiveMirror(bool on);
+		RD8LiveMirror &liveMirror();
+
 	private:
-		void globalSettingsOperation(MidiController *controller, std::function<void(std::shared_ptr<RD8GlobalSettings> settingsData)> operation);
+		void globalSettingsOperation(MidiController *controller, std::function<void(std::shared_ptr<RD8GlobalSettings> settingsData)> operation,
+			std::function<void()> onFailed); // onFailed if there is no valid answer in time
 		void valueTreePropertyChanged(ValueTree& treeWhosePropertyHasChanged, const Identifier& property) override;
 		void getMidiChannelsFromDevice();
+		std::shared_ptr<RD8GlobalSettings> currentDeviceSettings(); // The shadow copy, or nullptr if there is none or it is too old
+		void setDeviceSettings(RD8GlobalSettings const &settings);
 
 		struct FirmwareVersion { uint8 major, minor, patch; };
 
-		uint8 deviceID_;
-		FirmwareVersion version_;
+		// Cache of the device found on a port, persisted so the next detection can try that device ID first and knows how long to wait
+		struct KnownDevice { uint8 deviceID; FirmwareVersion version; int roundtripMS; };
+		static bool loadKnownDevice(std::string const &port, KnownDevice &outDevice);
+		void loadDetectionPortDevice(); // Sets hasKnownDevice_ and knownDevice_ for the detection port
+		static void storeKnownDevice(std::string const &port, KnownDevice const &device);
+
+		bool broadcastDetection_ = false;
+		CriticalSection detectionPortLock_;
+		std::string detectionPort_;
+		std::string probedPort_; // The port the current detection probes, empty if it is not known yet
+		bool hasKnownDevice_ = false;
+		KnownDevice knownDevice_ = { 0, { 0, 0, 0 }, -1 };
+		bool fallbackSent_ = false;
+		int lastDetectProbes_ = 0;
+		std::atomic<bool> detectAnswered_ { false };
+		std::atomic<uint32> detectSentAtMS_ { 0 }; // When the first of the last probes was sent, 0 if none was sent
+		std::atomic<int> measuredRoundtripMS_ { -1 };
+
+		uint8 deviceID_ = 0;
+		FirmwareVersion version_ = { 0, 0, 0 };
 		std::shared_ptr<RD8Pattern::PatternData> livePattern_; // quasi the edit buffer of the device
 		std::vector<std::shared_ptr<TypedNamedValue>> properties_;
 		MidiChannel outputChannel_ = MidiChannel::invalidChannel();
 
-		MidiController::HandlerHandle roundtripHandle_ = MidiController::makeNoneHandle();
+		std::unique_ptr<RD8Metrics> metrics_;
+		std::shared_ptr<RD8MidiTransport> transport_;
+		std::unique_ptr<RD8RequestMultiplexer> requests_;
+		std::unique_ptr<RD8LiveMirror> liveMirror_;
 
 		std::shared_ptr<RD8GlobalSettings> globalSettings_;
+		CriticalSection deviceSettingsLock_;
+		std::shared_ptr<RD8GlobalSettings> deviceSettings_; // Shadow copy of the settings the device has, if known
+		uint32 deviceSettingsTimeMS_ = 0; // When the shadow copy was read or sent
 		ValueTree globalSettingsTree_;
 	};
 
@@ -0,0 +1,140 @@
+#include "RD8ArchiveImporter.h"
+
+#include "RD8.h"
+
+#include <algorithm>
+
+namespace midikraft {
+
+	namespace {
+		// Number of frames a worker takes from the shared queue at once
+		const size_t kFramesPerChunk = 64;
+	}
+
+	RD8ArchiveImporter::RD8ArchiveImporter(BehringerRD8 const *rd8, int numberOfThreads) :
+		rd8_(rd8), numberOfThreads_(numberOfThreads > 0 ? numberOfThreads : SystemStats::getNumCpus()), pool_(numberOfThreads_)
+	{
+	}
+
+	std::vector<RD8ArchiveImporter::SysexFrame> RD8ArchiveImporter::splitSysex(uint8 const *data, size_t size)
+	{
+		auto isStatus = [](uint8 byte) { return (byte & 0x80) != 0; };
+		std::vector<SysexFrame> result;
+		size_t i = 0;
+		while (i < size) {
+			auto start = static_cast<uint8 const *>(memchr(data + i, 0xf0, size - i));
+			if (start == nullptr) {
+				break;
+			}
+			uint8 const *body = start + 1;
+			uint8 const *end = std::find_if(body, data + size, isStatus);
+			// Realtime messages may appear anywhere, even inside sysex. Only then the frame is copied, without them
+			std::shared_ptr<std::vector<uint8>> cleaned;
+			uint8 const *copyFrom = body;
+			while (end != data + size && *end >= 0xf8) {
+				if (!cleaned) {
+					cleaned = std::make_shared<std::vector<uint8>>();
+				}
+				cleaned->insert(cleaned->end(), copyFrom, end);
+				copyFrom = end + 1;
+				end = std::find_if(copyFrom, data + size, isStatus);
+			}
+			if (end == data + size) {
+				// Truncated message at the end of the buffer, ignore it
+				break;
+			}
+			if (*end != 0xf7) {
+				// Any other status byte means the sysex was interrupted, restart the scan at that byte
+				i = (size_t) (end - data);
+				continue;
+			}
+			if (cleaned) {
+				cleaned->insert(cleaned->end(), copyFrom, end);
+				result.push_back({ cleaned->data(), cleaned->size(), cleaned });
+			}
+			else {
+				result.push_back({ body, (size_t) (end - body), nullptr });
+			}
+			i = (size_t) (end - data) + 1;
+		}
+		return result;
+	}
+
+	std::vector<std::shared_ptr<DataFile>> RD8ArchiveImporter::importFrames(std::vector<SysexFrame> const &frames, int dataTypeID)
+	{
+		std::vector<std::shared_ptr<DataFile>> decoded(frames.size());
+
+		// The workers pull chunks of frames from a shared counter until all are taken, so fast workers automatically take more chunks
+		std::atomic<size_t> nextChunk { 0 };
+		size_t numberOfChunks = (frames.size() + kFramesPerChunk - 1) / kFramesPerChunk;
+		int numberOfWorkers = (int) std::min((size_t) numberOfThreads_, numberOfChunks);
+		std::atomic<int> workersRunning { numberOfWorkers };
+		WaitableEvent allDone;
+		auto worker = [&]() {
+			size_t chunk;
+			while ((chunk = nextChunk++) < numberOfChunks) {
+				size_t end = std::min(frames.size(), (chunk + 1) * kFramesPerChunk);
+				for (size_t i = chunk * kFramesPerChunk; i < end; i++) {
+					auto const &frame = frames[i];
+					int type = BehringerRD8::dataTypeOfSysex(frame.sysexData, frame.size);
+					if (type != -1 && (dataTypeID == -1 || type == dataTypeID)) {
+						decoded[i] = rd8_->dataFileFromSysex(frame.sysexData, frame.size);
+					}
+				}
+			}
+			if (--workersRunning == 0) {
+				allDone.signal();
+			}
+		};
+		if (numberOfWorkers > 0) {
+			for (int i = 0; i < numberOfWorkers; i++) {
+				pool_.addJob(worker);
+			}
+			allDone.wait();
+		}
+
+		// Merge in the original order
+		std::vector<std::shared_ptr<DataFile>> result;
+		result.reserve(decoded.size());
+		for (auto &dataFile : decoded) {
+			if (dataFile) {
+				result.push_back(std::move(dataFile));
+			}
+		}
+		return result;
+	}
+
+	std::vector<std::shared_ptr<DataFile>> RD8ArchiveImporter::importBuffer(uint8 const *data, size_t size, int dataTypeID)
+	{
+		return importFrames(splitSysex(data, size), dataTypeID);
+	}
+
+	std::vector<std::shared_ptr<DataFile>> RD8ArchiveImporter::importFiles(std::vector<File> const &files, int dataTypeID)
+	{
+		// Map all files, and decode all of their frames in one go so the pool is busy even with many small files
+		std::vector<std::unique_ptr<MemoryMappedFile>> mappedFiles;
+		std::vector<SysexFrame> frames;
+		for (auto const &file : files) {
+			auto mapped = std::make_unique<MemoryMappedFile>(file, MemoryMappedFile::readOnly);
+			if (mapped->getData() == nullptr) {
+				continue;
+			}
+			auto fileFrames = splitSysex(static_cast<uint8 const *>(mapped->getData()), mapped->getSize());
+			frames.insert(frames.end(), fileFrames.begin(), fileFrames.end());
+			mappedFiles.push_back(std::move(mapped));
+		}
+		return importFrames(frames, dataTypeID);
+	}
+
+	std::vector<std::shared_ptr<DataFile>> RD8ArchiveImporter::importDirectory(File const &directory, bool recursive, int dataTypeID)
+	{
+		std::vector<File> files;
+		for (auto const &file : directory.findChildFiles(File::findFiles, recursive, "*.syx")) {
+			files.push_back(file);
+		}
+		// Sort for a reproducible order
+		std::sort(files.begin(), files.end());
+		return importFiles(files, dataTypeID);
+	}
+
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "Patch.h"
+
+namespace midikraft {
+
+	class BehringerRD8;
+
+	// Imports large collections of RD8 sysex dumps, from buffers, .syx files or directories of them.
+	// The dumps are split at F0/F7, classified and decoded on a thread pool, and returned in their original order.
+	class RD8ArchiveImporter {
+	public:
+		// A sysex message inside a buffer, referring to the data between F0 and F7. If realtime bytes had to be left out,
+		// the data is a copy held by storage
+		struct SysexFrame {
+			uint8 const *sysexData;
+			size_t size;
+			std::shared_ptr<std::vector<uint8> const> storage;
+		};
+
+		RD8ArchiveImporter(BehringerRD8 const *rd8, int numberOfThreads = 0); // 0 = one per CPU
+
+		// Uses the same rules as RD8SysexFramer: realtime bytes inside a message are skipped, any other status byte interrupts it
+		static std::vector<SysexFrame> splitSysex(uint8 const *data, size_t size);
+
+		// Pass a data type ID to import only files of that type, or -1 for everything
+		std::vector<std::shared_ptr<DataFile>> importFrames(std::vector<SysexFrame> const &frames, int dataTypeID = -1);
+		std::vector<std::shared_ptr<DataFile>> importBuffer(uint8 const *data, size_t size, int dataTypeID = -1);
+		std::vector<std::shared_ptr<DataFile>> importFiles(std::vector<File> const &files, int dataTypeID = -1);
+		std::vector<std::shared_ptr<DataFile>> importDirectory(File const &directory, bool recursive, int dataTypeID = -1);
+
+	private:
+		BehringerRD8 const *rd8_;
+		int numberOfThreads_;
+		ThreadPool pool_;
+	};
+
+}
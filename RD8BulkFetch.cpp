@@ -0,0 +1,179 @@
+#include "RD8BulkFetch.h"
+
+#include "RD8.h"
+
+#include <algorithm>
+
+namespace midikraft {
+
+	RD8BulkFetch::RD8BulkFetch(BehringerRD8 *rd8, RD8RequestMultiplexer &requests, int dataTypeID, std::vector<int> const &itemNos, Options options) :
+		rd8_(rd8), requests_(requests), dataTypeID_(dataTypeID), options_(options), itemsTotal_((int) itemNos.size()), pending_(itemNos.begin(), itemNos.end())
+	{
+		jassert(options_.windowSize > 0);
+	}
+
+	RD8BulkFetch::~RD8BulkFetch()
+	{
+		cancel();
+	}
+
+	void RD8BulkFetch::start(ProgressCallback progress, FinishedCallback finished)
+	{
+		std::vector<Request> requests;
+		Completion completion;
+		{
+			ScopedLock lock(lock_);
+			if (running_) {
+				jassertfalse;
+				return;
+			}
+			running_ = true;
+			progress_ = progress;
+			finished_ = finished;
+			fillWindow(requests);
+			if (requests.empty()) {
+				// Nothing to do
+				finish(completion);
+			}
+		}
+		sendRequests(requests);
+		completion.call(itemsTotal_);
+	}
+
+	void RD8BulkFetch::cancel()
+	{
+		ScopedLock lock(lock_);
+		running_ = false;
+		for (auto const &request : outstanding_) {
+			requests_.cancel(request.second);
+		}
+		outstanding_.clear();
+	}
+
+	bool RD8BulkFetch::isRunning() const
+	{
+		ScopedLock lock(lock_);
+		return running_;
+	}
+
+	int RD8BulkFetch::itemNoFromResponse(BehringerRD8 const *rd8, MidiMessage const &message, int dataTypeID)
+	{
+		if (!rd8->isDataFile(message, dataTypeID)) {
+			return -1;
+		}
+		// The response repeats the item bytes of the request after the 14 bytes header
+		auto data = message.getSysExData();
+		switch (dataTypeID) {
+		case BehringerRD8::STORED_PATTERN:
+			return message.getSysExDataSize() > 15 ? data[14] * 16 + data[15] : -1;
+		case BehringerRD8::STORED_SONG:
+			return message.getSysExDataSize() > 14 ? data[14] : -1;
+		default:
+			// Single item types
+			return 0;
+		}
+	}
+
+	void RD8BulkFetch::handleResult(int itemNo, int retries, RD8RequestMultiplexer::Result result, MidiMessage const &response)
+	{
+		// Decode outside of the lock
+		std::shared_ptr<DataFile> dataFile;
+		if (result == RD8RequestMultiplexer::Result::Success) {
+			dataFile = rd8_->dataFileFromSysex(response.getSysExData(), (size_t) response.getSysExDataSize());
+		}
+
+		std::vector<Request> requests;
+		Completion completion;
+		{
+			ScopedLock lock(lock_);
+			if (!running_) {
+				return;
+			}
+			if (result == RD8RequestMultiplexer::Result::Timeout && retries < options_.maxRetries) {
+				outstanding_[itemNo] = 0;
+				requests.push_back({ itemNo, retries + 1 });
+			}
+			else {
+				outstanding_.erase(itemNo);
+				if (dataFile) {
+					results_[itemNo] = dataFile;
+				}
+				else {
+					failed_.push_back(itemNo);
+				}
+				completion.progress = progress_;
+				completion.itemsDone = (int) (results_.size() + failed_.size());
+				fillWindow(requests);
+				if (requests.empty() && outstanding_.empty() && pending_.empty()) {
+					finish(completion);
+				}
+			}
+		}
+		sendRequests(requests);
+		completion.call(itemsTotal_);
+	}
+
+	void RD8BulkFetch::fillWindow(std::vector<Request> &outRequests)
+	{
+		while (running_ && !pending_.empty() && (int) (outstanding_.size() + outRequests.size()) < options_.windowSize) {
+			outRequests.push_back({ pending_.front(), 0 });
+			pending_.pop_front();
+		}
+		// Mark them outstanding now, the request IDs follow once they are sent
+		for (auto const &request : outRequests) {
+			outstanding_[request.itemNo] = 0;
+		}
+	}
+
+	void RD8BulkFetch::sendRequests(std::vector<Request> const &requests)
+	{
+		std::weak_ptr<RD8BulkFetch> weakThis = shared_from_this();
+		for (auto const &request : requests) {
+			int itemNo = request.itemNo;
+			int retries = request.retries;
+			auto key = RD8RequestMultiplexer::CorrelationKey::forDataItem(dataTypeID_, itemNo);
+			auto requestID = requests_.send(rd8_->requestDataItem(itemNo, dataTypeID_), key, options_.timeoutMS,
+				[weakThis, itemNo, retries](RD8RequestMultiplexer::Result result, MidiMessage const &response) {
+				// Keeps us alive until the result is handled, or does nothing if we are gone already
+				if (auto fetch = weakThis.lock()) {
+					fetch->handleResult(itemNo, retries, result, response);
+				}
+			});
+
+			ScopedLock lock(lock_);
+			auto found = outstanding_.find(itemNo);
+			if (found != outstanding_.end() && found->second == 0) {
+				found->second = requestID;
+			}
+			else if (!running_) {
+				// Cancelled while we were sending
+				requests_.cancel(requestID);
+			}
+		}
+	}
+
+	void RD8BulkFetch::finish(Completion &outCompletion)
+	{
+		if (!running_) {
+			return;
+		}
+		running_ = false;
+		for (auto const &item : results_) {
+			outCompletion.result.push_back(item.second);
+		}
+		std::sort(failed_.begin(), failed_.end());
+		outCompletion.failedItems = failed_;
+		outCompletion.finished = finished_;
+	}
+
+	void RD8BulkFetch::Completion::call(int itemsTotal) const
+	{
+		if (progress) {
+			progress(itemsDone, itemsTotal);
+		}
+		if (finished) {
+			finished(result, failedItems);
+		}
+	}
+
+}
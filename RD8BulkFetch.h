@@ -0,0 +1,75 @@
+#pragma once
+
+#include "Patch.h"
+#include "RD8RequestMultiplexer.h"
+
+#include <deque>
+
+namespace midikraft {
+
+	class BehringerRD8;
+
+	// Fetches many data items from the RD8 with a window of outstanding requests, instead of one roundtrip per item.
+	// Responses are matched by the item bytes in the reply, items that time out are requested again.
+	// Create it with std::make_shared, the pending requests only hold a weak reference to it. The callbacks are called from the
+	// MIDI input thread or the timeout thread of the multiplexer, without a lock held, so they may drop the last reference.
+	class RD8BulkFetch : public std::enable_shared_from_this<RD8BulkFetch> {
+	public:
+		struct Options {
+			int windowSize = 4; // Number of requests in flight
+			int timeoutMS = 500; // Time after which an outstanding request is sent again
+			int maxRetries = 3; // After that many retries, the item is reported as failed
+		};
+
+		typedef std::function<void(int itemsDone, int itemsTotal)> ProgressCallback;
+		typedef std::function<void(std::vector<std::shared_ptr<DataFile>> const &result, std::vector<int> const &failedItems)> FinishedCallback;
+
+		RD8BulkFetch(BehringerRD8 *rd8, RD8RequestMultiplexer &requests, int dataTypeID, std::vector<int> const &itemNos, Options options);
+		virtual ~RD8BulkFetch();
+
+		void start(ProgressCallback progress, FinishedCallback finished);
+		void cancel();
+		bool isRunning() const;
+
+		// Returns the item number a response message belongs to, or -1 if it is no response for the data type
+		static int itemNoFromResponse(BehringerRD8 const *rd8, MidiMessage const &message, int dataTypeID);
+
+	private:
+		struct Request {
+			int itemNo;
+			int retries;
+		};
+
+		// What is left to do after the lock is released
+		struct Completion {
+			ProgressCallback progress;
+			int itemsDone = 0;
+			FinishedCallback finished;
+			std::vector<std::shared_ptr<DataFile>> result;
+			std::vector<int> failedItems;
+
+			void call(int itemsTotal) const;
+		};
+
+		void handleResult(int itemNo, int retries, RD8RequestMultiplexer::Result result, MidiMessage const &response);
+		void fillWindow(std::vector<Request> &outRequests); // Call with lock held
+		void sendRequests(std::vector<Request> const &requests); // Call without lock held, as a reply can come in on this thread
+		void finish(Completion &outCompletion); // Call with lock held
+
+		BehringerRD8 *rd8_;
+		RD8RequestMultiplexer &requests_;
+		int dataTypeID_;
+		Options options_;
+		int itemsTotal_;
+
+		CriticalSection lock_;
+		bool running_ = false;
+		std::deque<int> pending_;
+		std::map<int, RD8RequestMultiplexer::RequestID> outstanding_;
+		std::map<int, std::shared_ptr<DataFile>> results_; // Keyed by item number, so the result comes out in item order
+		std::vector<int> failed_;
+		ProgressCallback progress_;
+		FinishedCallback finished_;
+	};
+
+}
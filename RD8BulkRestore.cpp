@@ -0,0 +1,220 @@
+#include "RD8BulkRestore.h"
+
+#include "RD8.h"
+#include "RD8BulkFetch.h"
+#include "RD8Hash.h"
+#include "RD8PatternEncoder.h"
+
+namespace midikraft {
+
+	namespace {
+		// DIN MIDI transfers 10 bits per byte at 31250 baud
+		const double kDinMillisecondsPerByte = 10.0 * 1000.0 / 31250.0;
+		const float kMaxGapScale = 4.0f;
+		const int kSuccessesBeforeNarrowing = 8;
+
+		// Where the payload starts, behind the header and the slot bytes
+		size_t payloadOffset(int dataTypeID)
+		{
+			switch (dataTypeID) {
+			case BehringerRD8::STORED_PATTERN: return 16;
+			case BehringerRD8::STORED_SONG: return 15;
+			default:
+				return BehringerRD8::kRequestHeaderSize;
+			}
+		}
+	}
+
+	RD8BulkRestore::RD8BulkRestore(BehringerRD8 *rd8, RD8RequestMultiplexer &requests, Options options) :
+		Thread("RD8BulkRestore"), rd8_(rd8), requests_(requests), options_(options), link_(options.link), measureLink_(options.link == Link::Auto)
+	{
+		if (options.link == Link::Auto) {
+			// A guess until the first read back: the RD8 names its own USB MIDI port, anything else is an interface with a DIN cable
+			String output(rd8_->midiOutput());
+			link_ = output.containsIgnoreCase("RD-8") || output.containsIgnoreCase("RD8") ? Link::USB : Link::DIN;
+		}
+	}
+
+	RD8BulkRestore::~RD8BulkRestore()
+	{
+		cancel();
+	}
+
+	bool RD8BulkRestore::addDataFile(std::shared_ptr<DataFile> dataFile)
+	{
+		auto rd8DataFile = std::dynamic_pointer_cast<RD8DataFile>(dataFile);
+		if (!rd8DataFile) {
+			return false;
+		}
+		int dataTypeID = rd8DataFile->dataTypeID();
+		if (dataTypeID != BehringerRD8::STORED_PATTERN && dataTypeID != BehringerRD8::STORED_SONG && dataTypeID != BehringerRD8::SETTINGS) {
+			return false;
+		}
+		auto messages = rd8DataFile->dataToSysex();
+		if (messages.size() != 1) {
+			return false;
+		}
+		int itemNo = RD8BulkFetch::itemNoFromResponse(rd8_, messages[0], dataTypeID);
+		if (itemNo < 0) {
+			return false;
+		}
+		items_.push_back({ dataTypeID, itemNo, messages[0] });
+		return true;
+	}
+
+	void RD8BulkRestore::addPattern(RD8Pattern::PatternData const &pattern, int itemNo, uint8 const *templateData)
+	{
+		RD8PatternEncoder encoder(rd8_);
+		std::vector<uint8> buffer;
+		size_t size = encoder.encodeStoredPattern(pattern, itemNo, buffer, templateData);
+		items_.push_back({ BehringerRD8::STORED_PATTERN, itemNo, MidiMessage::createSysExMessage(buffer.data(), (int) size) });
+	}
+
+	size_t RD8BulkRestore::numberOfItems() const
+	{
+		return items_.size();
+	}
+
+	void RD8BulkRestore::start(ProgressCallback progress, FinishedCallback finished)
+	{
+		jassert(!isThreadRunning());
+		progress_ = progress;
+		finished_ = finished;
+		startThread();
+	}
+
+	void RD8BulkRestore::cancel()
+	{
+		stopThread(2000);
+	}
+
+	bool RD8BulkRestore::isRunning() const
+	{
+		return isThreadRunning();
+	}
+
+	RD8BulkRestore::Link RD8BulkRestore::link() const
+	{
+		return link_;
+	}
+
+	int RD8BulkRestore::currentGapMS(size_t messageSize) const
+	{
+		double transferMS = link_ == Link::DIN ? messageSize * kDinMillisecondsPerByte : 0.0;
+		return roundToInt((transferMS + options_.processingGapMS) * gapScale_);
+	}
+
+	uint64 RD8BulkRestore::payloadHash(int dataTypeID, uint8 const *sysexData, size_t size)
+	{
+		// The escaped bytes are compared, equal escaped data means equal data. The header differs between request and reply
+		size_t offset = payloadOffset(dataTypeID);
+		return size > offset ? RD8Hash::xxHash64(sysexData + offset, size - offset, (uint64) dataTypeID) : 0;
+	}
+
+	RD8BulkRestore::Verification RD8BulkRestore::verify(Item const &item, std::string &outReason)
+	{
+		// Shared with the callback, which might still run after a cancel
+		struct ReadBack {
+			WaitableEvent answered;
+			MidiMessage response;
+			bool timedOut = true;
+		};
+		auto readBack = std::make_shared<ReadBack>();
+		double sentAtMS = Time::getMillisecondCounterHiRes();
+		auto requestID = requests_.send(rd8_->requestDataItem(item.itemNo, item.dataTypeID), RD8RequestMultiplexer::CorrelationKey::forDataItem(item.dataTypeID, item.itemNo),
+			options_.verifyTimeoutMS, [readBack](RD8RequestMultiplexer::Result result, MidiMessage const &message) {
+			if (result == RD8RequestMultiplexer::Result::Success) {
+				readBack->response = message;
+				readBack->timedOut = false;
+			}
+			readBack->answered.signal();
+		});
+		// Wake up regularly to react to cancel, the multiplexer will report the timeout
+		while (!readBack->answered.wait(50)) {
+			if (threadShouldExit()) {
+				requests_.cancel(requestID);
+				outReason = "Cancelled";
+				return Verification::Cancelled;
+			}
+		}
+		auto const &response = readBack->response;
+		if (readBack->timedOut) {
+			outReason = "No answer to the read back";
+			return Verification::Failed;
+		}
+		if (measureLink_) {
+			// Over DIN the answer alone takes a third of a millisecond per byte, over USB the whole roundtrip is much faster
+			double roundtripMS = Time::getMillisecondCounterHiRes() - sentAtMS;
+			link_ = roundtripMS >= 0.5 * response.getRawDataSize() * kDinMillisecondsPerByte ? Link::DIN : Link::USB;
+			measureLink_ = false;
+		}
+		uint64 sent = payloadHash(item.dataTypeID, item.dump.getSysExData(), (size_t) item.dump.getSysExDataSize());
+		uint64 received = payloadHash(item.dataTypeID, response.getSysExData(), (size_t) response.getSysExDataSize());
+		if (sent != received) {
+			outReason = "Read back differs";
+			return Verification::Failed;
+		}
+		return Verification::Ok;
+	}
+
+	void RD8BulkRestore::run()
+	{
+		std::vector<Failure> failures;
+		int done = 0;
+		bool settingsChanged = false;
+		for (auto const &item : items_) {
+			if (threadShouldExit()) {
+				break;
+			}
+			std::string reason;
+			bool ok = false;
+			for (int attempt = 0; attempt <= (options_.verify ? options_.maxRetries : 0) && !ok; attempt++) {
+				if (threadShouldExit()) {
+					break;
+				}
+				rd8_->transport()->send({ item.dump });
+				rd8_->metrics().count(RD8Metrics::BytesOut, (uint64) item.dump.getRawDataSize());
+				settingsChanged = settingsChanged || item.dataTypeID == BehringerRD8::SETTINGS;
+
+				// Let the device store the dump before the next message arrives
+				wait(currentGapMS((size_t) item.dump.getRawDataSize()));
+				if (threadShouldExit()) {
+					break;
+				}
+				auto verification = options_.verify ? verify(item, reason) : Verification::Ok;
+				if (verification == Verification::Cancelled) {
+					// Not a sign of the device falling behind
+					break;
+				}
+				ok = verification == Verification::Ok;
+
+				// Widen the gap when the device falls behind, and narrow it again slowly while all goes well
+				if (ok) {
+					if (++successesInRow_ >= kSuccessesBeforeNarrowing) {
+						gapScale_ = jmax(1.0f, gapScale_ * 0.9f);
+						successesInRow_ = 0;
+					}
+				}
+				else {
+					gapScale_ = jmin(kMaxGapScale, gapScale_ * 1.5f);
+					successesInRow_ = 0;
+				}
+			}
+			if (!ok) {
+				failures.push_back({ item.dataTypeID, item.itemNo, reason.empty() ? std::string("Cancelled") : reason });
+			}
+			done++;
+			if (progress_) {
+				progress_(done, (int) items_.size());
+			}
+		}
+		if (settingsChanged) {
+			// We wrote around the shadow copy
+			rd8_->invalidateGlobalSettingsCache();
+		}
+		if (finished_) {
+			finished_(failures);
+		}
+	}
+
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "RD8Pattern.h"
+#include "RD8RequestMultiplexer.h"
+
+#include <atomic>
+
+namespace midikraft {
+
+	class BehringerRD8;
+
+	// Uploads a set of stored patterns, songs and global settings to the RD8, one dump at a time with a gap between the writes
+	// that gives the device time to store each item. The gap is derived from the link speed (USB, or 31250 baud DIN, where the
+	// dump itself needs about a third of a millisecond per byte).
+	// With verification on, each item is requested back and compared by hash, and items that differ are sent again. The gap is
+	// widened when a read back shows the device could not keep up, and with Link::Auto the link is measured from the time the
+	// first read back takes. Without verification there is no feedback: the gap stays fixed, and Link::Auto only guesses the link
+	// from the name of the MIDI output.
+	// The work is done on a background thread, the callbacks are called from it.
+	class RD8BulkRestore : private Thread {
+	public:
+		enum class Link { Auto, USB, DIN }; // Auto guesses from the name of the MIDI output, and measures with verification on
+
+		struct Options {
+			Link link = Link::Auto;
+			int processingGapMS = 20; // Time the device needs to store a dump, on top of the transfer time
+			bool verify = false;
+			int verifyTimeoutMS = 1000;
+			int maxRetries = 2; // Sends per item after the first, if verification fails
+		};
+
+		struct Failure {
+			int dataTypeID;
+			int itemNo;
+			std::string reason;
+		};
+
+		typedef std::function<void(int itemsDone, int itemsTotal)> ProgressCallback;
+		typedef std::function<void(std::vector<Failure> const &failures)> FinishedCallback;
+
+		RD8BulkRestore(BehringerRD8 *rd8, RD8RequestMultiplexer &requests, Options options);
+		virtual ~RD8BulkRestore() override;
+
+		// Add the items, then start. Data files are restored to the slots they came from
+		bool addDataFile(std::shared_ptr<DataFile> dataFile);
+		// The template provides the bytes PatternData does not describe, see RD8Pattern::encodePatternData
+		void addPattern(RD8Pattern::PatternData const &pattern, int itemNo, uint8 const *templateData = nullptr);
+		size_t numberOfItems() const;
+
+		void start(ProgressCallback progress, FinishedCallback finished);
+		void cancel();
+		bool isRunning() const;
+
+		Link link() const; // The link used, after resolving Auto
+		int currentGapMS(size_t messageSize) const;
+
+	private:
+		struct Item {
+			int dataTypeID;
+			int itemNo;
+			MidiMessage dump;
+		};
+
+		enum class Verification { Ok, Failed, Cancelled };
+
+		void run() override;
+		Verification verify(Item const &item, std::string &outReason);
+		static uint64 payloadHash(int dataTypeID, uint8 const *sysexData, size_t size);
+
+		BehringerRD8 *rd8_;
+		RD8RequestMultiplexer &requests_;
+		Options options_;
+		std::atomic<Link> link_;
+		bool measureLink_; // Auto, and no read back seen yet
+		float gapScale_ = 1.0f; // Grows when the device falls behind
+		int successesInRow_ = 0;
+
+		std::vector<Item> items_;
+		ProgressCallback progress_;
+		FinishedCallback finished_;
+	};
+
+}
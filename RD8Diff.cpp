@@ -0,0 +1,162 @@
+#include "RD8Diff.h"
+
+#include <boost/format.hpp>
+
+namespace midikraft {
+
+	RD8Diff::EditScript RD8Diff::diff(uint8 const *from, uint8 const *to, size_t size)
+	{
+		jassert(size <= 0x10000);
+		EditScript result;
+		size_t i = 0;
+		// Skip equal words, most of the data does not change between two snapshots
+		for (; i + 8 <= size; i += 8) {
+			uint64 a, b;
+			memcpy(&a, from + i, 8);
+			memcpy(&b, to + i, 8);
+			if (a != b) {
+				for (size_t j = i; j < i + 8; j++) {
+					if (from[j] != to[j]) {
+						result.push_back({ (uint16) j, from[j], to[j] });
+					}
+				}
+			}
+		}
+		for (; i < size; i++) {
+			if (from[i] != to[i]) {
+				result.push_back({ (uint16) i, from[i], to[i] });
+			}
+		}
+		return result;
+	}
+
+	bool RD8Diff::diff(RD8Pattern const &from, RD8Pattern const &to, EditScript &outScript)
+	{
+		std::array<uint8, RD8Pattern::kPatternDataSize> fromData, toData;
+		if (!from.getPatternData(fromData.data()) || !to.getPatternData(toData.data())) {
+			return false;
+		}
+		outScript = diff(fromData.data(), toData.data(), fromData.size());
+		return true;
+	}
+
+	bool RD8Diff::diff(RD8GlobalSettings const &from, RD8GlobalSettings const &to, EditScript &outScript)
+	{
+		// The settings are kept unescaped
+		if (from.data().size() != to.data().size()) {
+			return false;
+		}
+		outScript = diff(from.data().data(), to.data().data(), from.data().size());
+		return true;
+	}
+
+	bool RD8Diff::apply(EditScript const &script, uint8 *data, size_t size)
+	{
+		for (auto const &edit : script) {
+			if (edit.index >= size || data[edit.index] != edit.from) {
+				return false;
+			}
+		}
+		for (auto const &edit : script) {
+			data[edit.index] = edit.to;
+		}
+		return true;
+	}
+
+	std::string RD8Diff::describe(PayloadType type, Edit const &edit)
+	{
+		if (type == PayloadType::Pattern) {
+			auto location = RD8Pattern::fieldAt(edit.index);
+			switch (location.field) {
+			case RD8Pattern::FieldLocation::Step: {
+				static const auto kTrackNames = RD8Pattern::PatternData().trackNames();
+				return (boost::format("%s step %d: 0x%02x -> 0x%02x") % kTrackNames[(size_t) location.trackNo] % (location.stepNo + 1) % (int) edit.from % (int) edit.to).str();
+			}
+			case RD8Pattern::FieldLocation::FilterStep:
+				return (boost::format("Filter step %d: %d -> %d") % (location.stepNo + 1) % (int) edit.from % (int) edit.to).str();
+			default:
+				return (boost::format("%s: %d -> %d") % location.name % (int) edit.from % (int) edit.to).str();
+			}
+		}
+		int element;
+		auto setting = RD8GlobalSettings::settingAt(edit.index, element);
+		if (setting == RD8GlobalSettings::NumberOfSettings) {
+			return (boost::format("Byte %d: %d -> %d") % edit.index % (int) edit.from % (int) edit.to).str();
+		}
+		if (setting == RD8GlobalSettings::GlobalFilterSteps) {
+			return (boost::format("%s %d: %d -> %d") % RD8GlobalSettings::settingName(setting) % (element + 1) % (int) edit.from % (int) edit.to).str();
+		}
+		return (boost::format("%s: %d -> %d") % RD8GlobalSettings::settingName(setting) % (int) edit.from % (int) edit.to).str();
+	}
+
+	std::vector<uint8> RD8Diff::serialize(EditScript const &script)
+	{
+		std::vector<uint8> result;
+		result.reserve(script.size() * 3);
+		int previous = -1;
+		for (auto const &edit : script) {
+			jassert((int) edit.index > previous);
+			uint32 gap = (uint32) (edit.index - previous - 1);
+			previous = edit.index;
+			// 7 bits per byte, the top bit says more follow
+			do {
+				uint8 byte = gap & 0x7f;
+				gap >>= 7;
+				result.push_back(gap != 0 ? (uint8) (byte | 0x80) : byte);
+			} while (gap != 0);
+			result.push_back(edit.from);
+			result.push_back(edit.to);
+		}
+		return result;
+	}
+
+	bool RD8Diff::deserialize(uint8 const *data, size_t size, EditScript &outScript)
+	{
+		outScript.clear();
+		size_t pos = 0;
+		int previous = -1;
+		while (pos < size) {
+			uint32 gap = 0;
+			int shift = 0;
+			uint8 byte;
+			do {
+				if (pos >= size || shift > 14) {
+					return false;
+				}
+				byte = data[pos++];
+				gap |= (uint32) (byte & 0x7f) << shift;
+				shift += 7;
+			} while (byte & 0x80);
+			if (pos + 2 > size || previous + 1 + (int) gap > 0xffff) {
+				return false;
+			}
+			previous = previous + 1 + (int) gap;
+			outScript.push_back({ (uint16) previous, data[pos], data[pos + 1] });
+			pos += 2;
+		}
+		return true;
+	}
+
+	RD8Diff::MergeResult RD8Diff::merge(uint8 const *base, uint8 const *ours, uint8 const *theirs, size_t size, ConflictPolicy policy)
+	{
+		MergeResult result;
+		result.merged.assign(ours, ours + size);
+		for (auto const &edit : diff(base, theirs, size)) {
+			uint8 our = ours[edit.index];
+			if (our == edit.from || our == edit.to) {
+				// Only they changed it, or both made the same change
+				result.merged[edit.index] = edit.to;
+			}
+			else {
+				result.conflicts.push_back({ edit.index, edit.from, our, edit.to });
+				switch (policy) {
+				case ConflictPolicy::KeepOurs: break;
+				case ConflictPolicy::KeepTheirs: result.merged[edit.index] = edit.to; break;
+				case ConflictPolicy::KeepBase: result.merged[edit.index] = edit.from; break;
+				}
+			}
+		}
+		return result;
+	}
+
+}
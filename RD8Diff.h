@@ -0,0 +1,50 @@
+#pragma once
+
+#include "RD8Pattern.h"
+
+namespace midikraft {
+
+	// Field by field comparison of unescaped pattern or settings data. An edit script lists the changed bytes with their old
+	// and new value, is compact to serialize and can be applied to another copy of the old data, so it doubles as a delta format.
+	class RD8Diff {
+	public:
+		enum class PayloadType { Pattern, Settings };
+
+		struct Edit {
+			uint16 index; // Into the unescaped data
+			uint8 from;
+			uint8 to;
+		};
+		typedef std::vector<Edit> EditScript; // Sorted by index
+
+		static EditScript diff(uint8 const *from, uint8 const *to, size_t size);
+		static bool diff(RD8Pattern const &from, RD8Pattern const &to, EditScript &outScript);
+		static bool diff(RD8GlobalSettings const &from, RD8GlobalSettings const &to, EditScript &outScript);
+
+		// Applies all edits or none. Fails if a byte does not have the old value the script expects
+		static bool apply(EditScript const &script, uint8 *data, size_t size);
+
+		// e.g. "Snare Drum step 5: 0x00 -> 0x01" or "Tempo: 120 -> 128"
+		static std::string describe(PayloadType type, Edit const &edit);
+
+		// Delta format: per edit the distance to the previous index as a variable length number, then the old and the new value
+		static std::vector<uint8> serialize(EditScript const &script);
+		static bool deserialize(uint8 const *data, size_t size, EditScript &outScript);
+
+		// Three-way merge. Bytes changed on one side only are taken from that side, bytes changed differently on both sides are
+		// conflicts and resolved by the policy
+		enum class ConflictPolicy { KeepOurs, KeepTheirs, KeepBase };
+		struct Conflict {
+			uint16 index;
+			uint8 base;
+			uint8 ours;
+			uint8 theirs;
+		};
+		struct MergeResult {
+			std::vector<uint8> merged;
+			std::vector<Conflict> conflicts;
+		};
+		static MergeResult merge(uint8 const *base, uint8 const *ours, uint8 const *theirs, size_t size, ConflictPolicy policy);
+	};
+
+}
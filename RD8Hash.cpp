@@ -0,0 +1,107 @@
+#include "RD8Hash.h"
+
+namespace midikraft {
+
+	namespace {
+		const uint64 kPrime1 = 11400714785074694791ULL;
+		const uint64 kPrime2 = 14029467366897019727ULL;
+		const uint64 kPrime3 = 1609587929392839161ULL;
+		const uint64 kPrime4 = 9650029242287828579ULL;
+		const uint64 kPrime5 = 2870177450012600261ULL;
+
+		inline uint64 rotateLeft(uint64 value, int bits)
+		{
+			return (value << bits) | (value >> (64 - bits));
+		}
+
+		inline uint64 read64(uint8 const *p)
+		{
+			uint64 value;
+			memcpy(&value, p, sizeof(value));
+#if JUCE_BIG_ENDIAN
+			value = ByteOrder::swap(value);
+#endif
+			return value;
+		}
+
+		inline uint32 read32(uint8 const *p)
+		{
+			uint32 value;
+			memcpy(&value, p, sizeof(value));
+#if JUCE_BIG_ENDIAN
+			value = ByteOrder::swap(value);
+#endif
+			return value;
+		}
+
+		inline uint64 round(uint64 accumulator, uint64 input)
+		{
+			accumulator += input * kPrime2;
+			accumulator = rotateLeft(accumulator, 31);
+			return accumulator * kPrime1;
+		}
+
+		inline uint64 mergeRound(uint64 accumulator, uint64 value)
+		{
+			accumulator ^= round(0, value);
+			return accumulator * kPrime1 + kPrime4;
+		}
+	}
+
+	uint64 RD8Hash::xxHash64(void const *data, size_t size, uint64 seed)
+	{
+		auto p = static_cast<uint8 const *>(data);
+		auto end = p + size;
+		uint64 hash;
+
+		if (size >= 32) {
+			// Four independent lanes over 32 byte stripes
+			uint64 v1 = seed + kPrime1 + kPrime2;
+			uint64 v2 = seed + kPrime2;
+			uint64 v3 = seed;
+			uint64 v4 = seed - kPrime1;
+			auto limit = end - 32;
+			do {
+				v1 = round(v1, read64(p)); p += 8;
+				v2 = round(v2, read64(p)); p += 8;
+				v3 = round(v3, read64(p)); p += 8;
+				v4 = round(v4, read64(p)); p += 8;
+			} while (p <= limit);
+			hash = rotateLeft(v1, 1) + rotateLeft(v2, 7) + rotateLeft(v3, 12) + rotateLeft(v4, 18);
+			hash = mergeRound(hash, v1);
+			hash = mergeRound(hash, v2);
+			hash = mergeRound(hash, v3);
+			hash = mergeRound(hash, v4);
+		}
+		else {
+			hash = seed + kPrime5;
+		}
+		hash += (uint64) size;
+
+		// The tail
+		while (p + 8 <= end) {
+			hash ^= round(0, read64(p));
+			hash = rotateLeft(hash, 27) * kPrime1 + kPrime4;
+			p += 8;
+		}
+		if (p + 4 <= end) {
+			hash ^= (uint64) read32(p) * kPrime1;
+			hash = rotateLeft(hash, 23) * kPrime2 + kPrime3;
+			p += 4;
+		}
+		while (p < end) {
+			hash ^= (*p) * kPrime5;
+			hash = rotateLeft(hash, 11) * kPrime1;
+			p++;
+		}
+
+		// Avalanche
+		hash ^= hash >> 33;
+		hash *= kPrime2;
+		hash ^= hash >> 29;
+		hash *= kPrime3;
+		hash ^= hash >> 32;
+		return hash;
+	}
+
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "JuceHeader.h"
+
+namespace midikraft {
+
+	// XXH64, a fast non-cryptographic 64 bit hash. The result is the same as the reference implementation on all platforms
+	class RD8Hash {
+	public:
+		static uint64 xxHash64(void const *data, size_t size, uint64 seed);
+	};
+
+}
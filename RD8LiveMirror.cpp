@@ -0,0 +1,185 @@
+#include "RD8LiveMirror.h"
+
+#include "RD8.h"
+
+namespace midikraft {
+
+	RD8LiveMirror::RD8LiveMirror(BehringerRD8 *rd8, std::shared_ptr<RD8Pattern::PatternData> pattern, Options options) :
+		rd8_(rd8), pattern_(pattern), options_(options), intervalMS_(options.minIntervalMS), pollState_(std::make_shared<PollState>())
+	{
+		jassert(pattern_);
+		pollState_->mirror = this;
+	}
+
+	RD8LiveMirror::~RD8LiveMirror()
+	{
+		stop();
+		{
+			ScopedLock lock(pollState_->lock);
+			pollState_->mirror = nullptr;
+		}
+		cancelPendingUpdate();
+	}
+
+	void RD8LiveMirror::start()
+	{
+		if (!running_) {
+			running_ = true;
+			intervalMS_ = options_.minIntervalMS;
+			timerCallback();
+		}
+	}
+
+	void RD8LiveMirror::stop()
+	{
+		running_ = false;
+		stopTimer();
+		if (inFlight_ != 0) {
+			rd8_->requests().cancel(inFlight_);
+			inFlight_ = 0;
+		}
+		// A callback might still be running, make sure its answer is dropped
+		ScopedLock lock(pollState_->lock);
+		pollState_->expectedPoll = 0;
+		pollState_->received = false;
+		pollState_->timedOut = false;
+	}
+
+	bool RD8LiveMirror::isRunning() const
+	{
+		return running_;
+	}
+
+	bool RD8LiveMirror::hasPattern() const
+	{
+		return hasPattern_;
+	}
+
+	int RD8LiveMirror::currentIntervalMS() const
+	{
+		return intervalMS_;
+	}
+
+	void RD8LiveMirror::addListener(Listener *listener)
+	{
+		listeners_.add(listener);
+	}
+
+	void RD8LiveMirror::removeListener(Listener *listener)
+	{
+		listeners_.remove(listener);
+	}
+
+	void RD8LiveMirror::timerCallback()
+	{
+		// One shot, the next poll is scheduled when this one has been answered
+		stopTimer();
+		if (!running_ || inFlight_ != 0) {
+			return;
+		}
+		auto request = rd8_->requestDataItem(0, BehringerRD8::LIVE_PATTERN);
+		auto key = RD8RequestMultiplexer::CorrelationKey::forDataItem(BehringerRD8::LIVE_PATTERN, 0);
+		// The answer can arrive before send returns the request ID, so the polls are matched by our own number
+		uint64 poll = ++pollNo_;
+		{
+			ScopedLock lock(pollState_->lock);
+			pollState_->expectedPoll = poll;
+		}
+		auto rd8 = rd8_;
+		auto state = pollState_;
+		inFlight_ = rd8_->requests().send(request, key, options_.timeoutMS, [rd8, state, poll](RD8RequestMultiplexer::Result result, MidiMessage const &response) {
+			// MIDI thread or multiplexer thread. Only unescape here, the rest is done on the message thread
+			ScopedLock lock(state->lock);
+			if (poll != state->expectedPoll || state->mirror == nullptr) {
+				return;
+			}
+			state->answeredPoll = poll;
+			if (result == RD8RequestMultiplexer::Result::Success) {
+				RD8LivePattern livePattern(rd8);
+				state->received = livePattern.dataFromSysexData(response.getSysExData(), (size_t) response.getSysExDataSize())
+					&& livePattern.getPatternData(state->current.data());
+				state->timedOut = !state->received;
+			}
+			else {
+				state->timedOut = true;
+			}
+			state->mirror->triggerAsyncUpdate();
+		});
+	}
+
+	void RD8LiveMirror::handleAsyncUpdate()
+	{
+		bool received, timedOut;
+		std::array<uint8, RD8Pattern::kPatternDataSize> current;
+		{
+			auto &state = *pollState_;
+			ScopedLock lock(state.lock);
+			if (state.expectedPoll == 0 || state.answeredPoll != state.expectedPoll) {
+				// Stopped, or the answer belongs to a poll before the one in flight
+				return;
+			}
+			state.expectedPoll = 0;
+			received = state.received;
+			timedOut = state.timedOut;
+			if (received) {
+				current = state.current;
+			}
+			state.received = false;
+			state.timedOut = false;
+		}
+		inFlight_ = 0;
+		if (!running_) {
+			return;
+		}
+
+		if (timedOut) {
+			listeners_.call([](Listener &l) { l.liveMirrorTimeout(); });
+			intervalMS_ = options_.maxIntervalMS;
+			startTimer(intervalMS_);
+			return;
+		}
+		if (!received) {
+			return;
+		}
+
+		if (!hasPattern_) {
+			if (!RD8Pattern::decodePatternData(current.data(), current.size(), *pattern_)) {
+				scheduleNextPoll(false);
+				return;
+			}
+			previous_ = current;
+			hasPattern_ = true;
+			listeners_.call([this](Listener &l) { l.livePatternReceived(*pattern_); });
+			scheduleNextPoll(true);
+			return;
+		}
+
+		auto changes = RD8Pattern::diffPatternData(previous_.data(), current.data());
+		if (changes.any()) {
+			RD8Pattern::applyPatternChanges(current.data(), changes, *pattern_);
+			previous_ = current;
+			for (int track = 0; track < RD8Pattern::kNumberOfTracks; track++) {
+				if (changes.changedTracks & (1 << track)) {
+					listeners_.call([this, track](Listener &l) { l.liveTrackChanged(track, *pattern_); });
+				}
+			}
+			if (changes.parametersChanged) {
+				listeners_.call([this](Listener &l) { l.liveParametersChanged(*pattern_); });
+			}
+		}
+		scheduleNextPoll(changes.any());
+	}
+
+	void RD8LiveMirror::scheduleNextPoll(bool changed)
+	{
+		// Poll fast while the user is editing, and back off while the pattern is left alone
+		if (changed) {
+			intervalMS_ = options_.minIntervalMS;
+		}
+		else {
+			intervalMS_ = jmin(options_.maxIntervalMS, roundToInt(intervalMS_ * options_.backoffFactor));
+		}
+		startTimer(intervalMS_);
+	}
+
+}
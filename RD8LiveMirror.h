@@ -0,0 +1,81 @@
+#pragma once
+
+#include "JuceHeader.h"
+#include "RD8Pattern.h"
+#include "RD8RequestMultiplexer.h"
+
+#include <atomic>
+
+namespace midikraft {
+
+	class BehringerRD8;
+
+	// Keeps a copy of the live pattern (the edit buffer) of the device up to date by polling it.
+	// Each new dump is compared to the previous one, and only the tracks and parameters that changed are decoded and reported.
+	// There is never more than one request in flight, and the poll interval grows while nothing changes, so a performance is not
+	// disturbed by a flood of requests.
+	class RD8LiveMirror : private Timer, private AsyncUpdater {
+	public:
+		// All listener functions are called on the message thread
+		class Listener {
+		public:
+			virtual ~Listener() = default;
+			virtual void liveTrackChanged(int trackNo, RD8Pattern::PatternData const &pattern) { ignoreUnused(trackNo, pattern); }
+			virtual void liveParametersChanged(RD8Pattern::PatternData const &pattern) { ignoreUnused(pattern); }
+			virtual void livePatternReceived(RD8Pattern::PatternData const &pattern) { ignoreUnused(pattern); } // The first complete pattern
+			virtual void liveMirrorTimeout() {}
+		};
+
+		struct Options {
+			int minIntervalMS = 100; // Poll interval right after a change
+			int maxIntervalMS = 2000; // Poll interval when nothing has changed for a while
+			float backoffFactor = 1.5f; // Growth of the interval per unchanged poll
+			int timeoutMS = 500;
+		};
+
+		// The pattern is updated in place, it is only modified on the message thread
+		RD8LiveMirror(BehringerRD8 *rd8, std::shared_ptr<RD8Pattern::PatternData> pattern, Options options);
+		virtual ~RD8LiveMirror() override;
+
+		void start();
+		void stop();
+		bool isRunning() const;
+
+		bool hasPattern() const; // False until the first dump has been received
+		int currentIntervalMS() const;
+
+		void addListener(Listener *listener);
+		void removeListener(Listener *listener);
+
+	private:
+		void timerCallback() override;
+		void handleAsyncUpdate() override;
+		void scheduleNextPoll(bool changed);
+
+		BehringerRD8 *rd8_;
+		std::shared_ptr<RD8Pattern::PatternData> pattern_;
+		Options options_;
+		ListenerList<Listener> listeners_;
+
+		bool running_ = false;
+		std::atomic<bool> hasPattern_ { false }; // Set on the message thread once the pattern is complete, read from any thread
+		int intervalMS_;
+		RD8RequestMultiplexer::RequestID inFlight_ = 0;
+		uint64 pollNo_ = 0; // Numbers the polls, so a late answer is not taken for the one in flight
+		std::array<uint8, RD8Pattern::kPatternDataSize> previous_;
+
+		// Handed over from the MIDI thread. The callbacks of the polls hold it by shared_ptr, as one might still be running when
+		// we are destroyed. The destructor clears mirror under the lock, after that no callback touches us anymore
+		struct PollState {
+			CriticalSection lock;
+			RD8LiveMirror *mirror;
+			uint64 expectedPoll = 0; // The poll in flight, 0 if none
+			uint64 answeredPoll = 0;
+			bool received = false;
+			bool timedOut = false;
+			std::array<uint8, RD8Pattern::kPatternDataSize> current;
+		};
+		std::shared_ptr<PollState> pollState_;
+	};
+
+}
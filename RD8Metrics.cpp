@@ -0,0 +1,232 @@
+#include "RD8Metrics.h"
+
+#include "RD8.h"
+
+#include <boost/format.hpp>
+
+#include <cmath>
+
+namespace midikraft {
+
+	namespace {
+		char const *kCounterNames[RD8Metrics::NumberOfCounters] = { "requests_sent", "responses_matched", "timeouts", "bytes_out", "bytes_in" };
+		char const *kDataTypeNames[RD8Metrics::kNumberOfDataTypes] = { "stored_pattern", "stored_song", "live_pattern", "live_song", "settings" };
+
+		// Threads get their slot number on first use, in the order they first record something
+		std::atomic<int> nextThreadSlot { 0 };
+		thread_local int threadSlot = -1;
+
+		void sumHistogram(RD8Metrics::HistogramSnapshot &out, std::atomic<uint64> const *buckets, std::atomic<uint64> const &sum)
+		{
+			for (int b = 0; b < RD8Metrics::kNumberOfBuckets; b++) {
+				uint64 value = buckets[b].load(std::memory_order_relaxed);
+				out.buckets[(size_t) b] += value;
+				out.count += value;
+			}
+			out.sumMicroseconds += sum.load(std::memory_order_relaxed);
+		}
+
+		std::string limitText(uint64 limit)
+		{
+			return limit == RD8Metrics::kAboveLimits ? std::string("+Inf") : std::to_string(limit);
+		}
+	}
+
+	RD8Metrics::RD8Metrics() : slots_(new Slot[kNumberOfSlots])
+	{
+		for (int s = 0; s < kNumberOfSlots; s++) {
+			auto &slot = slots_[s];
+			for (auto &counter : slot.counters) counter = 0;
+			for (auto &buckets : slot.decodeBuckets) for (auto &bucket : buckets) bucket = 0;
+			for (auto &sum : slot.decodeSum) sum = 0;
+			for (auto &buckets : slot.roundtripBuckets) for (auto &bucket : buckets) bucket = 0;
+			for (auto &sum : slot.roundtripSum) sum = 0;
+		}
+	}
+
+	RD8Metrics::~RD8Metrics()
+	{
+		stopTimer();
+	}
+
+	int64 RD8Metrics::nowMicroseconds()
+	{
+		return (int64) (Time::getMillisecondCounterHiRes() * 1000.0);
+	}
+
+	RD8Metrics::Slot & RD8Metrics::slotOfThisThread()
+	{
+		if (threadSlot < 0) {
+			threadSlot = nextThreadSlot++ % kNumberOfSlots;
+		}
+		return slots_[threadSlot];
+	}
+
+	uint64 RD8Metrics::bucketLimit(int bucket)
+	{
+		// Bucket b holds the whole microseconds below 2^b, so the inclusive limit is one less
+		return bucket >= kNumberOfBuckets - 1 ? kAboveLimits : ((uint64) 1 << bucket) - 1;
+	}
+
+	int RD8Metrics::bucketOf(int64 microseconds)
+	{
+		int bucket = 0;
+		while (bucket < kNumberOfBuckets - 1 && microseconds >= ((int64) 1 << bucket)) {
+			bucket++;
+		}
+		return bucket;
+	}
+
+	void RD8Metrics::count(Counter counter, uint64 amount)
+	{
+		slotOfThisThread().counters[counter].fetch_add(amount, std::memory_order_relaxed);
+	}
+
+	void RD8Metrics::recordDecodeTime(int dataTypeID, int64 microseconds)
+	{
+		if (dataTypeID < 0 || dataTypeID >= kNumberOfDataTypes) {
+			jassertfalse;
+			return;
+		}
+		auto &slot = slotOfThisThread();
+		slot.decodeBuckets[dataTypeID][bucketOf(microseconds)].fetch_add(1, std::memory_order_relaxed);
+		slot.decodeSum[dataTypeID].fetch_add((uint64) jmax((int64) 0, microseconds), std::memory_order_relaxed);
+	}
+
+	void RD8Metrics::recordRoundtrip(uint8 messageType, uint8 messageID, int64 microseconds)
+	{
+		int index = messageType == RD8_DATA_MESSAGE ? (messageID & 0x0f) : 0;
+		auto &slot = slotOfThisThread();
+		slot.roundtripBuckets[index][bucketOf(microseconds)].fetch_add(1, std::memory_order_relaxed);
+		slot.roundtripSum[index].fetch_add((uint64) jmax((int64) 0, microseconds), std::memory_order_relaxed);
+	}
+
+	RD8Metrics::Snapshot RD8Metrics::snapshot() const
+	{
+		Snapshot result;
+		result.counters.fill(0);
+		for (auto &histogram : result.decodeTime) {
+			histogram.buckets.fill(0);
+			histogram.count = histogram.sumMicroseconds = 0;
+		}
+		for (auto &histogram : result.roundtrip) {
+			histogram.buckets.fill(0);
+			histogram.count = histogram.sumMicroseconds = 0;
+		}
+		for (int s = 0; s < kNumberOfSlots; s++) {
+			auto const &slot = slots_[s];
+			for (int c = 0; c < NumberOfCounters; c++) {
+				result.counters[(size_t) c] += slot.counters[c].load(std::memory_order_relaxed);
+			}
+			for (int t = 0; t < kNumberOfDataTypes; t++) {
+				sumHistogram(result.decodeTime[(size_t) t], slot.decodeBuckets[t], slot.decodeSum[t]);
+			}
+			for (int m = 0; m < kNumberOfMessageIDs; m++) {
+				sumHistogram(result.roundtrip[(size_t) m], slot.roundtripBuckets[m], slot.roundtripSum[m]);
+			}
+		}
+		return result;
+	}
+
+	double RD8Metrics::HistogramSnapshot::meanMicroseconds() const
+	{
+		return count > 0 ? sumMicroseconds / (double) count : 0.0;
+	}
+
+	uint64 RD8Metrics::HistogramSnapshot::percentileMicroseconds(double percentile) const
+	{
+		uint64 rank = (uint64) std::ceil(percentile * count);
+		uint64 seen = 0;
+		for (int b = 0; b < kNumberOfBuckets; b++) {
+			seen += buckets[(size_t) b];
+			if (seen >= rank && seen > 0) {
+				return bucketLimit(b);
+			}
+		}
+		return 0;
+	}
+
+	std::string RD8Metrics::Snapshot::toJson() const
+	{
+		auto histogramJson = [](HistogramSnapshot const &histogram) {
+			std::string buckets;
+			for (int b = 0; b < kNumberOfBuckets; b++) {
+				buckets += (b > 0 ? "," : "") + std::to_string(histogram.buckets[(size_t) b]);
+			}
+			// A percentile in the last bucket has no limit, it is written as "+Inf" like in the Prometheus output
+			auto percentileJson = [&histogram](double percentile) {
+				uint64 limit = histogram.percentileMicroseconds(percentile);
+				return limit == kAboveLimits ? std::string("\"+Inf\"") : std::to_string(limit);
+			};
+			return (boost::format("{\"count\":%d,\"sum_us\":%d,\"mean_us\":%.1f,\"p50_us\":%s,\"p99_us\":%s,\"buckets\":[%s]}")
+				% histogram.count % histogram.sumMicroseconds % histogram.meanMicroseconds()
+				% percentileJson(0.5) % percentileJson(0.99) % buckets).str();
+		};
+
+		std::string result = "{\"counters\":{";
+		for (int c = 0; c < NumberOfCounters; c++) {
+			result += (boost::format("%s\"%s\":%d") % (c > 0 ? "," : "") % kCounterNames[c] % counters[(size_t) c]).str();
+		}
+		result += "},\"decode_time\":{";
+		for (int t = 0; t < kNumberOfDataTypes; t++) {
+			result += (boost::format("%s\"%s\":%s") % (t > 0 ? "," : "") % kDataTypeNames[t] % histogramJson(decodeTime[(size_t) t])).str();
+		}
+		result += "},\"roundtrip\":{";
+		bool first = true;
+		for (int m = 0; m < kNumberOfMessageIDs; m++) {
+			if (roundtrip[(size_t) m].count > 0) {
+				result += (boost::format("%s\"0x%02x\":%s") % (first ? "" : ",") % m % histogramJson(roundtrip[(size_t) m])).str();
+				first = false;
+			}
+		}
+		result += "}}";
+		return result;
+	}
+
+	std::string RD8Metrics::Snapshot::toPrometheus() const
+	{
+		std::string result;
+		for (int c = 0; c < NumberOfCounters; c++) {
+			result += (boost::format("# TYPE rd8_%s_total counter\nrd8_%s_total %d\n") % kCounterNames[c] % kCounterNames[c] % counters[(size_t) c]).str();
+		}
+		auto histogramText = [&result](std::string const &metric, std::string const &label, HistogramSnapshot const &histogram) {
+			uint64 cumulative = 0;
+			for (int b = 0; b < kNumberOfBuckets; b++) {
+				cumulative += histogram.buckets[(size_t) b];
+				result += (boost::format("%s_bucket{%s,le=\"%s\"} %d\n") % metric % label % limitText(bucketLimit(b)) % cumulative).str();
+			}
+			result += (boost::format("%s_sum{%s} %d\n%s_count{%s} %d\n") % metric % label % histogram.sumMicroseconds % metric % label % histogram.count).str();
+		};
+		result += "# TYPE rd8_decode_time_microseconds histogram\n";
+		for (int t = 0; t < kNumberOfDataTypes; t++) {
+			histogramText("rd8_decode_time_microseconds", (boost::format("type=\"%s\"") % kDataTypeNames[t]).str(), decodeTime[(size_t) t]);
+		}
+		result += "# TYPE rd8_roundtrip_microseconds histogram\n";
+		for (int m = 0; m < kNumberOfMessageIDs; m++) {
+			if (roundtrip[(size_t) m].count > 0) {
+				histogramText("rd8_roundtrip_microseconds", (boost::format("message_id=\"0x%02x\"") % m).str(), roundtrip[(size_t) m]);
+			}
+		}
+		return result;
+	}
+
+	void RD8Metrics::startPeriodicDump(File const &file, DumpFormat format, int intervalMS)
+	{
+		dumpFile_ = file;
+		dumpFormat_ = format;
+		startTimer(intervalMS);
+	}
+
+	void RD8Metrics::stopPeriodicDump()
+	{
+		stopTimer();
+	}
+
+	void RD8Metrics::timerCallback()
+	{
+		auto current = snapshot();
+		std::string text = dumpFormat_ == DumpFormat::Json ? current.toJson() : current.toPrometheus();
+		dumpFile_.replaceWithData(text.data(), text.size());
+	}
+
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "JuceHeader.h"
+
+#include <atomic>
+
+namespace midikraft {
+
+	// Counters and latency histograms for the MIDI transactions and the decoding of the RD8.
+	// Recording is lock free: each thread adds to its own slot of atomics, and a snapshot sums up all slots.
+	// The histograms have power of two buckets in microseconds.
+	class RD8Metrics : private Timer {
+	public:
+		enum Counter { RequestsSent, ResponsesMatched, Timeouts, BytesOut, BytesIn, NumberOfCounters };
+
+		static constexpr int kNumberOfBuckets = 24; // Bucket b counts values below 2^b microseconds, the last one everything above
+		static constexpr uint64 kAboveLimits = ~(uint64) 0; // The limit of the last bucket
+		static constexpr int kNumberOfDataTypes = 5; // BehringerRD8::RD8DateFileTypes
+		static constexpr int kNumberOfMessageIDs = 16; // Response message IDs of data messages, 0 is used for the firmware reply
+
+		// The inclusive upper limit of a bucket in whole microseconds, 2^b - 1, used for the percentiles and the exported buckets
+		static uint64 bucketLimit(int bucket);
+
+		struct HistogramSnapshot {
+			std::array<uint64, kNumberOfBuckets> buckets;
+			uint64 count;
+			uint64 sumMicroseconds;
+
+			double meanMicroseconds() const;
+			uint64 percentileMicroseconds(double percentile) const; // The bucketLimit of the bucket it falls in, e.g. for 0.99
+		};
+
+		struct Snapshot {
+			std::array<uint64, NumberOfCounters> counters;
+			// Indexed by data type ID. For the patterns getPattern and the unescape of the lazy field access, for the settings the
+			// parsing of the dump. Songs are only kept as raw dumps, so there is nothing to time
+			std::array<HistogramSnapshot, kNumberOfDataTypes> decodeTime;
+			std::array<HistogramSnapshot, kNumberOfMessageIDs> roundtrip; // Indexed by response message ID
+
+			std::string toJson() const;
+			std::string toPrometheus() const;
+		};
+
+		RD8Metrics();
+		virtual ~RD8Metrics() override;
+
+		void count(Counter counter, uint64 amount = 1);
+		void recordDecodeTime(int dataTypeID, int64 microseconds);
+		void recordRoundtrip(uint8 messageType, uint8 messageID, int64 microseconds);
+
+		Snapshot snapshot() const;
+
+		// Write a snapshot to the file every intervalMS milliseconds, from the message thread
+		enum class DumpFormat { Json, Prometheus };
+		void startPeriodicDump(File const &file, DumpFormat format, int intervalMS);
+		void stopPeriodicDump();
+
+		static int64 nowMicroseconds();
+
+	private:
+		struct alignas(64) Slot {
+			std::atomic<uint64> counters[NumberOfCounters];
+			std::atomic<uint64> decodeBuckets[kNumberOfDataTypes][kNumberOfBuckets];
+			std::atomic<uint64> decodeSum[kNumberOfDataTypes];
+			std::atomic<uint64> roundtripBuckets[kNumberOfMessageIDs][kNumberOfBuckets];
+			std::atomic<uint64> roundtripSum[kNumberOfMessageIDs];
+		};
+
+		void timerCallback() override;
+		Slot &slotOfThisThread();
+		static int bucketOf(int64 microseconds);
+
+		static constexpr int kNumberOfSlots = 16; // More threads than this share slots, which is still correct, just slower
+		std::unique_ptr<Slot[]> slots_;
+
+		File dumpFile_;
+		DumpFormat dumpFormat_ = DumpFormat::Json;
+	};
+
+}
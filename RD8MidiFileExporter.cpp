@@ -0,0 +1,235 @@
+#include "RD8MidiFileExporter.h"
+
+#include <algorithm>
+#include <tuple>
+
+namespace midikraft {
+
+	namespace {
+		const int kAccentTrack = 0;
+		const int kStepsPerBar = 16;
+
+		// Assumed, see the class comment
+		const double kFlamLevelsPerStep = 48.0;
+		const int kMinimumRepeats = 2;
+	}
+
+	RD8MidiFileExporter::RD8MidiFileExporter(NoteMapping const &noteMapping, Options options) : noteMapping_(noteMapping), options_(options)
+	{
+	}
+
+	RD8MidiFileExporter::NoteMapping RD8MidiFileExporter::noteMapping(RD8GlobalSettings const &settings)
+	{
+		NoteMapping result;
+		for (int i = 0; i < kNumberOfInstruments; i++) {
+			result[i] = settings.peek((RD8GlobalSettings::Setting) (RD8GlobalSettings::BassDrumNote + i));
+		}
+		return result;
+	}
+
+	RD8MidiFileExporter::NoteMapping RD8MidiFileExporter::defaultNoteMapping()
+	{
+		// Bass drum, snare, low/mid/high tom, rim shot, hand clap, cow bell, cymbal, open hat, closed hat
+		return { 36, 38, 45, 47, 50, 37, 39, 56, 49, 46, 42 };
+	}
+
+	RD8MidiFileExporter::Timing::Timing()
+	{
+		trackLengths.fill(16);
+	}
+
+	RD8MidiFileExporter::Timing::Timing(RD8Pattern::PatternData const &pattern)
+	{
+		// The step size has two values like the global step size setting, sixteenths or 32nds
+		stepsPerQuarterNote = pattern.stepSize != 0 ? 8 : 4;
+		int used = pattern.planes.usedLength();
+		patternLength = jmin(RD8Pattern::kNumberOfSteps, jmax(kStepsPerBar, (used + kStepsPerBar - 1) / kStepsPerBar * kStepsPerBar));
+		for (int track = 0; track < RD8Pattern::kNumberOfTracks; track++) {
+			int trackLength = pattern.planes.usedLength(track);
+			trackLengths[(size_t) track] = pattern.polymeterOnOff && trackLength > 0 ? trackLength : patternLength;
+		}
+		// Swing is the position of every second step within the pair in percent: 50 is straight, about 66.7 a triplet feel
+		// and 75 the maximum, a dotted step
+		swingDelay = (jlimit(50, 75, (int) pattern.swing) - 50) * 2 / 100.0;
+		// The flam level goes up to 24, the grace note comes up to half a step before the main note
+		flamDelay = pattern.flamLevel / kFlamLevelsPerStep;
+	}
+
+	int RD8MidiFileExporter::Timing::stepIndex(int64 step, int trackNo) const
+	{
+		return (int) (step % jlimit(1, RD8Pattern::kNumberOfSteps, trackLengths[(size_t) trackNo]));
+	}
+
+	int RD8MidiFileExporter::Timing::hits(RD8Pattern::PatternData const &pattern, int trackNo, int64 step, Options const &options, Random &random, Hit *out) const
+	{
+		auto const &planes = pattern.planes;
+		int bit = stepIndex(step, trackNo);
+		if (((planes.onOff[trackNo] >> bit) & 1) == 0) {
+			return 0;
+		}
+		if (((planes.probability[trackNo] >> bit) & 1) != 0 && options.applyProbability && random.nextInt(100) >= pattern.probability) {
+			return 0;
+		}
+		bool accent = ((planes.onOff[kAccentTrack] >> stepIndex(step, kAccentTrack)) & 1) != 0;
+		uint8 velocity = accent ? options.accentVelocity : options.velocity;
+		double time = (step % 2) == 1 ? swingDelay : 0.0;
+
+		int numberOfHits = 0;
+		if (((planes.flam[trackNo] >> bit) & 1) != 0 && flamDelay > 0.0) {
+			out[numberOfHits++] = { time - flamDelay, flamDelay, (uint8) (velocity / 2) };
+		}
+		if (((planes.repeatOnOff[trackNo] >> bit) & 1) != 0) {
+			// Note repeat plays 2 to 5 hits within the step
+			int repeats = kMinimumRepeats + (int) (((planes.repeatLo[trackNo] >> bit) & 1) | (((planes.repeatHi[trackNo] >> bit) & 1) << 1));
+			for (int repeat = 0; repeat < repeats; repeat++) {
+				out[numberOfHits++] = { time + repeat / (double) repeats, 1.0 / repeats, velocity };
+			}
+		}
+		else {
+			out[numberOfHits++] = { time, 1.0, velocity };
+		}
+		return numberOfHits;
+	}
+
+	bool RD8MidiFileExporter::NoteEvent::operator<(NoteEvent const &other) const
+	{
+		return std::tie(instrument, tick, velocity) < std::tie(other.instrument, other.tick, other.velocity);
+	}
+
+	int RD8MidiFileExporter::stepsToRender(Timing const &timing) const
+	{
+		return options_.numberOfSteps > 0 ? options_.numberOfSteps : timing.patternLength;
+	}
+
+	int RD8MidiFileExporter::ticksPerStep(Timing const &timing, int ticksPerQuarterNote)
+	{
+		return jmax(1, ticksPerQuarterNote / timing.stepsPerQuarterNote);
+	}
+
+	int RD8MidiFileExporter::renderNotes(RD8Pattern::PatternData const &pattern, int startTick, Random &random, std::vector<NoteEvent> &events) const
+	{
+		Timing timing(pattern);
+		int stepTicks = ticksPerStep(timing, options_.ticksPerQuarterNote);
+		int steps = stepsToRender(timing);
+		Timing::Hit hits[Timing::kMaxHitsPerStep];
+		for (int instrument = 0; instrument < kNumberOfInstruments; instrument++) {
+			int track = instrument + 1;
+			if (noteMapping_[instrument] > 127 || pattern.planes.onOff[track] == 0) {
+				continue;
+			}
+			for (int step = 0; step < steps; step++) {
+				int numberOfHits = timing.hits(pattern, track, step, options_, random, hits);
+				for (int i = 0; i < numberOfHits; i++) {
+					int tick = startTick + step * stepTicks + roundToInt(hits[i].time * stepTicks);
+					if (tick >= 0) {
+						events.push_back({ instrument, tick, jmax(1, roundToInt(hits[i].length * stepTicks)), hits[i].velocity });
+					}
+				}
+			}
+		}
+		return steps * stepTicks;
+	}
+
+	void RD8MidiFileExporter::clampLengths(std::vector<NoteEvent> &events)
+	{
+		// Swing and flam move notes into the previous step. A note off after the next note on of the same note would cut that one short
+		for (size_t i = 0; i + 1 < events.size(); i++) {
+			auto const &next = events[i + 1];
+			if (next.instrument == events[i].instrument) {
+				// Of two hits at the same tick, e.g. a grace note on a swung step, only the louder one is kept
+				events[i].length = next.tick > events[i].tick ? jmin(events[i].length, next.tick - events[i].tick) : 0;
+			}
+		}
+		events.erase(std::remove_if(events.begin(), events.end(), [](NoteEvent const &event) { return event.length <= 0; }), events.end());
+	}
+
+	void RD8MidiFileExporter::renderPattern(RD8Pattern::PatternData const &pattern, MidiFile &out) const
+	{
+		renderSequence({ &pattern }, out);
+	}
+
+	void RD8MidiFileExporter::renderSequence(std::vector<RD8Pattern::PatternData const *> const &patterns, MidiFile &out) const
+	{
+		// One buffer per thread, it grows to the largest pattern seen and is then reused
+		thread_local std::vector<NoteEvent> events;
+		events.clear();
+
+		Random random(options_.randomSeed);
+		int tick = 0;
+		for (auto pattern : patterns) {
+			tick += renderNotes(*pattern, tick, random, events);
+		}
+		std::sort(events.begin(), events.end());
+		clampLengths(events);
+
+		out.clear();
+		out.setTicksPerQuarterNote(options_.ticksPerQuarterNote);
+
+		MidiMessageSequence tempoTrack;
+		int bpm = patterns.empty() ? 120 : jmax(1, (int) patterns.front()->tempo);
+		tempoTrack.addEvent(MidiMessage::tempoMetaEvent(60000000 / bpm), 0);
+		tempoTrack.addEvent(MidiMessage::timeSignatureMetaEvent(4, 4), 0);
+		out.addTrack(tempoTrack);
+
+		auto names = patterns.empty() ? std::vector<std::string>() : patterns.front()->trackNames();
+		for (int instrument = 0; instrument < kNumberOfInstruments; instrument++) {
+			MidiMessageSequence sequence;
+			if (instrument + 1 < (int) names.size()) {
+				sequence.addEvent(MidiMessage::textMetaEvent(3, names[instrument + 1]), 0);
+			}
+			for (auto const &event : events) {
+				if (event.instrument == instrument) {
+					sequence.addEvent(MidiMessage::noteOn(options_.midiChannel, noteMapping_[instrument], event.velocity), event.tick);
+					sequence.addEvent(MidiMessage::noteOff(options_.midiChannel, noteMapping_[instrument]), event.tick + event.length);
+				}
+			}
+			sequence.updateMatchedPairs();
+			out.addTrack(sequence);
+		}
+	}
+
+	bool RD8MidiFileExporter::writePattern(RD8Pattern::PatternData const &pattern, OutputStream &out) const
+	{
+		return writeSequence({ &pattern }, out);
+	}
+
+	bool RD8MidiFileExporter::writeSequence(std::vector<RD8Pattern::PatternData const *> const &patterns, OutputStream &out) const
+	{
+		MidiFile midiFile;
+		renderSequence(patterns, midiFile);
+		return midiFile.writeTo(out, 1);
+	}
+
+	int RD8MidiFileExporter::exportPatterns(std::vector<ExportJob> const &jobs, ThreadPool &pool) const
+	{
+		std::atomic<size_t> nextJob { 0 };
+		std::atomic<int> written { 0 };
+		int numberOfWorkers = jmin(pool.getNumThreads(), (int) jobs.size());
+		std::atomic<int> workersRunning { numberOfWorkers };
+		WaitableEvent allDone;
+		auto worker = [&]() {
+			size_t job;
+			while ((job = nextJob++) < jobs.size()) {
+				FileOutputStream stream(jobs[job].file);
+				if (stream.openedOk()) {
+					stream.setPosition(0);
+					stream.truncate();
+					if (writePattern(*jobs[job].pattern, stream)) {
+						written++;
+					}
+				}
+			}
+			if (--workersRunning == 0) {
+				allDone.signal();
+			}
+		};
+		for (int i = 0; i < numberOfWorkers; i++) {
+			pool.addJob(worker);
+		}
+		if (numberOfWorkers > 0) {
+			allDone.wait();
+		}
+		return written;
+	}
+
+}
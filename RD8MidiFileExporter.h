@@ -0,0 +1,98 @@
+#pragma once
+
+#include "RD8Pattern.h"
+
+namespace midikraft {
+
+	// Renders RD8 patterns into type 1 Standard MIDI Files, one MIDI track per instrument plus a tempo track.
+	// Swing, flam, note repeat, probability, step size, polymeter and accent are rendered into the notes, the accent track
+	// modifies the velocity. The notes are placed by the Timing that RD8PatternPlayer uses as well, so a file sounds like the playback.
+	// The manual doesn't say how some values translate into time, so three mappings are assumptions: the pattern loops after its
+	// last used step rounded up to a bar, a flam level of 0 to 24 puts the grace note up to half a step early (level / 48 steps),
+	// and the 2 bit note repeat value plays 2 to 5 hits in the step.
+	// The notes are collected in an event buffer kept per thread and reused, so there is no intermediate container per pattern.
+	// The MidiMessageSequence still allocates a holder for each event it is given.
+	class RD8MidiFileExporter {
+	public:
+		static constexpr int kNumberOfInstruments = RD8Pattern::kNumberOfTracks - 1; // All but the accent track
+
+		typedef std::array<uint8, kNumberOfInstruments> NoteMapping;
+
+		struct Options {
+			int ticksPerQuarterNote = 96;
+			int midiChannel = 10;
+			uint8 velocity = 100;
+			uint8 accentVelocity = 127;
+			bool applyProbability = true; // Else steps with probability enabled are always played
+			int64 randomSeed = 1; // For reproducible probability rendering
+			int numberOfSteps = 0; // Steps rendered per pattern, 0 to use the last used step rounded up to a full bar
+		};
+
+		// Where the notes of a pattern fall, in steps. A note lasts until the next hit of the same note at the latest,
+		// callers clamp the lengths given here to that
+		struct Timing {
+			static constexpr int kMaxHitsPerStep = 6; // The grace note of a flam and up to 5 note repeats
+
+			struct Hit {
+				double time; // From the start of the step without swing, the grace note can be before it
+				double length;
+				uint8 velocity;
+			};
+
+			int patternLength = 16; // Steps before the pattern loops
+			std::array<int, RD8Pattern::kNumberOfTracks> trackLengths; // Per track loop length, with polymeter on each track loops after its own last used step
+			int stepsPerQuarterNote = 4; // The step size, 4 for sixteenths, 8 for 32nds
+			double swingDelay = 0.0; // Delay of every second step
+			double flamDelay = 0.0; // Time from the grace note to the main note, assumed to be flam level / 48 steps
+
+			Timing();
+
+			// The pattern data has no decoded length, so the pattern loops after its last used step rounded up to a full bar
+			explicit Timing(RD8Pattern::PatternData const &pattern);
+
+			int stepIndex(int64 step, int trackNo) const; // The step of the track playing at this step of the pattern
+
+			// The hits of a track at a step of the pattern, in time order, returns their number. The grace note of the very
+			// first step falls before the start, callers drop it
+			int hits(RD8Pattern::PatternData const &pattern, int trackNo, int64 step, Options const &options, Random &random, Hit *out) const;
+		};
+
+		RD8MidiFileExporter(NoteMapping const &noteMapping, Options options);
+
+		// The note mapping as configured in the global settings, or the General MIDI drum notes
+		static NoteMapping noteMapping(RD8GlobalSettings const &settings);
+		static NoteMapping defaultNoteMapping();
+
+		// A sequence of patterns is played one after the other, e.g. a song. The tempo of the first pattern is used
+		void renderPattern(RD8Pattern::PatternData const &pattern, MidiFile &out) const;
+		void renderSequence(std::vector<RD8Pattern::PatternData const *> const &patterns, MidiFile &out) const;
+		bool writePattern(RD8Pattern::PatternData const &pattern, OutputStream &out) const;
+		bool writeSequence(std::vector<RD8Pattern::PatternData const *> const &patterns, OutputStream &out) const;
+
+		// Batch export of one file per pattern on the thread pool, returns the number of files written
+		struct ExportJob {
+			RD8Pattern::PatternData const *pattern;
+			File file;
+		};
+		int exportPatterns(std::vector<ExportJob> const &jobs, ThreadPool &pool) const;
+
+	private:
+		struct NoteEvent {
+			int instrument;
+			int tick;
+			int length;
+			uint8 velocity;
+
+			bool operator<(NoteEvent const &other) const;
+		};
+
+		int stepsToRender(Timing const &timing) const;
+		static int ticksPerStep(Timing const &timing, int ticksPerQuarterNote);
+		int renderNotes(RD8Pattern::PatternData const &pattern, int startTick, Random &random, std::vector<NoteEvent> &events) const; // Returns the ticks rendered
+		static void clampLengths(std::vector<NoteEvent> &events); // Ends each note at the next hit of the same note, events sorted
+
+		NoteMapping noteMapping_;
+		Options options_;
+	};
+
+}
@@ -0,0 +1,56 @@
+#include "RD8MidiTransport.h"
+
+#include "MidiHelpers.h"
+
+namespace midikraft {
+
+	RD8MidiControllerTransport::RD8MidiControllerTransport(SimpleDiscoverableDevice const *device) : device_(device)
+	{
+	}
+
+	RD8MidiControllerTransport::~RD8MidiControllerTransport()
+	{
+		ScopedLock lock(lock_);
+		for (auto const &handler : handlers_) {
+			MidiController::instance()->removeMessageHandler(handler.second);
+		}
+	}
+
+	RD8MidiTransport::ReceiverID RD8MidiControllerTransport::addReceiver(Receiver receiver)
+	{
+		ScopedLock lock(lock_);
+		auto handle = MidiController::makeNoneHandle();
+		MidiController::instance()->addMessageHandler(handle, [receiver](MidiInput *source, const MidiMessage &message) {
+			ignoreUnused(source);
+			receiver(message);
+		});
+		MidiController::instance()->enableMidiInput(device_->midiInput());
+		ReceiverID receiverID = nextReceiverID_++;
+		handlers_[receiverID] = handle;
+		return receiverID;
+	}
+
+	void RD8MidiControllerTransport::removeReceiver(ReceiverID receiverID)
+	{
+		ScopedLock lock(lock_);
+		auto found = handlers_.find(receiverID);
+		if (found != handlers_.end()) {
+			MidiController::instance()->removeMessageHandler(found->second);
+			handlers_.erase(found);
+		}
+	}
+
+	void RD8MidiControllerTransport::send(std::vector<MidiMessage> const &messages)
+	{
+		// The input might have changed since the receivers were added
+		MidiController::instance()->enableMidiInput(device_->midiInput());
+		auto buffer = MidiHelpers::bufferFromMessages(messages);
+		MidiController::instance()->getMidiOutput(device_->midiOutput())->sendBlockOfMessagesNow(buffer);
+	}
+
+	void RD8MidiControllerTransport::sendDebounced(MidiMessage const &message, int milliseconds)
+	{
+		MidiController::instance()->getMidiOutput(device_->midiOutput())->sendMessageDebounced(message, milliseconds);
+	}
+
+}
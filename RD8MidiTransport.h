@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Synth.h"
+#include "MidiController.h"
+
+namespace midikraft {
+
+	// The MIDI I/O used by the RD8 adaptation for its own transactions. The default sends via the MidiController to the ports
+	// the device was detected on, but it can be replaced e.g. by the RD8VirtualDevice to run without hardware.
+	class RD8MidiTransport {
+	public:
+		typedef std::function<void(MidiMessage const &message)> Receiver;
+		typedef int ReceiverID;
+
+		virtual ~RD8MidiTransport() = default;
+
+		virtual ReceiverID addReceiver(Receiver receiver) = 0;
+		virtual void removeReceiver(ReceiverID receiverID) = 0;
+
+		virtual void send(std::vector<MidiMessage> const &messages) = 0;
+		virtual void sendDebounced(MidiMessage const &message, int milliseconds) = 0;
+	};
+
+	class RD8MidiControllerTransport : public RD8MidiTransport {
+	public:
+		explicit RD8MidiControllerTransport(SimpleDiscoverableDevice const *device);
+		virtual ~RD8MidiControllerTransport() override;
+
+		virtual ReceiverID addReceiver(Receiver receiver) override;
+		virtual void removeReceiver(ReceiverID receiverID) override;
+
+		virtual void send(std::vector<MidiMessage> const &messages) override;
+		virtual void sendDebounced(MidiMessage const &message, int milliseconds) override;
+
+	private:
+		SimpleDiscoverableDevice const *device_;
+		CriticalSection lock_;
+		ReceiverID nextReceiverID_ = 1;
+		std::map<ReceiverID, MidiController::HandlerHandle> handlers_;
+	};
+
+}
@@ -2,9 +2,12 @@
 
 #include "MidiHelpers.h"
 #include "RD8.h"
+#include "RD8SysexCodec.h"
 
 #include <boost/format.hpp>
 
+#include <unordered_map>
+
 namespace midikraft {
 
 	RD8DataFile::RD8DataFile(BehringerRD8 const *rd8, int dataTypeID, uint8 midiFileType) : DataFile(dataTypeID), rd8_(rd8), midiFileType_(midiFileType)
@@ -13,84 +16,71 @@ namespace midikraft {
 
 	bool RD8DataFile::isDataDump(const MidiMessage & message) const
 	{
-		if (rd8_->isOwnSysex(message)) {
-			auto id = rd8_->getMessageID(message);
-			if (id.messageType == RD8_DATA_MESSAGE && id.messageID == midiFileType_) {
-				return true;
+		return message.isSysEx() && isDataDump(message.getSysExData(), (size_t) message.getSysExDataSize());
+	}
+
+	bool RD8DataFile::isDataDump(uint8 const *sysexData, size_t size) const
+	{
+		return BehringerRD8::dataTypeOfSysex(sysexData, size) == dataTypeID();
+	}
+
+	bool RD8DataFile::dataFromSysex(const std::vector<MidiMessage> &messages)
+	{
+		// At least one of the messages is a data dump, we use the first one to find
+		for (auto const &message : messages) {
+			if (isDataDump(message)) {
+				return dataFromSysexData(message.getSysExData(), (size_t) message.getSysExDataSize());
 			}
 		}
 		return false;
 	}
 
-	std::vector<uint8> RD8DataFile::unescapeSysex(const std::vector<uint8> &input) const
+	void RD8DataFile::setDataFromSysexData(uint8 const *sysexData, size_t size)
 	{
-		std::vector<uint8> result;
-		int dataIndex = 0;
-		while (dataIndex < input.size()) {
-			uint8 ms_bits = input.data()[dataIndex];
-			dataIndex++;
-			for (int i = 0; i < 7; i++) {
-				if (dataIndex < input.size()) {
-					result.push_back(input.data()[dataIndex] | ((ms_bits & (1 << i)) << (7 - i)));
-				}
-				dataIndex++;
-			}
+		// Copy the bytes straight into the data of the file, once. None of the RD8 files override setData, so nothing is skipped
+		data_.assign(sysexData, sysexData + size);
+	}
+
+	void RD8DataFile::recordDecodeTime(int64 startedAtMicroseconds) const
+	{
+		if (rd8_) {
+			rd8_->metrics().recordDecodeTime(dataTypeID(), RD8Metrics::nowMicroseconds() - startedAtMicroseconds);
 		}
-		return result;
 	}
 
-	std::vector<juce::uint8> RD8DataFile::escapeSysex(const std::vector<uint8> &input) const
+	std::vector<uint8> RD8DataFile::unescapeSysex(const std::vector<uint8> &input) const
 	{
-		std::vector<juce::uint8> result;
-		int readIndex = 0;
-		while (readIndex < input.size()) {
-			// Write an empty msb byte and record the index
-			result.push_back(0);
-			size_t msbIndex = result.size() - 1;
-
-			// Now append the next 7 bytes from the input, and set their msb byte
-			uint8 msb = 0;
-			for (int i = 0; i < 7; i++) {
-				if (readIndex < input.size()) {
-					result.push_back(input.at(readIndex) & 0x7f);
-					msb |= (input.at(readIndex) & 0x80) >> (7 - i);
-				}
-				readIndex++;
-			}
+		return RD8SysexCodec::unescape(input.data(), input.size());
+	}
 
-			// Then poke the msb back into the result stream
-			result.at(msbIndex) = msb;
-		}
-		return result;
+	std::vector<juce::uint8> RD8DataFile::escapeSysex(const std::vector<uint8> &input) const
+	{
+		return RD8SysexCodec::escape(input.data(), input.size());
 	}
 
 	RD8StoredPattern::RD8StoredPattern(BehringerRD8 const *rd8) : RD8Pattern(rd8, BehringerRD8::STORED_PATTERN, RD8_STORED_PATTERN_RESPONSE)
 	{
 	}
 
+	size_t RD8StoredPattern::payloadOffset() const
+	{
+		return 16;
+	}
+
 	std::string RD8StoredPattern::name() const
 	{
 		return (boost::format("Pattern %02d/%03d") % (int) songNo % (int)patternNo).str();
 	}
 
-	bool RD8StoredPattern::dataFromSysex(const std::vector<MidiMessage> &messages)
+	bool RD8StoredPattern::dataFromSysexData(uint8 const *sysexData, size_t size)
 	{
-		// At least one of the messages is a data dump, we use the first one to find
-		for (auto message : messages) {
-			if (isDataDump(message)) {
-				// As we don't know the format yet, just copy out all bytes we can get
-				if (message.getSysExDataSize() > 15) {
-					songNo = message.getSysExData()[14];
-					patternNo = message.getSysExData()[15];
-					// The rest is binary data we need to decrypt
-					/*std::vector<uint8> data;
-					for (int i = 16; i < message.getSysExDataSize(); i++) {
-						data.push_back(message.getSysExData()[i]);
-					}*/
-					setDataFromSysex(message);
-					return true;
-				}
-			}
+		if (isDataDump(sysexData, size) && size > 15) {
+			songNo = sysexData[14];
+			patternNo = sysexData[15];
+			// The rest is binary data we need to decrypt, this is done on demand
+			setDataFromSysexData(sysexData, size);
+			invalidatePatternData();
+			return true;
 		}
 		return false;
 	}
@@ -104,28 +94,32 @@ namespace midikraft {
 		return std::vector<MidiMessage>({ MidiHelpers::sysexMessage(data()) });
 	}
 
+	int RD8StoredPattern::itemNo() const
+	{
+		return songNo * 16 + patternNo;
+	}
+
 	RD8LivePattern::RD8LivePattern(BehringerRD8 const *rd8) : RD8Pattern(rd8, BehringerRD8::LIVE_PATTERN, RD8_LIVE_PATTERN_RESPONSE)
 	{
 	}
 
+	size_t RD8LivePattern::payloadOffset() const
+	{
+		return 14;
+	}
+
 	std::string RD8LivePattern::name() const
 	{
 		return "Live Pattern";
 	}
 
-	bool RD8LivePattern::dataFromSysex(const std::vector<MidiMessage> &messages)
+	bool RD8LivePattern::dataFromSysexData(uint8 const *sysexData, size_t size)
 	{
-		// At least one of the messages is a data dump, we use the first one to find
-		for (auto message : messages) {
-			if (isDataDump(message)) {
-				// As we don't know the format yet, just copy out all bytes we can get
-				/*std::vector<uint8> data;
-				for (int i = 14; i < message.getSysExDataSize(); i++) {
-					data.push_back(message.getSysExData()[i]);
-				}*/
-				setDataFromSysex(message);
-				return true;
-			}
+		if (isDataDump(sysexData, size)) {
+			// The binary data is decrypted on demand
+			setDataFromSysexData(sysexData, size);
+			invalidatePatternData();
+			return true;
 		}
 		return false;
 	}
@@ -137,32 +131,77 @@ namespace midikraft {
 		return { MidiHelpers::sysexMessage(data()) };
 	}
 
+	int RD8Song::PatternReference::itemNo() const
+	{
+		return songNo * 16 + patternNo;
+	}
+
+	std::shared_ptr<RD8Song::SongData> RD8Song::getSong(Layout layout) const
+	{
+		auto result = std::make_shared<SongData>();
+		if (!getSong(*result, layout)) {
+			return std::shared_ptr<SongData>();
+		}
+		return result;
+	}
+
+	bool RD8Song::getSong(SongData &out, Layout layout) const
+	{
+		out.chain.clear();
+		if (!kSongLayoutVerified && layout != Layout::AllowUnverified) {
+			return false;
+		}
+		size_t offset = payloadOffset();
+		if (data().size() <= offset) {
+			return false;
+		}
+		int64 startedAt = RD8Metrics::nowMicroseconds();
+		// The size of the song data is not known, so this can't use a fixed stack buffer like the patterns
+		auto songData = RD8SysexCodec::unescape(data().data() + offset, data().size() - offset);
+		bool ok = decodeSongData(songData.data(), songData.size(), out);
+		recordDecodeTime(startedAt);
+		return ok;
+	}
+
+	bool RD8Song::decodeSongData(uint8 const *songData, size_t size, SongData &out)
+	{
+		out.chain.clear();
+		if (size <= ChainLength) {
+			return false;
+		}
+		int length = songData[ChainLength];
+		if (length > kMaxChainLength || Chain + (size_t) length > size) {
+			return false;
+		}
+		out.chain.reserve((size_t) length);
+		for (int i = 0; i < length; i++) {
+			uint8 reference = songData[Chain + i];
+			out.chain.push_back({ (uint8) (reference >> 4), (uint8) (reference & 0x0f) });
+		}
+		return true;
+	}
+
 	RD8StoredSong::RD8StoredSong(BehringerRD8 const *rd8) : RD8Song(rd8, BehringerRD8::STORED_SONG, RD8_STORED_SONG_RESPONSE)
 	{
 	}
 
+	size_t RD8StoredSong::payloadOffset() const
+	{
+		return 15;
+	}
+
 	std::string RD8StoredSong::name() const
 	{
 		return (boost::format("Stored Song %02d") % (int) songNo ).str();
 	}
 
-	bool RD8StoredSong::dataFromSysex(const std::vector<MidiMessage> &messages)
+	bool RD8StoredSong::dataFromSysexData(uint8 const *sysexData, size_t size)
 	{
-		// At least one of the messages is a data dump, we use the first one to find
-		for (auto message : messages) {
-			if (isDataDump(message)) {
-				// As we don't know the format yet, just copy out all bytes we can get
-				if (message.getSysExDataSize() > 14) {
-					songNo = message.getSysExData()[14];
-					// The rest is binary data we need to decrypt
-					/*std::vector<uint8> data;
-					for (int i = 15; i < message.getSysExDataSize(); i++) {
-						data.push_back(message.getSysExData()[i]);
-					}*/
-					setDataFromSysex(message);
-					return true;
-				}
-			}
+		if (isDataDump(sysexData, size) && size > 14) {
+			songNo = sysexData[14];
+			// As we don't know the format yet, just keep all bytes we can get
+			setDataFromSysexData(sysexData, size);
+			return true;
 		}
 		return false;
 	}
@@ -175,27 +214,26 @@ namespace midikraft {
 		return { MidiHelpers::sysexMessage(data()) };
 	}
 
-	RD8LiveSong::RD8LiveSong(BehringerRD8 const *rd8) : RD8Song(rd8, BehringerRD8::LIVE_PATTERN, RD8_LIVE_PATTERN_RESPONSE)
+	RD8LiveSong::RD8LiveSong(BehringerRD8 const *rd8) : RD8Song(rd8, BehringerRD8::LIVE_SONG, RD8_LIVE_SONG_RESPONSE)
 	{
 	}
 
+	size_t RD8LiveSong::payloadOffset() const
+	{
+		return 14;
+	}
+
 	std::string RD8LiveSong::name() const
 	{
 		return "Live Song";
 	}
 
-	bool RD8LiveSong::dataFromSysex(const std::vector<MidiMessage> &messages)
+	bool RD8LiveSong::dataFromSysexData(uint8 const *sysexData, size_t size)
 	{
-		// At least one of the messages is a data dump, we use the first one to find
-		for (auto message : messages) {
-			if (isDataDump(message)) {
-				// As we don't know the format yet, just copy out all bytes we can get
-				/*std::vector<uint8> data; 
-				for (int i = 14; i < message.getSysExDataSize(); i++) {
-					data.push_back(message.getSysExData()[i]);
-				}*/
-				setDataFromSysex(message);
-			}
+		if (isDataDump(sysexData, size)) {
+			// As we don't know the format yet, just keep all bytes we can get
+			setDataFromSysexData(sysexData, size);
+			return true;
 		}
 		return false;
 	}
@@ -216,37 +254,32 @@ namespace midikraft {
 		return "Settings";
 	}
 
-	bool RD8GlobalSettings::dataFromSysex(const std::vector<MidiMessage> &messages)
+	bool RD8GlobalSettings::dataFromSysexData(uint8 const *sysexData, size_t size)
 	{
-		// At least one of the messages is a data dump, we use the first one to find
-		for (auto message : messages) {
-			if (isDataDump(message)) {
-				// As we don't know the format yet, just copy out all bytes we can get
-				std::vector<uint8> rawData;
-				for (int i = 14; i < message.getSysExDataSize(); i++) {
-					rawData.push_back(message.getSysExData()[i]);
-				}
-				setData(unescapeSysex(rawData));
-				globalSettings_.clear();
-				// Load the individual data items and create a data structure that will be used by the property panel
-				for (auto setting : kGlobalSettingsDefinition) {
-					globalSettings_.push_back(std::make_shared<TypedNamedValue>(setting.def)); // Use copy constructor to create shared object
-					if (setting.index < data().size()) {
-						var dataVariant = at(setting.index);
-						globalSettings_.back()->value() = dataVariant;
-					}
-				}
-				return true;
+		if (!isDataDump(sysexData, size) || size < 14) {
+			return false;
+		}
+		int64 startedAt = RD8Metrics::nowMicroseconds();
+		setData(RD8SysexCodec::unescape(sysexData + 14, size - 14));
+		globalSettings_.clear();
+		// Load the individual data items and create a data structure that will be used by the property panel
+		for (auto const &setting : kGlobalSettingsDefinition) {
+			globalSettings_.push_back(std::make_shared<TypedNamedValue>(setting.def)); // Use copy constructor to create shared object
+			if (setting.index < (int) data().size()) {
+				var dataVariant = at(setting.index);
+				globalSettings_.back()->value() = dataVariant;
 			}
 		}
-		return false;
+		recordDecodeTime(startedAt);
+		return true;
 	}
 
 	std::vector<juce::MidiMessage> RD8GlobalSettings::dataToSysex() const
 	{
 		auto message = rd8_->createRequestMessage(BehringerRD8::MessageID({ RD8_DATA_MESSAGE,  midiFileType_ }));
-		auto escapedData = escapeSysex(data());
-		message.insert(message.end(), escapedData.begin(), escapedData.end());
+		size_t headerSize = message.size();
+		message.resize(headerSize + RD8SysexCodec::escapedSize(data().size()));
+		RD8SysexCodec::escape(data().data(), data().size(), message.data() + headerSize);
 		return std::vector<MidiMessage>({ MidiHelpers::sysexMessage(message) });
 	}
 
@@ -255,26 +288,78 @@ namespace midikraft {
 		return globalSettings_;
 	}
 
-	bool RD8GlobalSettings::pokeSetting(std::string const &settingName, uint8 newValue)
+	bool RD8GlobalSettings::poke(Setting setting, uint8 newValue)
 	{
-		for (auto setting : kGlobalSettingsDefinition) {
-			if (setting.def.name().toStdString() == settingName) {
-				if (newValue >= setting.def.minValue() && newValue <= setting.def.maxValue()) {
-					setAt(setting.index, newValue);
-					return true;
-				}
-			}
+		jassert(setting >= 0 && setting < NumberOfSettings);
+		auto const &layout = kSettingsLayout[setting];
+		if (newValue >= layout.minValue && newValue <= layout.maxValue && layout.index < (int) data().size()) {
+			setAt(layout.index, newValue);
+			return true;
 		}
 		return false;
 	}
 
-	juce::uint8 RD8GlobalSettings::peekSetting(std::string const &settingName) const
+	uint8 RD8GlobalSettings::peek(Setting setting) const
+	{
+		jassert(setting >= 0 && setting < NumberOfSettings);
+		auto const &layout = kSettingsLayout[setting];
+		if (layout.index < (int) data().size()) {
+			return (uint8) at(layout.index);
+		}
+		jassertfalse;
+		return 0xff;
+	}
+
+	RD8GlobalSettings::Setting RD8GlobalSettings::settingFromName(std::string_view settingName)
+	{
+		// The keys point into the static layout table, so building and querying the index needs no string copies
+		static const std::unordered_map<std::string_view, Setting> kNameIndex = []() {
+			std::unordered_map<std::string_view, Setting> result;
+			for (int i = 0; i < NumberOfSettings; i++) {
+				result.emplace(kSettingsLayout[i].name, (Setting) i);
+			}
+			return result;
+		}();
+		auto found = kNameIndex.find(settingName);
+		return found != kNameIndex.end() ? found->second : NumberOfSettings;
+	}
+
+	char const * RD8GlobalSettings::settingName(Setting setting)
 	{
-		for (auto setting: kGlobalSettingsDefinition) {
-			if (setting.def.name().toStdString() == settingName) {
-				return (uint8) at(setting.index);
+		jassert(setting >= 0 && setting < NumberOfSettings);
+		return kSettingsLayout[setting].name;
+	}
+
+	RD8GlobalSettings::Setting RD8GlobalSettings::settingAt(int dataIndex, int &outElement)
+	{
+		outElement = 0;
+		if (dataIndex >= kSettingsLayout[GlobalFilterSteps].index && dataIndex < kSettingsLayout[GlobalFilterSteps].index + RD8Pattern::kNumberOfSteps) {
+			outElement = dataIndex - kSettingsLayout[GlobalFilterSteps].index;
+			return GlobalFilterSteps;
+		}
+		for (int i = 0; i < NumberOfSettings; i++) {
+			if (kSettingsLayout[i].index == dataIndex) {
+				return (Setting) i;
 			}
 		}
+		return NumberOfSettings;
+	}
+
+	bool RD8GlobalSettings::pokeSetting(std::string_view settingName, uint8 newValue)
+	{
+		Setting setting = settingFromName(settingName);
+		if (setting != NumberOfSettings) {
+			return poke(setting, newValue);
+		}
+		return false;
+	}
+
+	juce::uint8 RD8GlobalSettings::peekSetting(std::string_view settingName) const
+	{
+		Setting setting = settingFromName(settingName);
+		if (setting != NumberOfSettings) {
+			return peek(setting);
+		}
 		jassert(false);
 		return 0xff;
 	}
@@ -290,121 +375,428 @@ namespace midikraft {
 		AnalogClockMode = 6
 	};
 
-	std::map<int, std::string> kPreferenceLookup = { {0, "Song" }, { 1, "Global" }, { 2, "Pattern" } };
-	std::map<int, std::string> kMidiChannelLookup = { {0, "1"}, { 1, "2"}, {2, "3" }, { 3, "4" }, { 4, "5" }, { 5, "6" }, { 6, "7" }, { 7, "8" }, { 8, "9" }, { 9, "10" },
-		{10, "11" }, { 11, "12" }, { 12, "13" }, { 13, "14" }, { 14, "15" }, { 15, "16" }, { 16, "All (omni)" } };
-
-	std::vector<RD8GlobalSettings::ValueDefinition> RD8GlobalSettings::kGlobalSettingsDefinition = {
-				//{2, "Last Loaded Song"}
-				//{3, "Last Loaded Pattern"}
-				{ 4, TypedNamedValue("Device ID", "General", 0, 0, 15) },
-				{ 5, TypedNamedValue("Clock Source", "General", 0, { {0, "Internal"}, {1, "MIDI" }, { 2, "USB" }, { 3, "Trigger" } }) },
-				{ 6, TypedNamedValue("Analog Clock Mode", "General", 0, { {0, "1 PPQ"}, {1, "2 PPQ" }, { 2, "4 PPQ" }, { 3, "24 PPQ" }, { 4, "48 PPQ" } })  },
-				{ 7, TypedNamedValue("MIDI RX Channel", "MIDI", 0, kMidiChannelLookup) }, // MIDIChannel with extra!
-				{ 8, TypedNamedValue("MIDI TX Channel", "MIDI", 0, kMidiChannelLookup) }, // MIDIChannel with extra!
-				{ 9, TypedNamedValue("MIDI to USB through", "MIDI", false) },
-				{ 10, TypedNamedValue("MIDI soft through", "MIDI", false) },
-				{ 11, TypedNamedValue("USB RX Channel", "MIDI", 0, kMidiChannelLookup) }, // MIDIChannel with extra! 16 = All, 17 = equal to Out
-				{ 12, TypedNamedValue("USB TX Channel", "MIDI", 0, kMidiChannelLookup) }, // MIDIChannel with extra!
-				{ 13, TypedNamedValue("USB to MIDI through", "MIDI", false) },
-				{ 14, TypedNamedValue("Bass Drum MIDI Note", "Note mapping", 0, 0, 128) },
-				{ 15, TypedNamedValue("Snare Drum MIDI Note", "Note mapping", 0, 0, 128) },
-				{ 16, TypedNamedValue("Low Tom MIDI Note", "Note mapping", 0, 0, 128) },
-				{ 17, TypedNamedValue("Mid Tom MIDI Note", "Note mapping", 0, 0, 128) },
-				{ 18, TypedNamedValue("High Tom MIDI Note", "Note mapping", 0, 0, 128) },
-				{ 19, TypedNamedValue("Rim Shot MIDI Note", "Note mapping", 0, 0, 128) },
-				{ 20, TypedNamedValue("Hand Clap MIDI Note", "Note mapping", 0, 0, 128) },
-				{ 21, TypedNamedValue("Cow Bell MIDI Note", "Note mapping", 0, 0, 128) },
-				{ 22, TypedNamedValue("Cymbal MIDI Note", "Note mapping", 0, 0, 128) },
-				{ 23, TypedNamedValue("Open Hat MIDI Note", "Note mapping", 0, 0, 128) },
-				{ 24, TypedNamedValue("Closed Hat MIDI Note", "Note mapping", 0, 0, 128) },
-				{ 25, TypedNamedValue("Song Chain Mode", "Song mode", false)},
-				{ 26, TypedNamedValue("Tempo Preference", "Preferences", 0, kPreferenceLookup) },
-				{ 27, TypedNamedValue("Swing Preference", "Preferences", 0, kPreferenceLookup) },
-				{ 28, TypedNamedValue("Probability Preference", "Preferences", 0, kPreferenceLookup) },
-				{ 29, TypedNamedValue("Flam Preference", "Preferences", 0, kPreferenceLookup) },
-				{ 30, TypedNamedValue("Filter Mode Preference", "Preferences", 0, kPreferenceLookup) },
-				{ 31, TypedNamedValue("Filter Enable Preference", "Preferences", 0, kPreferenceLookup) },
-				{ 32, TypedNamedValue("Filter Automation Preference", "Preferences", 0, kPreferenceLookup) },
-				{ 33, TypedNamedValue("Polymeter Preference", "Preferences", 0, kPreferenceLookup) },
-				{ 34, TypedNamedValue("Step Size Preference", "Preferences", 0, kPreferenceLookup) },
-				{ 35, TypedNamedValue("Auto Advance Preference", "Preferences", 0, {{0, "Song"}, {1, "Global" }}) },
-				{ 36, TypedNamedValue("Auto Scroll Preference", "Preferences", 0, { {1, "Global" }, { 2, "Pattern" }}) },
-				{ 37, TypedNamedValue("FX Bus Preference", "Preferences", 0, kPreferenceLookup)},
-				{ 38, TypedNamedValue("Mute Preference", "Preferences", 0, kPreferenceLookup)},
-				{ 39, TypedNamedValue("Solo Preference", "Preferences", 0, kPreferenceLookup)},
-				{ 40, TypedNamedValue("Global Tempo", "GlobalSettings", 0, 20, 240) },
-				{ 41, TypedNamedValue("Global Swing", "GlobalSettings", 0, 50, 75) },
-				{ 42, TypedNamedValue("Global Probability", "GlobalSettings", 0, 0, 100) },
-				{ 43, TypedNamedValue("Global Flam", "GlobalSettings", 0, 0, 24) },
-				{ 44, TypedNamedValue("Global Filter Mode", "GlobalSettings", false) },
-				{ 45, TypedNamedValue("Global Filter Enable", "GlobalSettings", false)},
-				{ 46, TypedNamedValue("Global Filter Automation", "GlobalSettings", false)},
-				{ 47, TypedNamedValue("Global Filter Steps", "GlobalSettings", 0, 0, 255)}, // This is an interesting editor... needs an array var
-				{ 47 + 64 , TypedNamedValue("Global Polymeter", "GlobalSettings", false)},
-				{ 47 + 64 + 1 , TypedNamedValue("Global Step Size", "GlobalSettings", false)},
-				{ 47 + 64 + 2 , TypedNamedValue("Global Auto-Advance", "GlobalSettings", false)},
-				{ 47 + 64 + 3 , TypedNamedValue("Global Auto-Scroll", "GlobalSettings", false)},
-				//{ 47 + 64 + 4 , "Global FX Assignments", 0, 1},
-				//{ 47 + 64 + 5 , "Global Mute Assignments", 0, 1},
-				//{ 47 + 64 + 6 , "Global Solo Assignments", 0, 1},
-			};
+	namespace {
+		// Names of the values of the choice settings, starting at the minimum value of the setting
+		constexpr char const *kClockSourceNames[] = { "Internal", "MIDI", "USB", "Trigger" };
+		constexpr char const *kAnalogClockModeNames[] = { "1 PPQ", "2 PPQ", "4 PPQ", "24 PPQ", "48 PPQ" };
+		constexpr char const *kMidiChannelNames[] = { "1", "2", "3", "4", "5", "6", "7", "8", "9", "10", "11", "12", "13", "14", "15", "16", "All (omni)" }; // MIDIChannel with extra!
+		constexpr char const *kPreferenceNames[] = { "Song", "Global", "Pattern" };
+		constexpr char const *kAutoScrollPreferenceNames[] = { "Global", "Pattern" };
+	}
+
+	// The single description of the settings: position in the data, valid range, and how the property panel shows them.
+	// The names are the keys of the ValueTree properties
+	constexpr RD8GlobalSettings::SettingLayout RD8GlobalSettings::kSettingsLayout[RD8GlobalSettings::NumberOfSettings] = {
+		//{2, "Last Loaded Song"}
+		//{3, "Last Loaded Pattern"}
+		{ 4, "Device ID", "General", Number, 0, 15 },
+		{ 5, "Clock Source", "General", Choice, 0, 3, kClockSourceNames },
+		{ 6, "Analog Clock Mode", "General", Choice, 0, 4, kAnalogClockModeNames },
+		{ 7, "MIDI RX Channel", "MIDI", Choice, 0, 16, kMidiChannelNames },
+		{ 8, "MIDI TX Channel", "MIDI", Choice, 0, 16, kMidiChannelNames },
+		{ 9, "MIDI to USB through", "MIDI", Flag, 0, 1 },
+		{ 10, "MIDI soft through", "MIDI", Flag, 0, 1 },
+		{ 11, "USB RX Channel", "MIDI", Choice, 0, 16, kMidiChannelNames }, // 16 = All, 17 = equal to Out
+		{ 12, "USB TX Channel", "MIDI", Choice, 0, 16, kMidiChannelNames },
+		{ 13, "USB to MIDI through", "MIDI", Flag, 0, 1 },
+		{ 14, "Bass Drum MIDI Note", "Note mapping", Number, 0, 128 },
+		{ 15, "Snare Drum MIDI Note", "Note mapping", Number, 0, 128 },
+		{ 16, "Low Tom MIDI Note", "Note mapping", Number, 0, 128 },
+		{ 17, "Mid Tom MIDI Note", "Note mapping", Number, 0, 128 },
+		{ 18, "High Tom MIDI Note", "Note mapping", Number, 0, 128 },
+		{ 19, "Rim Shot MIDI Note", "Note mapping", Number, 0, 128 },
+		{ 20, "Hand Clap MIDI Note", "Note mapping", Number, 0, 128 },
+		{ 21, "Cow Bell MIDI Note", "Note mapping", Number, 0, 128 },
+		{ 22, "Cymbal MIDI Note", "Note mapping", Number, 0, 128 },
+		{ 23, "Open Hat MIDI Note", "Note mapping", Number, 0, 128 },
+		{ 24, "Closed Hat MIDI Note", "Note mapping", Number, 0, 128 },
+		{ 25, "Song Chain Mode", "Song mode", Flag, 0, 1 },
+		{ 26, "Tempo Preference", "Preferences", Choice, 0, 2, kPreferenceNames },
+		{ 27, "Swing Preference", "Preferences", Choice, 0, 2, kPreferenceNames },
+		{ 28, "Probability Preference", "Preferences", Choice, 0, 2, kPreferenceNames },
+		{ 29, "Flam Preference", "Preferences", Choice, 0, 2, kPreferenceNames },
+		{ 30, "Filter Mode Preference", "Preferences", Choice, 0, 2, kPreferenceNames },
+		{ 31, "Filter Enable Preference", "Preferences", Choice, 0, 2, kPreferenceNames },
+		{ 32, "Filter Automation Preference", "Preferences", Choice, 0, 2, kPreferenceNames },
+		{ 33, "Polymeter Preference", "Preferences", Choice, 0, 2, kPreferenceNames },
+		{ 34, "Step Size Preference", "Preferences", Choice, 0, 2, kPreferenceNames },
+		{ 35, "Auto Advance Preference", "Preferences", Choice, 0, 1, kPreferenceNames },
+		{ 36, "Auto Scroll Preference", "Preferences", Choice, 1, 2, kAutoScrollPreferenceNames },
+		{ 37, "FX Bus Preference", "Preferences", Choice, 0, 2, kPreferenceNames },
+		{ 38, "Mute Preference", "Preferences", Choice, 0, 2, kPreferenceNames },
+		{ 39, "Solo Preference", "Preferences", Choice, 0, 2, kPreferenceNames },
+		{ 40, "Global Tempo", "GlobalSettings", Number, 20, 240 },
+		{ 41, "Global Swing", "GlobalSettings", Number, 50, 75 },
+		{ 42, "Global Probability", "GlobalSettings", Number, 0, 100 },
+		{ 43, "Global Flam", "GlobalSettings", Number, 0, 24 },
+		{ 44, "Global Filter Mode", "GlobalSettings", Flag, 0, 1 },
+		{ 45, "Global Filter Enable", "GlobalSettings", Flag, 0, 1 },
+		{ 46, "Global Filter Automation", "GlobalSettings", Flag, 0, 1 },
+		{ 47, "Global Filter Steps", "GlobalSettings", Number, 0, 255 }, // This is an interesting editor... needs an array var
+		{ 47 + 64, "Global Polymeter", "GlobalSettings", Flag, 0, 1 },
+		{ 47 + 64 + 1, "Global Step Size", "GlobalSettings", Flag, 0, 1 },
+		{ 47 + 64 + 2, "Global Auto-Advance", "GlobalSettings", Flag, 0, 1 },
+		{ 47 + 64 + 3, "Global Auto-Scroll", "GlobalSettings", Flag, 0, 1 },
+		//{ 47 + 64 + 4 , "Global FX Assignments", 0, 1},
+		//{ 47 + 64 + 5 , "Global Mute Assignments", 0, 1},
+		//{ 47 + 64 + 6 , "Global Solo Assignments", 0, 1},
+	};
+
+	namespace {
+		constexpr bool isInDataOrder(RD8GlobalSettings::SettingLayout const *layout, int count)
+		{
+			for (int i = 1; i < count; i++) {
+				if (layout[i].index <= layout[i - 1].index) {
+					return false;
+				}
+			}
+			return true;
+		}
+	}
+
+	static_assert(isInDataOrder(RD8GlobalSettings::kSettingsLayout, RD8GlobalSettings::NumberOfSettings), "The settings must be listed in the order of the Setting enum and the data");
+
+	// The definitions for the property panel, generated from the layout
+	std::vector<RD8GlobalSettings::ValueDefinition> const RD8GlobalSettings::kGlobalSettingsDefinition = []() {
+		std::vector<ValueDefinition> result;
+		for (auto const &layout : kSettingsLayout) {
+			switch (layout.kind) {
+			case Flag:
+				result.push_back({ layout.index, TypedNamedValue(layout.name, layout.section, false) });
+				break;
+			case Choice: {
+				std::map<int, std::string> lookup;
+				for (int value = layout.minValue; value <= layout.maxValue; value++) {
+					lookup.emplace(value, layout.valueNames[value - layout.minValue]);
+				}
+				result.push_back({ layout.index, TypedNamedValue(layout.name, layout.section, 0, lookup) });
+				break;
+			}
+			case Number:
+				result.push_back({ layout.index, TypedNamedValue(layout.name, layout.section, 0, layout.minValue, layout.maxValue) });
+				break;
+			}
+		}
+		return result;
+	}();
 
 	std::shared_ptr<RD8Pattern::PatternData> RD8Pattern::getPattern() const
 	{
-		std::shared_ptr<RD8Pattern::PatternData> result = std::make_shared<RD8Pattern::PatternData>();
-		RD8Pattern::PatternData &out = *result;
+		auto result = std::make_shared<RD8Pattern::PatternData>();
+		if (!getPattern(*result)) {
+			return std::shared_ptr<RD8Pattern::PatternData>();
+		}
+		return result;
+	}
 
-		// Check that the data version and the product version are ok!
-		if (!(at(PatternDataVersion) == 0 && at(ProductVariant) == 0x08) || data().size() != 889) {
+	bool RD8Pattern::getPattern(PatternData &out) const
+	{
+		int64 startedAt = RD8Metrics::nowMicroseconds();
+		bool ok;
+		// Use the cached payload if there is one, but don't create it, so decoding a whole library stays free of allocations
+		auto cached = std::atomic_load(&patternData_);
+		if (cached) {
+			ok = decodePatternData(cached->data(), cached->size(), out);
+		}
+		else {
+			// Unescape into a stack buffer, the pattern data has a fixed size
+			std::array<uint8, kPatternDataSize> patternData;
+			ok = getPatternData(patternData.data()) && decodePatternData(patternData.data(), patternData.size(), out);
+		}
+		recordDecodeTime(startedAt);
+		return ok;
+	}
+
+	bool RD8Pattern::getPatternData(uint8 *out) const
+	{
+		size_t offset = payloadOffset();
+		if (data().size() <= offset || RD8SysexCodec::unescapedSize(data().size() - offset) != kPatternDataSize) {
 			jassert(false);
-			return std::shared_ptr<RD8Pattern::PatternData>();
+			return false;
+		}
+		RD8SysexCodec::unescape(data().data() + offset, data().size() - offset, out);
+		return true;
+	}
+
+	std::shared_ptr<std::array<uint8, RD8Pattern::kPatternDataSize> const> RD8Pattern::cachedPatternData() const
+	{
+		auto cached = std::atomic_load(&patternData_);
+		if (!cached) {
+			// Two threads might both unescape, that is harmless as the results are equal
+			int64 startedAt = RD8Metrics::nowMicroseconds();
+			auto patternData = std::make_shared<std::array<uint8, kPatternDataSize>>();
+			bool ok = getPatternData(patternData->data());
+			recordDecodeTime(startedAt);
+			if (!ok) {
+				return nullptr;
+			}
+			cached = patternData;
+			std::atomic_store(&patternData_, cached);
+		}
+		return cached;
+	}
+
+	void RD8Pattern::invalidatePatternData()
+	{
+		std::atomic_store(&patternData_, std::shared_ptr<std::array<uint8, kPatternDataSize> const>());
+	}
+
+	uint8 RD8Pattern::cachedByte(size_t index) const
+	{
+		auto cached = cachedPatternData();
+		return cached ? (*cached)[index] : 0;
+	}
+
+	uint8 RD8Pattern::tempo() const
+	{
+		return cachedByte(Tempo);
+	}
+
+	uint8 RD8Pattern::swing() const
+	{
+		return cachedByte(Swing);
+	}
+
+	uint8 RD8Pattern::probability() const
+	{
+		return cachedByte(Probability);
+	}
+
+	uint8 RD8Pattern::flamLevel() const
+	{
+		return cachedByte(FlamLevel);
+	}
+
+	uint8 RD8Pattern::stepSize() const
+	{
+		return cachedByte(StepSize);
+	}
+
+	bool RD8Pattern::polymeterOnOff() const
+	{
+		return cachedByte(PolymeterOnOff) != 0;
+	}
+
+	uint8 RD8Pattern::stepByte(int trackNo, int stepNo) const
+	{
+		jassert(trackNo >= 0 && trackNo < kNumberOfTracks && stepNo >= 0 && stepNo < kNumberOfSteps);
+		return cachedByte(AccentSteps + (size_t) (trackNo * kNumberOfSteps + stepNo));
+	}
+
+	uint64 RD8Pattern::trackOnOff(int trackNo) const
+	{
+		jassert(trackNo >= 0 && trackNo < kNumberOfTracks);
+		auto cached = cachedPatternData();
+		return cached ? RD8StepPlanes::onOffMask(cached->data() + AccentSteps + trackNo * kNumberOfSteps) : 0;
+	}
+
+	int RD8Pattern::numberOfActiveSteps(int trackNo) const
+	{
+		return popcount64(trackOnOff(trackNo));
+	}
+
+	int RD8Pattern::numberOfActiveSteps() const
+	{
+		auto cached = cachedPatternData();
+		if (!cached) {
+			return 0;
 		}
+		int result = 0;
+		for (int track = 0; track < kNumberOfTracks; track++) {
+			result += popcount64(RD8StepPlanes::onOffMask(cached->data() + AccentSteps + track * kNumberOfSteps));
+		}
+		return result;
+	}
 
-		// Interpret pattern data
-		out.tracks.clear();
-		for (int track = 0; track < 12; track++) {
-			out.tracks.push_back(std::vector<std::shared_ptr<StepData>>());
-			for (int step = 0; step < 64; step++) {
-				uint8 toDecode = (uint8) at(AccentSteps + track * 64 + step);
-				std::shared_ptr<RD8Pattern::StepData> stepData = std::make_shared<RD8Pattern::StepData>();
-				stepData->stepOnOff = (toDecode & STEP_BYTE_MASK_ON_OFF_BIT) != 0;
-				stepData->probabilityOnOff = (toDecode & STEP_BYTE_MASK_PROBABILITY_BIT) != 0;
-				stepData->flamOnOff = (toDecode & STEP_BYTE_MASK_FLAM_BIT) != 0;
-				stepData->repeatOnOff = (toDecode & STEP_BYTE_MASK_NOTE_REPEAT_ON_OFF_BIT) != 0;
-				stepData->repeat = (toDecode & STEP_BYTE_MASK_NOTE_REPEAT) >> 5;
-				out.tracks[track].push_back(stepData);
+	bool RD8Pattern::PatternChanges::any() const
+	{
+		return changedTracks != 0 || parametersChanged || otherChanged;
+	}
+
+	RD8Pattern::FieldLocation RD8Pattern::fieldAt(size_t index)
+	{
+		static char const *kParameterNames[] = { "Tempo", "Swing", "Probability", "Flam Level", "Filter Mode", "Filter Enable", "Filter Automation" };
+		if (index >= AccentSteps && index < PatternLength) {
+			int step = (int) (index - AccentSteps);
+			return { FieldLocation::Step, step / kNumberOfSteps, step % kNumberOfSteps, "Step" };
+		}
+		if (index >= Tempo && index < FilterSteps) {
+			return { FieldLocation::Parameter, -1, -1, kParameterNames[index - Tempo] };
+		}
+		if (index >= FilterSteps && index < PolymeterOnOff) {
+			return { FieldLocation::FilterStep, -1, (int) (index - FilterSteps), "Filter Step" };
+		}
+		switch (index) {
+		case PolymeterOnOff: return { FieldLocation::Parameter, -1, -1, "Polymeter" };
+		case StepSize: return { FieldLocation::Parameter, -1, -1, "Step Size" };
+		case AutoAdvance: return { FieldLocation::Parameter, -1, -1, "Auto Advance" };
+		case PatternDataVersion: return { FieldLocation::Other, -1, -1, "Data Version" };
+		case ProductVariant: return { FieldLocation::Other, -1, -1, "Product Variant" };
+		default:
+			if (index >= PatternLength && index < RandomOnOff) {
+				return { FieldLocation::Other, -1, -1, "Unknown, maybe lengths" };
+			}
+			if (index >= RandomOnOff && index < Next) {
+				return { FieldLocation::Other, -1, -1, "Random" };
 			}
+			return { FieldLocation::Other, -1, -1, "Unknown" };
 		}
+	}
+
+	RD8Pattern::PatternChanges RD8Pattern::diffPatternData(uint8 const *previous, uint8 const *current)
+	{
+		PatternChanges result;
+		auto classify = [&result](size_t index) {
+			auto location = fieldAt(index);
+			switch (location.field) {
+			case FieldLocation::Step:
+				result.changedTracks |= (uint16) (1 << location.trackNo);
+				break;
+			case FieldLocation::Parameter:
+			case FieldLocation::FilterStep:
+				result.parametersChanged = true;
+				break;
+			default:
+				result.otherChanged = true;
+			}
+		};
 
-		// Interpret pattern parameters
-		out.tempo = (uint8) at(Tempo);
-		out.swing = (uint8) at(Swing);
-		out.probability = (uint8) at(Probability);
-		out.flamLevel = (uint8) at(FlamLevel);
-		out.filterMode = (uint8) at(FilterMode);
-		jassert(at(FilterEnable) == 0 || at(FilterEnable) == 1); // Assuming this is a bool
-		out.filterOnOff = at(FilterEnable);
-		jassert(at(FilterAutomation) == 0 || at(FilterAutomation) == 1); // Assuming this is a bool
-		out.filterAutomationOnOff = at(FilterAutomation) != 0;
-		out.filterSteps.clear();
-		for (int i = 0; i < 64; i++) out.filterSteps.push_back((uint8)at(FilterSteps + i));
-		jassert(at(PolymeterOnOff) == 0 || at(PolymeterOnOff) == 1); // Assuming this is a bool
-		out.polymeterOnOff = at(PolymeterOnOff) != 0;
-		out.stepSize = (uint8)at(StepSize);
-		jassert(at(AutoAdvance) == 0 || at(AutoAdvance) == 1); // Assuming this is a bool
-		out.autoAdvanceOnOff = at(AutoAdvance) != 0;
+		// Compare 8 bytes at a time, and only look at the single bytes of words that differ
+		size_t i = 0;
+		for (; i + 8 <= kPatternDataSize; i += 8) {
+			uint64 a, b;
+			memcpy(&a, previous + i, 8);
+			memcpy(&b, current + i, 8);
+			if (a != b) {
+				for (size_t j = i; j < i + 8; j++) {
+					if (previous[j] != current[j]) {
+						classify(j);
+					}
+				}
+			}
+		}
+		for (; i < kPatternDataSize; i++) {
+			if (previous[i] != current[i]) {
+				classify(i);
+			}
+		}
 		return result;
 	}
 
+	void RD8Pattern::applyPatternChanges(uint8 const *current, PatternChanges const &changes, PatternData &inOut)
+	{
+		for (int track = 0; track < kNumberOfTracks; track++) {
+			if (changes.changedTracks & (1 << track)) {
+				uint8 const *stepBytes = current + AccentSteps + track * kNumberOfSteps;
+				for (int step = 0; step < kNumberOfSteps; step++) {
+					inOut.planes.setStepByte(track, step, stepBytes[step]);
+				}
+			}
+		}
+		if (changes.parametersChanged) {
+			decodePatternParameters(current, inOut);
+		}
+	}
+
+	bool RD8Pattern::decodePatternData(uint8 const *patternData, size_t size, PatternData &out)
+	{
+		// Check that the data version and the product version are ok!
+		if (size != kPatternDataSize || !(patternData[PatternDataVersion] == 0 && patternData[ProductVariant] == 0x08)) {
+			jassert(false);
+			return false;
+		}
+
+		// Interpret pattern data, the step bytes are split into bitplanes
+		out.planes.fromStepBytes(patternData + AccentSteps);
+
+		decodePatternParameters(patternData, out);
+		return true;
+	}
+
+	void RD8Pattern::encodePatternData(PatternData const &pattern, uint8 const *templateData, uint8 *out)
+	{
+		if (templateData) {
+			memcpy(out, templateData, kPatternDataSize);
+		}
+		else {
+			memset(out, 0, kPatternDataSize);
+			out[PatternDataVersion] = 0;
+			out[ProductVariant] = 0x08;
+		}
+
+		// Steps, packed back from the bitplanes. The bits the planes don't hold stay as in the template
+		pattern.planes.toStepBytes(out + AccentSteps);
+
+		// Parameters
+		out[Tempo] = pattern.tempo;
+		out[Swing] = pattern.swing;
+		out[Probability] = pattern.probability;
+		out[FlamLevel] = pattern.flamLevel;
+		out[FilterMode] = pattern.filterMode;
+		out[FilterEnable] = pattern.filterOnOff ? 1 : 0;
+		out[FilterAutomation] = pattern.filterAutomationOnOff ? 1 : 0;
+		memcpy(out + FilterSteps, pattern.filterSteps.data(), pattern.filterSteps.size());
+		out[PolymeterOnOff] = pattern.polymeterOnOff ? 1 : 0;
+		out[StepSize] = pattern.stepSize;
+		out[AutoAdvance] = pattern.autoAdvanceOnOff ? 1 : 0;
+	}
+
+	void RD8Pattern::decodePatternParameters(uint8 const *patternData, PatternData &out)
+	{
+		out.tempo = patternData[Tempo];
+		out.swing = patternData[Swing];
+		out.probability = patternData[Probability];
+		out.flamLevel = patternData[FlamLevel];
+		out.filterMode = patternData[FilterMode];
+		jassert(patternData[FilterEnable] == 0 || patternData[FilterEnable] == 1); // Assuming this is a bool
+		out.filterOnOff = patternData[FilterEnable] != 0;
+		jassert(patternData[FilterAutomation] == 0 || patternData[FilterAutomation] == 1); // Assuming this is a bool
+		out.filterAutomationOnOff = patternData[FilterAutomation] != 0;
+		memcpy(out.filterSteps.data(), patternData + FilterSteps, out.filterSteps.size());
+		jassert(patternData[PolymeterOnOff] == 0 || patternData[PolymeterOnOff] == 1); // Assuming this is a bool
+		out.polymeterOnOff = patternData[PolymeterOnOff] != 0;
+		out.stepSize = patternData[StepSize];
+		jassert(patternData[AutoAdvance] == 0 || patternData[AutoAdvance] == 1); // Assuming this is a bool
+		out.autoAdvanceOnOff = patternData[AutoAdvance] != 0;
+	}
+
+	RD8Pattern::StepData::StepData(uint8 stepByte) : stepByte(stepByte)
+	{
+	}
+
 	bool RD8Pattern::StepData::isOn()
 	{
-		return stepOnOff;
+		return stepOnOff();
+	}
+
+	bool RD8Pattern::StepData::stepOnOff() const
+	{
+		return (stepByte & STEP_BYTE_MASK_ON_OFF_BIT) != 0;
+	}
+
+	bool RD8Pattern::StepData::probabilityOnOff() const
+	{
+		return (stepByte & STEP_BYTE_MASK_PROBABILITY_BIT) != 0;
+	}
+
+	bool RD8Pattern::StepData::flamOnOff() const
+	{
+		return (stepByte & STEP_BYTE_MASK_FLAM_BIT) != 0;
+	}
+
+	bool RD8Pattern::StepData::repeatOnOff() const
+	{
+		return (stepByte & STEP_BYTE_MASK_NOTE_REPEAT_ON_OFF_BIT) != 0;
+	}
+
+	uint8 RD8Pattern::StepData::repeat() const
+	{
+		return (stepByte & STEP_BYTE_MASK_NOTE_REPEAT) >> 5;
 	}
 
 	int RD8Pattern::PatternData::numberOfTracks() const
 	{
-		return 12;
+		return kNumberOfTracks;
 	}
 
 	std::vector<std::string> RD8Pattern::PatternData::trackNames() const
@@ -416,9 +808,25 @@ namespace midikraft {
 
 	std::vector<std::shared_ptr<StepSequencerStep>> RD8Pattern::PatternData::track(int trackNo)
 	{
+		// Adapter for the generic interface. All steps of the track share one allocation, the returned pointers alias into it
+		auto block = std::make_shared<std::array<StepData, kNumberOfSteps>>();
 		std::vector<std::shared_ptr<StepSequencerStep>> result;
-		result.insert(result.end(), tracks[trackNo].begin(), tracks[trackNo].end());
+		result.reserve(kNumberOfSteps);
+		for (int step = 0; step < kNumberOfSteps; step++) {
+			(*block)[step] = this->step(trackNo, step);
+			result.push_back(std::shared_ptr<StepSequencerStep>(block, &(*block)[step]));
+		}
 		return result;
 	}
 
+	uint8 RD8Pattern::PatternData::stepByte(int trackNo, int stepNo) const
+	{
+		return planes.stepByte(trackNo, stepNo);
+	}
+
+	RD8Pattern::StepData RD8Pattern::PatternData::step(int trackNo, int stepNo) const
+	{
+		return StepData(stepByte(trackNo, stepNo));
+	}
+
 }
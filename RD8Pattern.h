@@ -4,6 +4,10 @@
 #include "Patch.h"
 
 #include "StepSequencer.h"
+#include "RD8StepPlanes.h"
+
+#include <array>
+#include <string_view>
 
 namespace midikraft {
 
@@ -14,8 +18,18 @@ namespace midikraft {
 		RD8DataFile(BehringerRD8 const *rd8, int dataTypeID, uint8 midiFileType);		
 
 		bool isDataDump(const MidiMessage & message) const;
+		bool isDataDump(uint8 const *sysexData, size_t size) const;
+
+		// Parses the first data dump of the messages, via dataFromSysexData
+		virtual bool dataFromSysex(const std::vector<MidiMessage> &messages) override;
+
+		// Parse directly from the sysex data (without F0 and F7) of a single message, e.g. a span into a file buffer
+		virtual bool dataFromSysexData(uint8 const *sysexData, size_t size) = 0;
 
 	protected:
+		void setDataFromSysexData(uint8 const *sysexData, size_t size); // Range based setData
+		void recordDecodeTime(int64 startedAtMicroseconds) const; // Into the decode time histogram of our data type
+
 		std::vector<uint8> unescapeSysex(const std::vector<uint8> &input) const;
 		std::vector<juce::uint8> escapeSysex(const std::vector<uint8> &input) const;
 
@@ -27,15 +41,24 @@ namespace midikraft {
 	public:
 		using RD8DataFile::RD8DataFile;
 
+		static constexpr int kNumberOfTracks = 12;
+		static constexpr int kNumberOfSteps = 64;
+		static constexpr size_t kPatternDataSize = 889; // Unescaped size of the pattern data, data version 0
+
+		// A step is a view on the single step byte as stored in the device, decoded on access
 		class StepData : public StepSequencerStep {
 		public:
+			explicit StepData(uint8 stepByte = 0);
+
 			virtual bool isOn() override;
 
-			bool stepOnOff;
-			bool probabilityOnOff;
-			bool flamOnOff;
-			bool repeatOnOff;
-			uint8 repeat;
+			bool stepOnOff() const;
+			bool probabilityOnOff() const;
+			bool flamOnOff() const;
+			bool repeatOnOff() const;
+			uint8 repeat() const;
+
+			uint8 stepByte;
 		};
 
 		class PatternData : public StepSequencerPattern {
@@ -44,8 +67,12 @@ namespace midikraft {
 			virtual std::vector<std::string> trackNames() const override;
 			virtual std::vector<std::shared_ptr<StepSequencerStep>> track(int trackNo) override;
 
-			// Notes
-			std::vector<std::vector<std::shared_ptr<StepData>>> tracks;
+			// Allocation free step access
+			uint8 stepByte(int trackNo, int stepNo) const;
+			StepData step(int trackNo, int stepNo) const;
+
+			// Notes, stored as bitplanes per track, see RD8StepPlanes for density and similarity queries
+			RD8StepPlanes planes;
 
 			// Settings
 			uint8 tempo;
@@ -55,7 +82,7 @@ namespace midikraft {
 			uint8 filterMode; // 0 == LPF, 1 == HPF
 			bool filterOnOff;
 			bool filterAutomationOnOff;
-			std::vector<uint8> filterSteps;
+			std::array<uint8, kNumberOfSteps> filterSteps;
 			bool polymeterOnOff;
 			uint8 stepSize;
 			bool autoAdvanceOnOff;
@@ -63,7 +90,64 @@ namespace midikraft {
 		
 		std::shared_ptr<RD8Pattern::PatternData> getPattern() const;
 
+		// Decode into an existing PatternData without any heap allocation, e.g. to reuse one object for a whole library
+		bool getPattern(PatternData &out) const;
+		static bool decodePatternData(uint8 const *patternData, size_t size, PatternData &out);
+
+		// The reverse, into kPatternDataSize bytes. The bytes PatternData does not describe (data version, product variant, the 13
+		// bytes after the steps, random, FX sends) are copied from the template, e.g. the data the pattern was decoded from.
+		// Without a template they are 0, except for the data version 0 and product variant 0x08 the decoder expects
+		static void encodePatternData(PatternData const &pattern, uint8 const *templateData, uint8 *out);
+
+		// The unescaped pattern data, out must hold kPatternDataSize bytes
+		bool getPatternData(uint8 *out) const;
+
+		// Lazy access for callers that need only a few fields, e.g. list views. The payload is unescaped on first use and kept,
+		// and each call decodes only the field asked for. Invalid data reads as 0
+		uint8 tempo() const;
+		uint8 swing() const;
+		uint8 probability() const;
+		uint8 flamLevel() const;
+		uint8 stepSize() const;
+		bool polymeterOnOff() const;
+		uint8 stepByte(int trackNo, int stepNo) const;
+		uint64 trackOnOff(int trackNo) const; // Bit n is step n
+		int numberOfActiveSteps(int trackNo) const;
+		int numberOfActiveSteps() const; // Summed over all tracks
+
+		// What differs between two versions of the pattern data, found by comparing them word by word
+		struct PatternChanges {
+			uint16 changedTracks = 0; // Bit n is set if a step of track n differs
+			bool parametersChanged = false; // Tempo, swing, filter and the other pattern parameters
+			bool otherChanged = false; // Bytes that are not decoded into PatternData
+
+			bool any() const;
+		};
+		static PatternChanges diffPatternData(uint8 const *previous, uint8 const *current);
+
+		// Decode only the changed parts of the current pattern data into a PatternData that holds the previous version
+		static void applyPatternChanges(uint8 const *current, PatternChanges const &changes, PatternData &inOut);
+
+		// Where a byte of the unescaped pattern data belongs
+		struct FieldLocation {
+			enum Field { Step, Parameter, FilterStep, Other } field;
+			int trackNo; // For steps
+			int stepNo; // For steps and filter steps
+			char const *name; // Parameter name, or a description of the other bytes
+		};
+		static FieldLocation fieldAt(size_t index);
+
 	protected:
+		// Offset of the escaped pattern data within the sysex data of this file
+		virtual size_t payloadOffset() const = 0;
+
+		static void decodePatternParameters(uint8 const *patternData, PatternData &out);
+
+		// The unescaped payload, cached on first use. Call invalidatePatternData() when the data of the file changes
+		std::shared_ptr<std::array<uint8, kPatternDataSize> const> cachedPatternData() const;
+		void invalidatePatternData();
+		uint8 cachedByte(size_t index) const;
+
 		enum SysexIndex {
 			// Pattern data
 			PatternDataVersion = 0,
@@ -111,6 +195,9 @@ namespace midikraft {
 			STEP_BYTE_MASK_NOTE_REPEAT_ON_OFF_BIT = 1 << 4,
 			STEP_BYTE_MASK_NOTE_REPEAT = 3 << 5
 		};
+
+	private:
+		mutable std::shared_ptr<std::array<uint8, kPatternDataSize> const> patternData_; // Accessed with atomic_load/atomic_store
 	};
 
 	class RD8LivePattern : public RD8Pattern {
@@ -119,8 +206,11 @@ namespace midikraft {
 
 		virtual std::string name() const override;
 
-		virtual bool dataFromSysex(const std::vector<MidiMessage> &message) override;
+		virtual bool dataFromSysexData(uint8 const *sysexData, size_t size) override;
 		virtual std::vector<MidiMessage> dataToSysex() const override;
+
+	protected:
+		virtual size_t payloadOffset() const override;
 	};
 
 	class RD8StoredPattern : public RD8Pattern {
@@ -129,9 +219,14 @@ namespace midikraft {
 
 		virtual std::string name() const override;
 
-		virtual bool dataFromSysex(const std::vector<MidiMessage> &message) override;
+		virtual bool dataFromSysexData(uint8 const *sysexData, size_t size) override;
 		virtual std::vector<MidiMessage> dataToSysex() const override;
 
+		int itemNo() const; // songNo * 16 + patternNo, as used by requestDataItem
+
+	protected:
+		virtual size_t payloadOffset() const override;
+
 	private:
 		uint8 songNo;
 		uint8 patternNo;
@@ -141,6 +236,42 @@ namespace midikraft {
 	class RD8Song : public RD8DataFile {
 	public:
 		using RD8DataFile::RD8DataFile;
+
+		static constexpr int kMaxChainLength = 64;
+
+		// The song format is not documented, and the layout in SongIndex has not been checked against dumps of a device.
+		// Until it is, songs are only decoded if the caller asks for the unverified layout, and the result is a best guess
+		static constexpr bool kSongLayoutVerified = false;
+		enum class Layout { VerifiedOnly, AllowUnverified };
+
+		// A step of the pattern chain of a song
+		struct PatternReference {
+			uint8 songNo;
+			uint8 patternNo;
+
+			int itemNo() const; // songNo * 16 + patternNo, as for the stored patterns
+		};
+
+		class SongData {
+		public:
+			std::vector<PatternReference> chain; // In playing order
+		};
+
+		// Both fail for Layout::VerifiedOnly as long as kSongLayoutVerified is false
+		std::shared_ptr<SongData> getSong(Layout layout = Layout::VerifiedOnly) const;
+		bool getSong(SongData &out, Layout layout = Layout::VerifiedOnly) const; // Unescapes the payload once
+		static bool decodeSongData(uint8 const *songData, size_t size, SongData &out);
+
+	protected:
+		// Offset of the escaped song data within the sysex data of this file
+		virtual size_t payloadOffset() const = 0;
+
+		// Assumed, see kSongLayoutVerified: the chain length, followed by one byte per chain step with the song number
+		// in the high and the pattern number in the low nibble
+		enum SongIndex {
+			ChainLength = 0,
+			Chain = 1
+		};
 	};
 
 	class RD8StoredSong : public RD8Song {
@@ -149,9 +280,12 @@ namespace midikraft {
 
 		virtual std::string name() const override;
 
-		virtual bool dataFromSysex(const std::vector<MidiMessage> &message) override;
+		virtual bool dataFromSysexData(uint8 const *sysexData, size_t size) override;
 		virtual std::vector<MidiMessage> dataToSysex() const override;
 
+	protected:
+		virtual size_t payloadOffset() const override;
+
 	private:
 		uint8 songNo;
 	};
@@ -162,8 +296,11 @@ namespace midikraft {
 
 		virtual std::string name() const override;
 
-		virtual bool dataFromSysex(const std::vector<MidiMessage> &message) override;
+		virtual bool dataFromSysexData(uint8 const *sysexData, size_t size) override;
 		virtual std::vector<MidiMessage> dataToSysex() const override;
+
+	protected:
+		virtual size_t payloadOffset() const override;
 	};
 
 	class RD8GlobalSettings : public RD8DataFile {
@@ -172,15 +309,48 @@ namespace midikraft {
 
 		virtual std::string name() const override;
 
-		virtual bool dataFromSysex(const std::vector<MidiMessage> &message) override;
+		virtual bool dataFromSysexData(uint8 const *sysexData, size_t size) override;
 		virtual std::vector<MidiMessage> dataToSysex() const override;
 
 		// high level access
 		TypedNamedValueSet globalSettings() const;
 
-		// low level access
-		bool pokeSetting(std::string const &settingName, uint8 newValue);
-		uint8 peekSetting(std::string const &settingName) const;
+		// The settings in the order of kGlobalSettingsDefinition
+		enum Setting {
+			DeviceID, ClockSource, AnalogClockMode,
+			MidiRxChannel, MidiTxChannel, MidiToUsbThrough, MidiSoftThrough, UsbRxChannel, UsbTxChannel, UsbToMidiThrough,
+			BassDrumNote, SnareDrumNote, LowTomNote, MidTomNote, HighTomNote, RimShotNote, HandClapNote, CowBellNote, CymbalNote, OpenHatNote, ClosedHatNote,
+			SongChainMode,
+			TempoPreference, SwingPreference, ProbabilityPreference, FlamPreference, FilterModePreference, FilterEnablePreference, FilterAutomationPreference,
+			PolymeterPreference, StepSizePreference, AutoAdvancePreference, AutoScrollPreference, FXBusPreference, MutePreference, SoloPreference,
+			GlobalTempo, GlobalSwing, GlobalProbability, GlobalFlam, GlobalFilterMode, GlobalFilterEnable, GlobalFilterAutomation, GlobalFilterSteps,
+			GlobalPolymeter, GlobalStepSize, GlobalAutoAdvance, GlobalAutoScroll,
+			NumberOfSettings
+		};
+
+		// low level access, typed with constant time lookup
+		bool poke(Setting setting, uint8 newValue);
+		uint8 peek(Setting setting) const;
+		static Setting settingFromName(std::string_view settingName); // NumberOfSettings if the name is unknown
+		static char const *settingName(Setting setting);
+		static Setting settingAt(int dataIndex, int &outElement); // The setting stored at a byte of the data, element is the filter step for Global Filter Steps
+
+		// low level access by name, as used by the ValueTree
+		bool pokeSetting(std::string_view settingName, uint8 newValue);
+		uint8 peekSetting(std::string_view settingName) const;
+
+		// Position, valid range and presentation of a setting, indexed by Setting
+		enum Kind { Number, Flag, Choice };
+		struct SettingLayout {
+			int index;
+			char const *name;
+			char const *section;
+			Kind kind;
+			int minValue;
+			int maxValue;
+			char const * const *valueNames = nullptr; // For a Choice, the names of the values from minValue to maxValue
+		};
+		static const SettingLayout kSettingsLayout[NumberOfSettings];
 
 	private:
 		struct ValueDefinition {
@@ -189,7 +359,7 @@ namespace midikraft {
 		};
 
 		TypedNamedValueSet globalSettings_;
-		static std::vector<ValueDefinition> kGlobalSettingsDefinition;
+		static std::vector<ValueDefinition> const kGlobalSettingsDefinition; // Generated from kSettingsLayout
 	};
 
 }
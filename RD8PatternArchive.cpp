@@ -0,0 +1,277 @@
+#include "RD8PatternArchive.h"
+
+namespace midikraft {
+
+	namespace {
+		struct ArchiveHeader {
+			char magic[4];
+			uint32 version;
+			uint32 byteOrder; // kByteOrderMark as written by the host, the columns are in its byte order
+			uint32 reserved;
+			uint64 numberOfPatterns;
+			uint64 columnOffsets[RD8PatternArchive::NumberOfColumns]; // From the start of the file, 8 byte aligned
+		};
+		const char kArchiveMagic[4] = { 'R', 'D', '8', 'A' };
+		const uint32 kArchiveVersion = 2;
+		const uint32 kByteOrderMark = 0x01020304;
+
+		enum FlagBits {
+			FLAG_FILTER_ON_OFF = 1 << 0,
+			FLAG_FILTER_AUTOMATION = 1 << 1,
+			FLAG_POLYMETER = 1 << 2,
+			FLAG_AUTO_ADVANCE = 1 << 3
+		};
+
+		size_t bytesPerRow(int column)
+		{
+			if (column <= RD8PatternArchive::RepeatHi) {
+				return RD8Pattern::kNumberOfTracks * sizeof(uint64);
+			}
+			if (column == RD8PatternArchive::FilterSteps) {
+				return RD8Pattern::kNumberOfSteps;
+			}
+			return 1;
+		}
+
+		RD8StepPlanes::Plane const &plane(RD8StepPlanes const &planes, int column)
+		{
+			switch (column) {
+			case RD8PatternArchive::OnOff: return planes.onOff;
+			case RD8PatternArchive::StepProbability: return planes.probability;
+			case RD8PatternArchive::Flam: return planes.flam;
+			case RD8PatternArchive::RepeatOnOff: return planes.repeatOnOff;
+			case RD8PatternArchive::RepeatLo: return planes.repeatLo;
+			default:
+				jassert(column == RD8PatternArchive::RepeatHi);
+				return planes.repeatHi;
+			}
+		}
+
+		uint8 byteField(RD8Pattern::PatternData const &pattern, int column)
+		{
+			switch (column) {
+			case RD8PatternArchive::Tempo: return pattern.tempo;
+			case RD8PatternArchive::Swing: return pattern.swing;
+			case RD8PatternArchive::Probability: return pattern.probability;
+			case RD8PatternArchive::FlamLevel: return pattern.flamLevel;
+			case RD8PatternArchive::FilterMode: return pattern.filterMode;
+			case RD8PatternArchive::StepSize: return pattern.stepSize;
+			default:
+				jassert(column == RD8PatternArchive::Flags);
+				return (uint8) ((pattern.filterOnOff ? FLAG_FILTER_ON_OFF : 0) | (pattern.filterAutomationOnOff ? FLAG_FILTER_AUTOMATION : 0)
+					| (pattern.polymeterOnOff ? FLAG_POLYMETER : 0) | (pattern.autoAdvanceOnOff ? FLAG_AUTO_ADVANCE : 0));
+			}
+		}
+	}
+
+	void RD8PatternArchive::Writer::add(RD8Pattern::PatternData const &pattern)
+	{
+		patterns_.push_back(pattern);
+	}
+
+	bool RD8PatternArchive::Writer::add(uint8 const *patternData, size_t size)
+	{
+		RD8Pattern::PatternData pattern;
+		if (!RD8Pattern::decodePatternData(patternData, size, pattern)) {
+			return false;
+		}
+		patterns_.push_back(pattern);
+		return true;
+	}
+
+	size_t RD8PatternArchive::Writer::numberOfPatterns() const
+	{
+		return patterns_.size();
+	}
+
+	bool RD8PatternArchive::Writer::writeTo(File const &file) const
+	{
+		// Lay out the columns one after the other
+		size_t n = patterns_.size();
+		ArchiveHeader header;
+		memcpy(header.magic, kArchiveMagic, 4);
+		header.version = kArchiveVersion;
+		header.byteOrder = kByteOrderMark;
+		header.reserved = 0;
+		header.numberOfPatterns = n;
+		size_t position = sizeof(ArchiveHeader);
+		for (int column = 0; column < NumberOfColumns; column++) {
+			position = (position + 7) & ~(size_t) 7;
+			header.columnOffsets[column] = position;
+			position += n * bytesPerRow(column);
+		}
+
+		std::vector<uint8> buffer(position, 0);
+		memcpy(buffer.data(), &header, sizeof(header));
+		for (int column = 0; column < NumberOfColumns; column++) {
+			uint8 *out = buffer.data() + header.columnOffsets[column];
+			for (size_t row = 0; row < n; row++) {
+				auto const &pattern = patterns_[row];
+				if (column <= RepeatHi) {
+					memcpy(out + row * bytesPerRow(column), plane(pattern.planes, column).data(), bytesPerRow(column));
+				}
+				else if (column == FilterSteps) {
+					memcpy(out + row * bytesPerRow(column), pattern.filterSteps.data(), bytesPerRow(column));
+				}
+				else {
+					out[row] = byteField(pattern, column);
+				}
+			}
+		}
+		return file.replaceWithData(buffer.data(), buffer.size());
+	}
+
+	bool RD8PatternArchive::open(File const &file)
+	{
+		close();
+		auto mapped = std::make_unique<MemoryMappedFile>(file, MemoryMappedFile::readOnly);
+		auto data = static_cast<uint8 const *>(mapped->getData());
+		if (data == nullptr || mapped->getSize() < sizeof(ArchiveHeader)) {
+			return false;
+		}
+
+		// Only the header is checked, nothing is parsed
+		ArchiveHeader header;
+		memcpy(&header, data, sizeof(header));
+		if (memcmp(header.magic, kArchiveMagic, 4) != 0 || header.byteOrder != kByteOrderMark || header.version != kArchiveVersion) {
+			// The columns are used in place, so an archive written on a host with the other byte order can't be opened
+			return false;
+		}
+		size_t size = mapped->getSize();
+		for (int column = 0; column < NumberOfColumns; column++) {
+			// Checked by division, as the multiplication could overflow with a corrupt header
+			uint64 offset = header.columnOffsets[column];
+			if (offset % 8 != 0 || offset > size || header.numberOfPatterns > (size - offset) / bytesPerRow(column)) {
+				return false;
+			}
+			columns_[(size_t) column] = data + header.columnOffsets[column];
+		}
+		numberOfPatterns_ = (size_t) header.numberOfPatterns;
+		mapped_ = std::move(mapped);
+		return true;
+	}
+
+	void RD8PatternArchive::close()
+	{
+		mapped_.reset();
+		numberOfPatterns_ = 0;
+		columns_.fill(nullptr);
+	}
+
+	size_t RD8PatternArchive::numberOfPatterns() const
+	{
+		return numberOfPatterns_;
+	}
+
+	RD8PatternArchive::Row RD8PatternArchive::row(size_t rowNo) const
+	{
+		jassert(rowNo < numberOfPatterns_);
+		return Row(*this, rowNo);
+	}
+
+	uint64 const * RD8PatternArchive::planeColumn(Column column) const
+	{
+		jassert(column <= RepeatHi);
+		return reinterpret_cast<uint64 const *>(columns_[(size_t) column]);
+	}
+
+	uint8 const * RD8PatternArchive::byteColumn(Column column) const
+	{
+		jassert(column > RepeatHi);
+		return columns_[(size_t) column];
+	}
+
+	RD8PatternArchive::Row::Row(RD8PatternArchive const &archive, size_t rowNo) : archive_(archive), rowNo_(rowNo)
+	{
+	}
+
+	uint64 RD8PatternArchive::Row::onOff(int trackNo) const
+	{
+		return archive_.planeColumn(OnOff)[rowNo_ * RD8Pattern::kNumberOfTracks + (size_t) trackNo];
+	}
+
+	uint8 RD8PatternArchive::Row::tempo() const
+	{
+		return archive_.byteColumn(Tempo)[rowNo_];
+	}
+
+	uint8 RD8PatternArchive::Row::swing() const
+	{
+		return archive_.byteColumn(Swing)[rowNo_];
+	}
+
+	uint8 RD8PatternArchive::Row::probability() const
+	{
+		return archive_.byteColumn(Probability)[rowNo_];
+	}
+
+	uint8 RD8PatternArchive::Row::flamLevel() const
+	{
+		return archive_.byteColumn(FlamLevel)[rowNo_];
+	}
+
+	uint8 RD8PatternArchive::Row::filterMode() const
+	{
+		return archive_.byteColumn(FilterMode)[rowNo_];
+	}
+
+	uint8 RD8PatternArchive::Row::flags() const
+	{
+		return archive_.byteColumn(Flags)[rowNo_];
+	}
+
+	bool RD8PatternArchive::Row::filterOnOff() const
+	{
+		return (flags() & FLAG_FILTER_ON_OFF) != 0;
+	}
+
+	bool RD8PatternArchive::Row::filterAutomationOnOff() const
+	{
+		return (flags() & FLAG_FILTER_AUTOMATION) != 0;
+	}
+
+	bool RD8PatternArchive::Row::polymeterOnOff() const
+	{
+		return (flags() & FLAG_POLYMETER) != 0;
+	}
+
+	uint8 RD8PatternArchive::Row::stepSize() const
+	{
+		return archive_.byteColumn(StepSize)[rowNo_];
+	}
+
+	bool RD8PatternArchive::Row::autoAdvanceOnOff() const
+	{
+		return (flags() & FLAG_AUTO_ADVANCE) != 0;
+	}
+
+	uint8 const * RD8PatternArchive::Row::filterSteps() const
+	{
+		return archive_.byteColumn(FilterSteps) + rowNo_ * RD8Pattern::kNumberOfSteps;
+	}
+
+	void RD8PatternArchive::Row::getPattern(RD8Pattern::PatternData &out) const
+	{
+		auto planeRow = [this](Column column, RD8StepPlanes::Plane &plane) {
+			memcpy(plane.data(), archive_.planeColumn(column) + rowNo_ * RD8Pattern::kNumberOfTracks, sizeof(RD8StepPlanes::Plane));
+		};
+		planeRow(OnOff, out.planes.onOff);
+		planeRow(StepProbability, out.planes.probability);
+		planeRow(Flam, out.planes.flam);
+		planeRow(RepeatOnOff, out.planes.repeatOnOff);
+		planeRow(RepeatLo, out.planes.repeatLo);
+		planeRow(RepeatHi, out.planes.repeatHi);
+		out.tempo = tempo();
+		out.swing = swing();
+		out.probability = probability();
+		out.flamLevel = flamLevel();
+		out.filterMode = filterMode();
+		out.filterOnOff = filterOnOff();
+		out.filterAutomationOnOff = filterAutomationOnOff();
+		memcpy(out.filterSteps.data(), filterSteps(), out.filterSteps.size());
+		out.polymeterOnOff = polymeterOnOff();
+		out.stepSize = stepSize();
+		out.autoAdvanceOnOff = autoAdvanceOnOff();
+	}
+
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "RD8Pattern.h"
+
+namespace midikraft {
+
+	// A binary archive of decoded patterns, stored column by column: the step bitplanes, the pattern parameters and the filter steps
+	// each in their own array. Opening an archive maps the file and checks the header, the rows are only read when accessed,
+	// so the time to open does not depend on the number of patterns. The columns are in the byte order of the host that wrote
+	// the archive, which is recorded in the header, and open() rejects archives from a host with the other byte order.
+	class RD8PatternArchive {
+	public:
+		enum Column {
+			OnOff, StepProbability, Flam, RepeatOnOff, RepeatLo, RepeatHi, // 12 uint64 per row
+			Tempo, Swing, Probability, FlamLevel, FilterMode, StepSize, Flags, // 1 byte per row
+			FilterSteps, // 64 bytes per row
+			NumberOfColumns
+		};
+
+		// Collects patterns and writes the archive
+		class Writer {
+		public:
+			void add(RD8Pattern::PatternData const &pattern);
+			bool add(uint8 const *patternData, size_t size); // Unescaped pattern data as in RD8Pattern::SysexIndex
+			size_t numberOfPatterns() const;
+			bool writeTo(File const &file) const;
+
+		private:
+			std::vector<RD8Pattern::PatternData> patterns_;
+		};
+
+		// A view of one row that reads the fields from the mapped file on access
+		class Row {
+		public:
+			Row(RD8PatternArchive const &archive, size_t rowNo);
+
+			uint64 onOff(int trackNo) const;
+			uint8 tempo() const;
+			uint8 swing() const;
+			uint8 probability() const;
+			uint8 flamLevel() const;
+			uint8 filterMode() const;
+			bool filterOnOff() const;
+			bool filterAutomationOnOff() const;
+			bool polymeterOnOff() const;
+			uint8 stepSize() const;
+			bool autoAdvanceOnOff() const;
+			uint8 const *filterSteps() const; // 64 bytes
+
+			// Decode the complete row
+			void getPattern(RD8Pattern::PatternData &out) const;
+
+		private:
+			uint8 flags() const;
+
+			RD8PatternArchive const &archive_;
+			size_t rowNo_;
+		};
+
+		bool open(File const &file);
+		void close();
+
+		size_t numberOfPatterns() const;
+		Row row(size_t rowNo) const;
+
+		// Direct access to a column for scans over all patterns, e.g. onOff is numberOfPatterns() * 12 words
+		uint64 const *planeColumn(Column column) const;
+		uint8 const *byteColumn(Column column) const;
+
+	private:
+		std::unique_ptr<MemoryMappedFile> mapped_;
+		size_t numberOfPatterns_ = 0;
+		std::array<uint8 const *, NumberOfColumns> columns_ {};
+	};
+
+}
@@ -0,0 +1,66 @@
+#include "RD8PatternCache.h"
+
+namespace midikraft {
+
+	void RD8PatternCache::set(int itemNo, std::shared_ptr<RD8Pattern::PatternData const> pattern)
+	{
+		if (itemNo < 0 || itemNo >= kNumberOfItems) {
+			jassertfalse;
+			return;
+		}
+		patterns_[(size_t) itemNo] = pattern;
+	}
+
+	bool RD8PatternCache::add(RD8StoredPattern const &storedPattern)
+	{
+		auto pattern = storedPattern.getPattern();
+		if (!pattern) {
+			return false;
+		}
+		set(storedPattern.itemNo(), pattern);
+		return true;
+	}
+
+	int RD8PatternCache::addAll(std::vector<std::shared_ptr<DataFile>> const &dataFiles)
+	{
+		int added = 0;
+		for (auto const &dataFile : dataFiles) {
+			auto storedPattern = std::dynamic_pointer_cast<RD8StoredPattern>(dataFile);
+			if (storedPattern && add(*storedPattern)) {
+				added++;
+			}
+		}
+		return added;
+	}
+
+	void RD8PatternCache::clear()
+	{
+		for (auto &pattern : patterns_) {
+			pattern.reset();
+		}
+	}
+
+	std::shared_ptr<RD8Pattern::PatternData const> RD8PatternCache::get(int itemNo) const
+	{
+		if (itemNo < 0 || itemNo >= kNumberOfItems) {
+			return nullptr;
+		}
+		return patterns_[(size_t) itemNo];
+	}
+
+	std::vector<RD8Pattern::PatternData const *> RD8PatternCache::resolve(RD8Song::SongData const &song, int &outMissing) const
+	{
+		std::vector<RD8Pattern::PatternData const *> result;
+		result.reserve(song.chain.size());
+		outMissing = 0;
+		for (auto const &reference : song.chain) {
+			auto pattern = get(reference.itemNo()).get();
+			if (!pattern) {
+				outMissing++;
+			}
+			result.push_back(pattern);
+		}
+		return result;
+	}
+
+}
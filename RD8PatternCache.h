@@ -0,0 +1,28 @@
+#pragma once
+
+#include "RD8Pattern.h"
+
+namespace midikraft {
+
+	// The decoded stored patterns of a device, each decoded once and shared. Songs are resolved against the cache into pattern
+	// pointers, so all songs referring to a pattern use the same decoded data.
+	// Fill the cache first, after that it can be read from any number of threads.
+	class RD8PatternCache {
+	public:
+		static constexpr int kNumberOfItems = 256; // 16 songs with 16 patterns
+
+		void set(int itemNo, std::shared_ptr<RD8Pattern::PatternData const> pattern);
+		bool add(RD8StoredPattern const &storedPattern);
+		int addAll(std::vector<std::shared_ptr<DataFile>> const &dataFiles); // Returns the number of stored patterns added
+		void clear();
+
+		std::shared_ptr<RD8Pattern::PatternData const> get(int itemNo) const;
+
+		// One entry per chain step, nullptr for patterns not in the cache. The pointers stay valid as long as the cache is unchanged
+		std::vector<RD8Pattern::PatternData const *> resolve(RD8Song::SongData const &song, int &outMissing) const;
+
+	private:
+		std::array<std::shared_ptr<RD8Pattern::PatternData const>, kNumberOfItems> patterns_;
+	};
+
+}
@@ -0,0 +1,68 @@
+#include "RD8PatternEncoder.h"
+
+#include "RD8.h"
+#include "RD8SysexCodec.h"
+
+namespace midikraft {
+
+	RD8PatternEncoder::RD8PatternEncoder(BehringerRD8 const *rd8) : rd8_(rd8)
+	{
+	}
+
+	size_t RD8PatternEncoder::storedPatternSysexSize()
+	{
+		return BehringerRD8::kRequestHeaderSize + 2 + RD8SysexCodec::escapedSize(RD8Pattern::kPatternDataSize);
+	}
+
+	size_t RD8PatternEncoder::livePatternSysexSize()
+	{
+		return BehringerRD8::kRequestHeaderSize + RD8SysexCodec::escapedSize(RD8Pattern::kPatternDataSize);
+	}
+
+	size_t RD8PatternEncoder::encode(RD8Pattern::PatternData const &pattern, uint8 messageID, uint8 const *slotBytes, size_t numberOfSlotBytes,
+		std::vector<uint8> &buffer, uint8 const *templateData) const
+	{
+		size_t size = BehringerRD8::kRequestHeaderSize + numberOfSlotBytes + RD8SysexCodec::escapedSize(RD8Pattern::kPatternDataSize);
+		if (buffer.size() < size) {
+			buffer.resize(size);
+		}
+		uint8 *out = buffer.data();
+		out += rd8_->writeRequestHeader(BehringerRD8::MessageID({ RD8_DATA_MESSAGE, messageID }), out);
+		for (size_t i = 0; i < numberOfSlotBytes; i++) {
+			*out++ = slotBytes[i];
+		}
+
+		std::array<uint8, RD8Pattern::kPatternDataSize> patternData;
+		RD8Pattern::encodePatternData(pattern, templateData, patternData.data());
+		RD8SysexCodec::escape(patternData.data(), patternData.size(), out);
+		return size;
+	}
+
+	size_t RD8PatternEncoder::encodeStoredPattern(RD8Pattern::PatternData const &pattern, int itemNo, std::vector<uint8> &buffer, uint8 const *templateData) const
+	{
+		jassert(itemNo >= 0 && itemNo < 256);
+		uint8 slotBytes[2] = { (uint8) (itemNo / 16), (uint8) (itemNo % 16) };
+		return encode(pattern, RD8_STORED_PATTERN_RESPONSE, slotBytes, 2, buffer, templateData);
+	}
+
+	size_t RD8PatternEncoder::encodeLivePattern(RD8Pattern::PatternData const &pattern, std::vector<uint8> &buffer, uint8 const *templateData) const
+	{
+		return encode(pattern, RD8_LIVE_PATTERN_RESPONSE, nullptr, 0, buffer, templateData);
+	}
+
+	std::vector<MidiMessage> RD8PatternEncoder::storedPatternMessages(std::vector<RD8Pattern::PatternData const *> const &patterns, int firstItemNo,
+		std::vector<uint8 const *> const &templateData) const
+	{
+		jassert(templateData.empty() || templateData.size() == patterns.size());
+		std::vector<MidiMessage> result;
+		result.reserve(patterns.size());
+		std::vector<uint8> buffer(storedPatternSysexSize());
+		for (size_t i = 0; i < patterns.size(); i++) {
+			uint8 const *patternTemplate = i < templateData.size() ? templateData[i] : nullptr;
+			size_t size = encodeStoredPattern(*patterns[i], firstItemNo + (int) i, buffer, patternTemplate);
+			result.push_back(MidiMessage::createSysExMessage(buffer.data(), (int) size));
+		}
+		return result;
+	}
+
+}
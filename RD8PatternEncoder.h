@@ -0,0 +1,36 @@
+#pragma once
+
+#include "RD8Pattern.h"
+
+namespace midikraft {
+
+	class BehringerRD8;
+
+	// Turns PatternData into device ready sysex: packs steps and parameters into the 889 bytes of pattern data, escapes them and
+	// puts the request header in front, all into one caller provided buffer. Nothing is allocated once the buffer has its size.
+	class RD8PatternEncoder {
+	public:
+		explicit RD8PatternEncoder(BehringerRD8 const *rd8);
+
+		// Sizes of the sysex data without F0 and F7
+		static size_t storedPatternSysexSize();
+		static size_t livePatternSysexSize();
+
+		// Both return the number of bytes written to the front of the buffer, which is only grown if it is too small.
+		// The template provides the bytes PatternData does not describe, see RD8Pattern::encodePatternData
+		size_t encodeStoredPattern(RD8Pattern::PatternData const &pattern, int itemNo, std::vector<uint8> &buffer, uint8 const *templateData = nullptr) const;
+		size_t encodeLivePattern(RD8Pattern::PatternData const &pattern, std::vector<uint8> &buffer, uint8 const *templateData = nullptr) const;
+
+		// A batch of dumps for consecutive slots, e.g. all 256 starting from 0. The templates are either empty or one per pattern,
+		// and a nullptr template stands for the defaults of a new pattern
+		std::vector<MidiMessage> storedPatternMessages(std::vector<RD8Pattern::PatternData const *> const &patterns, int firstItemNo,
+			std::vector<uint8 const *> const &templateData = {}) const;
+
+	private:
+		size_t encode(RD8Pattern::PatternData const &pattern, uint8 messageID, uint8 const *slotBytes, size_t numberOfSlotBytes,
+			std::vector<uint8> &buffer, uint8 const *templateData) const;
+
+		BehringerRD8 const *rd8_;
+	};
+
+}
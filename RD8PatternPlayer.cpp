@@ -0,0 +1,177 @@
+#include "RD8PatternPlayer.h"
+
+#include <algorithm>
+
+namespace midikraft {
+
+	RD8PatternPlayer::Playback::Playback(RD8Pattern::PatternData const &pattern) : pattern(pattern), timing(pattern)
+	{
+	}
+
+	RD8PatternPlayer::RD8PatternPlayer(RD8MidiFileExporter::NoteMapping const &noteMapping, RD8MidiFileExporter::Options const &options) :
+		noteMapping_(noteMapping), options_(options), fifo_(kQueueSize), random_(options.randomSeed)
+	{
+	}
+
+	bool RD8PatternPlayer::setPlayback(Playback const &playback)
+	{
+		int start1, size1, start2, size2;
+		fifo_.prepareToWrite(1, start1, size1, start2, size2);
+		if (size1 + size2 < 1) {
+			return false;
+		}
+		queue_[(size_t) (size1 > 0 ? start1 : start2)] = playback;
+		fifo_.finishedWrite(1);
+		return true;
+	}
+
+	void RD8PatternPlayer::prepareToPlay(double sampleRate, MidiBuffer &midiOut)
+	{
+		// processBlock might still be called, e.g. while stopped, so the state it owns is reset by it
+		jassert(!playing_);
+		// A block can't emit more than the events scheduled, and processBlock doesn't schedule more than fit
+		midiOut.ensureSize(kMaxScheduledEvents * kBytesPerMidiEvent);
+		preparedSampleRate_ = sampleRate;
+	}
+
+	void RD8PatternPlayer::setPlaying(bool playing)
+	{
+		playing_ = playing;
+	}
+
+	void RD8PatternPlayer::setTempoOverride(double bpm)
+	{
+		tempoOverride_ = bpm;
+	}
+
+	void RD8PatternPlayer::processBlock(MidiBuffer &midiOut, int numSamples)
+	{
+		double preparedSampleRate = preparedSampleRate_.exchange(0.0);
+		if (preparedSampleRate > 0.0) {
+			sampleRate_ = preparedSampleRate;
+			numScheduled_ = 0;
+			reset();
+		}
+
+		// Take the newest pattern from the queue, if any. Copying it does not allocate
+		int ready = fifo_.getNumReady();
+		if (ready > 0) {
+			int start1, size1, start2, size2;
+			fifo_.prepareToRead(ready, start1, size1, start2, size2);
+			current_ = queue_[(size_t) (size2 > 0 ? start2 + size2 - 1 : start1 + size1 - 1)];
+			fifo_.finishedRead(size1 + size2);
+			hasPattern_ = true;
+		}
+
+		bool playing = playing_;
+		if (!playing || !hasPattern_) {
+			if (wasPlaying_) {
+				allNotesOff(midiOut);
+				reset();
+			}
+			wasPlaying_ = false;
+			return;
+		}
+		wasPlaying_ = true;
+
+		double bpm = tempoOverride_ > 0.0 ? (double) tempoOverride_ : (double) jmax((uint8) 1, current_.pattern.tempo);
+		double samplesPerStep = sampleRate_ * 60.0 / (bpm * jmax(1, current_.timing.stepsPerQuarterNote));
+		double blockEnd = position_ + numSamples;
+		// The grace note of a flam comes before its step, so steps are scheduled that much ahead
+		double lookahead = current_.timing.flamDelay * samplesPerStep;
+		while (nextStepTime_ - lookahead < blockEnd) {
+			scheduleStep(nextStep_, nextStepTime_, samplesPerStep);
+			nextStep_++;
+			nextStepTime_ += samplesPerStep;
+		}
+		emitDue(midiOut, position_, blockEnd);
+		position_ = blockEnd;
+	}
+
+	void RD8PatternPlayer::scheduleStep(int64 step, double stepTime, double samplesPerStep)
+	{
+		RD8MidiFileExporter::Timing::Hit hits[RD8MidiFileExporter::Timing::kMaxHitsPerStep];
+		for (int instrument = 0; instrument < RD8MidiFileExporter::kNumberOfInstruments; instrument++) {
+			uint8 note = noteMapping_[(size_t) instrument];
+			if (note > 127) {
+				continue;
+			}
+			int numberOfHits = current_.timing.hits(current_.pattern, instrument + 1, step, options_, random_, hits);
+			for (int i = 0; i < numberOfHits; i++) {
+				double time = stepTime + hits[i].time * samplesPerStep;
+				if (time >= 0.0) { // As in the exporter, there is no room for a grace note before the very first step
+					schedule(time, note, hits[i].velocity, hits[i].length * samplesPerStep);
+				}
+			}
+		}
+	}
+
+	void RD8PatternPlayer::schedule(double sampleTime, uint8 note, uint8 velocity, double length)
+	{
+		// Note on and off need two slots, drop the note if they are not available
+		if (numScheduled_ + 2 > kMaxScheduledEvents) {
+			jassertfalse;
+			return;
+		}
+		// End a note still sounding at the latest with this one, else its note off would cut this one short
+		bool moved = false;
+		for (int i = 0; i < numScheduled_; i++) {
+			auto &event = scheduled_[(size_t) i];
+			if (event.note == note && event.velocity == 0 && event.sampleTime > sampleTime) {
+				event.sampleTime = sampleTime;
+				moved = true;
+			}
+		}
+		if (moved) {
+			std::make_heap(scheduled_.begin(), scheduled_.begin() + numScheduled_, later);
+		}
+		scheduled_[(size_t) numScheduled_++] = { sampleTime, note, velocity };
+		std::push_heap(scheduled_.begin(), scheduled_.begin() + numScheduled_, later);
+		scheduled_[(size_t) numScheduled_++] = { sampleTime + length, note, 0 };
+		std::push_heap(scheduled_.begin(), scheduled_.begin() + numScheduled_, later);
+	}
+
+	void RD8PatternPlayer::reset()
+	{
+		position_ = 0.0;
+		nextStep_ = 0;
+		nextStepTime_ = 0.0;
+	}
+
+	bool RD8PatternPlayer::later(ScheduledEvent const &a, ScheduledEvent const &b)
+	{
+		// At the same time the note off goes first, so a retriggered note is not cut off by the end of the previous one
+		if (a.sampleTime != b.sampleTime) {
+			return a.sampleTime > b.sampleTime;
+		}
+		return a.velocity > b.velocity;
+	}
+
+	void RD8PatternPlayer::emitDue(MidiBuffer &midiOut, double blockStart, double blockEnd)
+	{
+		// Emit in time order by taking the earliest event off the heap until it is not due in this block
+		while (numScheduled_ > 0 && scheduled_[0].sampleTime < blockEnd) {
+			std::pop_heap(scheduled_.begin(), scheduled_.begin() + numScheduled_, later);
+			numScheduled_--;
+			auto const &event = scheduled_[(size_t) numScheduled_];
+			int offset = jlimit(0, jmax(0, (int) (blockEnd - blockStart) - 1), (int) (event.sampleTime - blockStart));
+			if (event.velocity > 0) {
+				midiOut.addEvent(MidiMessage::noteOn(options_.midiChannel, event.note, event.velocity), offset);
+			}
+			else {
+				midiOut.addEvent(MidiMessage::noteOff(options_.midiChannel, event.note), offset);
+			}
+		}
+	}
+
+	void RD8PatternPlayer::allNotesOff(MidiBuffer &midiOut)
+	{
+		for (int i = 0; i < numScheduled_; i++) {
+			if (scheduled_[(size_t) i].velocity == 0) {
+				midiOut.addEvent(MidiMessage::noteOff(options_.midiChannel, scheduled_[(size_t) i].note), 0);
+			}
+		}
+		numScheduled_ = 0;
+	}
+
+}
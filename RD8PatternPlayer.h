@@ -0,0 +1,79 @@
+#pragma once
+
+#include "RD8MidiFileExporter.h"
+
+namespace midikraft {
+
+	// Plays an RD8 pattern in software, sample accurate, from the block callback of the audio thread.
+	// New patterns from the UI are passed through a wait-free single producer/single consumer queue. processBlock doesn't lock,
+	// and doesn't allocate as long as it writes into the MidiBuffer that was reserved in prepareToPlay.
+	class RD8PatternPlayer {
+	public:
+		struct Playback {
+			RD8Pattern::PatternData pattern;
+			RD8MidiFileExporter::Timing timing; // Loop lengths and step size, the same as in an exported file
+
+			Playback() = default;
+			explicit Playback(RD8Pattern::PatternData const &pattern);
+		};
+
+		// Channel, velocities and probability rendering are taken from the options, like in an exported file
+		RD8PatternPlayer(RD8MidiFileExporter::NoteMapping const &noteMapping, RD8MidiFileExporter::Options const &options);
+
+		// Call from the UI (the single producer). Returns false if the queue is full, i.e. the audio thread is not running
+		bool setPlayback(Playback const &playback);
+
+		// Call while not playing, not from the audio thread. midiOut is the buffer processBlock will write to, it gets room
+		// for the most events one block can produce. The reset of the playback position is done by the next processBlock
+		void prepareToPlay(double sampleRate, MidiBuffer &midiOut);
+
+		// These may be called from any thread
+		void setPlaying(bool playing);
+		void setTempoOverride(double bpm); // 0 to use the tempo of the pattern
+
+		// Call from the audio thread (the single consumer)
+		void processBlock(MidiBuffer &midiOut, int numSamples);
+
+	private:
+		struct ScheduledEvent {
+			double sampleTime;
+			uint8 note;
+			uint8 velocity; // 0 for note off
+		};
+
+		void scheduleStep(int64 step, double stepTime, double samplesPerStep);
+		void schedule(double sampleTime, uint8 note, uint8 velocity, double length);
+		void reset();
+		void emitDue(MidiBuffer &midiOut, double blockStart, double blockEnd);
+		static bool later(ScheduledEvent const &a, ScheduledEvent const &b);
+		void allNotesOff(MidiBuffer &midiOut);
+
+		static constexpr int kQueueSize = 4;
+		static constexpr int kMaxScheduledEvents = 512;
+		static constexpr size_t kBytesPerMidiEvent = sizeof(int32) + sizeof(uint16) + 3; // How MidiBuffer stores a note on or off
+
+		RD8MidiFileExporter::NoteMapping noteMapping_;
+		RD8MidiFileExporter::Options options_;
+
+		// The queue from UI to audio thread
+		AbstractFifo fifo_;
+		std::array<Playback, kQueueSize> queue_;
+
+		// Owned by the audio thread
+		Playback current_;
+		bool hasPattern_ = false;
+		bool wasPlaying_ = false;
+		double sampleRate_ = 44100.0;
+		double position_ = 0.0; // Samples since playback started
+		int64 nextStep_ = 0;
+		double nextStepTime_ = 0.0;
+		std::array<ScheduledEvent, kMaxScheduledEvents> scheduled_; // A heap with the earliest event first
+		int numScheduled_ = 0;
+		Random random_;
+
+		std::atomic<bool> playing_ { false };
+		std::atomic<double> tempoOverride_ { 0.0 };
+		std::atomic<double> preparedSampleRate_ { 0.0 }; // Handed from prepareToPlay to the audio thread, 0 when taken
+	};
+
+}
@@ -0,0 +1,296 @@
+#include "RD8PatternStore.h"
+
+#include "RD8.h"
+#include "RD8Hash.h"
+#include "RD8SysexCodec.h"
+
+namespace midikraft {
+
+	namespace {
+		// The pack file is a sequence of records, each a header followed by the payload.
+		// Both files are written in the byte order of the machine
+		struct PackRecordHeader {
+			char magic[4];
+			uint8 dataTypeID;
+			uint8 reserved[3];
+			uint32 size;
+			uint32 reserved2;
+			uint64 hash;
+		};
+		const char kPackRecordMagic[4] = { 'R', 'D', '8', 'P' };
+
+		struct IndexHeader {
+			char magic[4];
+			uint32 version;
+			uint64 packSizeCovered; // Pack records behind this position are not in the index
+			uint64 numberOfEntries;
+		};
+		const char kIndexMagic[4] = { 'R', 'D', '8', 'I' };
+		const uint32 kIndexVersion = 1;
+
+		// The payload starts after the header and the slot bytes, see RD8StoredPattern and RD8StoredSong
+		bool payloadLayout(int dataTypeID, size_t &outOffset, uint8 &outResponseID)
+		{
+			switch (dataTypeID) {
+			case BehringerRD8::STORED_PATTERN: outOffset = 16; outResponseID = RD8_STORED_PATTERN_RESPONSE; return true;
+			case BehringerRD8::STORED_SONG: outOffset = 15; outResponseID = RD8_STORED_SONG_RESPONSE; return true;
+			default:
+				return false;
+			}
+		}
+	}
+
+	RD8PatternStore::RD8PatternStore(BehringerRD8 const *rd8, File const &packFile) :
+		rd8_(rd8), packFile_(packFile), indexFile_(packFile.withFileExtension(".rd8idx"))
+	{
+	}
+
+	RD8PatternStore::~RD8PatternStore()
+	{
+		flush();
+	}
+
+	RD8PatternStore::ContentHash RD8PatternStore::contentHash(int dataTypeID, uint8 const *payload, size_t size)
+	{
+		// The data type is the seed, so a song and a pattern with the same bytes do not collide
+		return RD8Hash::xxHash64(payload, size, (uint64) dataTypeID);
+	}
+
+	bool RD8PatternStore::open()
+	{
+		ScopedLock lock(lock_);
+		if (!packFile_.existsAsFile() && !packFile_.create()) {
+			return false;
+		}
+		packSize_ = packFile_.getSize();
+		mapIndex();
+
+		// Index what was appended to the pack after the index was written
+		int64 covered = 0;
+		if (mappedIndex_) {
+			auto header = static_cast<IndexHeader const *>(mappedIndex_->getData());
+			covered = (int64) header->packSizeCovered;
+		}
+		if (covered > packSize_) {
+			// The index does not belong to this pack, start over
+			mappedIndex_.reset();
+			sortedEntries_ = nullptr;
+			numberOfSortedEntries_ = 0;
+			covered = 0;
+		}
+		return scanPack(covered);
+	}
+
+	void RD8PatternStore::mapIndex()
+	{
+		mappedIndex_.reset();
+		sortedEntries_ = nullptr;
+		numberOfSortedEntries_ = 0;
+		if (!indexFile_.existsAsFile()) {
+			return;
+		}
+		auto mapped = std::make_unique<MemoryMappedFile>(indexFile_, MemoryMappedFile::readOnly);
+		if (mapped->getData() == nullptr || mapped->getSize() < sizeof(IndexHeader)) {
+			return;
+		}
+		auto header = static_cast<IndexHeader const *>(mapped->getData());
+		if (memcmp(header->magic, kIndexMagic, 4) != 0 || header->version != kIndexVersion
+			|| mapped->getSize() < sizeof(IndexHeader) + header->numberOfEntries * sizeof(IndexEntry)) {
+			return;
+		}
+		sortedEntries_ = reinterpret_cast<IndexEntry const *>(static_cast<uint8 const *>(mapped->getData()) + sizeof(IndexHeader));
+		numberOfSortedEntries_ = (size_t) header->numberOfEntries;
+		mappedIndex_ = std::move(mapped);
+	}
+
+	bool RD8PatternStore::scanPack(int64 fromPosition)
+	{
+		if (fromPosition >= packSize_) {
+			return true;
+		}
+		FileInputStream in(packFile_);
+		if (!in.openedOk() || !in.setPosition(fromPosition)) {
+			return false;
+		}
+		int64 position = fromPosition;
+		while (position + (int64) sizeof(PackRecordHeader) <= packSize_) {
+			PackRecordHeader header;
+			if (in.read(&header, sizeof(header)) != (int) sizeof(header) || memcmp(header.magic, kPackRecordMagic, 4) != 0
+				|| position + (int64) sizeof(header) + header.size > packSize_) {
+				break;
+			}
+			IndexEntry entry = { header.hash, (uint64) (position + (int64) sizeof(header)), header.size, header.dataTypeID, { 0, 0, 0 } };
+			recentEntries_[header.hash] = entry;
+			position += (int64) sizeof(header) + header.size;
+			in.setPosition(position);
+		}
+		if (position < packSize_) {
+			// A record was only partially written, cut it off so the next append starts at a record boundary
+			FileOutputStream out(packFile_);
+			if (!out.openedOk() || !out.setPosition(position) || !out.truncate().wasOk()) {
+				return false;
+			}
+			packSize_ = position;
+		}
+		return true;
+	}
+
+	void RD8PatternStore::flush()
+	{
+		ScopedLock lock(lock_);
+		if (recentEntries_.empty()) {
+			return;
+		}
+
+		// Merge the mapped entries and the new ones into a new sorted index
+		std::vector<IndexEntry> entries(sortedEntries_, sortedEntries_ + numberOfSortedEntries_);
+		for (auto const &recent : recentEntries_) {
+			entries.push_back(recent.second);
+		}
+		std::sort(entries.begin(), entries.end(), [](IndexEntry const &a, IndexEntry const &b) { return a.hash < b.hash; });
+
+		IndexHeader header;
+		memcpy(header.magic, kIndexMagic, 4);
+		header.version = kIndexVersion;
+		header.packSizeCovered = (uint64) packSize_;
+		header.numberOfEntries = entries.size();
+		MemoryBlock block;
+		block.append(&header, sizeof(header));
+		block.append(entries.data(), entries.size() * sizeof(IndexEntry));
+
+		// Unmap before replacing the file. Write to a temporary file first so a crash never leaves a broken index behind
+		mappedIndex_.reset();
+		sortedEntries_ = nullptr;
+		numberOfSortedEntries_ = 0;
+		auto temporary = indexFile_.withFileExtension(".rd8idx.tmp");
+		if (temporary.replaceWithData(block.getData(), block.getSize()) && temporary.moveFileTo(indexFile_)) {
+			recentEntries_.clear();
+		}
+		else {
+			jassertfalse;
+		}
+		mapIndex();
+		if (!mappedIndex_) {
+			// Keep everything in memory, the entries are found in the pack again on the next open
+			for (auto const &entry : entries) {
+				recentEntries_[entry.hash] = entry;
+			}
+		}
+	}
+
+	bool RD8PatternStore::find(ContentHash hash, IndexEntry &outEntry) const
+	{
+		auto recent = recentEntries_.find(hash);
+		if (recent != recentEntries_.end()) {
+			outEntry = recent->second;
+			return true;
+		}
+		auto end = sortedEntries_ + numberOfSortedEntries_;
+		auto found = std::lower_bound(sortedEntries_, end, hash, [](IndexEntry const &entry, ContentHash value) { return entry.hash < value; });
+		if (found != end && found->hash == hash) {
+			outEntry = *found;
+			return true;
+		}
+		return false;
+	}
+
+	bool RD8PatternStore::add(RD8DataFile const &dataFile, ContentHash &outHash)
+	{
+		size_t offset;
+		uint8 responseID;
+		auto const &sysexData = dataFile.data();
+		if (!payloadLayout(dataFile.dataTypeID(), offset, responseID) || sysexData.size() <= offset) {
+			return false;
+		}
+		auto payload = RD8SysexCodec::unescape(sysexData.data() + offset, sysexData.size() - offset);
+		outHash = contentHash(dataFile.dataTypeID(), payload.data(), payload.size());
+
+		ScopedLock lock(lock_);
+		IndexEntry existing;
+		if (find(outHash, existing)) {
+			jassert(existing.size == payload.size() && existing.dataTypeID == dataFile.dataTypeID());
+			return true;
+		}
+
+		// Append header and payload with one write
+		PackRecordHeader header;
+		memcpy(header.magic, kPackRecordMagic, 4);
+		header.dataTypeID = (uint8) dataFile.dataTypeID();
+		memset(header.reserved, 0, sizeof(header.reserved));
+		header.size = (uint32) payload.size();
+		header.reserved2 = 0;
+		header.hash = outHash;
+		MemoryBlock record;
+		record.append(&header, sizeof(header));
+		record.append(payload.data(), payload.size());
+		if (!packFile_.appendData(record.getData(), record.getSize())) {
+			return false;
+		}
+		IndexEntry entry = { outHash, (uint64) (packSize_ + (int64) sizeof(header)), header.size, header.dataTypeID, { 0, 0, 0 } };
+		recentEntries_[outHash] = entry;
+		packSize_ += (int64) record.getSize();
+		return true;
+	}
+
+	bool RD8PatternStore::contains(ContentHash hash) const
+	{
+		ScopedLock lock(lock_);
+		IndexEntry entry;
+		return find(hash, entry);
+	}
+
+	size_t RD8PatternStore::numberOfEntries() const
+	{
+		ScopedLock lock(lock_);
+		return numberOfSortedEntries_ + recentEntries_.size();
+	}
+
+	bool RD8PatternStore::contentOf(ContentHash hash, std::vector<uint8> &outPayload, int &outDataTypeID) const
+	{
+		IndexEntry entry;
+		{
+			ScopedLock lock(lock_);
+			if (!find(hash, entry)) {
+				return false;
+			}
+		}
+		// The pack is append only, so the record can be read without holding the lock
+		FileInputStream in(packFile_);
+		if (!in.openedOk() || !in.setPosition((int64) entry.position)) {
+			return false;
+		}
+		outPayload.resize(entry.size);
+		if (in.read(outPayload.data(), (int) entry.size) != (int) entry.size) {
+			return false;
+		}
+		outDataTypeID = entry.dataTypeID;
+		return true;
+	}
+
+	std::shared_ptr<RD8DataFile> RD8PatternStore::load(ContentHash hash, int slotNo) const
+	{
+		std::vector<uint8> payload;
+		int dataTypeID;
+		size_t offset;
+		uint8 responseID;
+		if (!contentOf(hash, payload, dataTypeID) || !payloadLayout(dataTypeID, offset, responseID)) {
+			return nullptr;
+		}
+
+		// Header, slot bytes, then the escaped payload
+		auto message = rd8_->createRequestMessage(BehringerRD8::MessageID({ RD8_DATA_MESSAGE, responseID }));
+		if (dataTypeID == BehringerRD8::STORED_PATTERN) {
+			message.push_back((uint8) (slotNo / 16));
+			message.push_back((uint8) (slotNo % 16));
+		}
+		else {
+			message.push_back((uint8) slotNo);
+		}
+		jassert(message.size() == offset);
+		size_t headerSize = message.size();
+		message.resize(headerSize + RD8SysexCodec::escapedSize(payload.size()));
+		RD8SysexCodec::escape(payload.data(), payload.size(), message.data() + headerSize);
+		return rd8_->dataFileFromSysex(message.data(), message.size());
+	}
+
+}
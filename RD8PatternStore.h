@@ -0,0 +1,66 @@
+#pragma once
+
+#include "RD8Pattern.h"
+
+#include <unordered_map>
+
+namespace midikraft {
+
+	class BehringerRD8;
+
+	// A local store for stored patterns and songs, addressed by the hash of their content.
+	// The key is the XXH64 of the unescaped payload, without the header and the song/pattern slot bytes, so the same pattern
+	// saved into different slots or dumped from different devices is stored only once.
+	// The payloads are appended to a pack file, the pack is never rewritten. A sorted index of hash, position and size next to it
+	// is memory mapped, entries added since the index was last written are kept in memory until flush().
+	class RD8PatternStore {
+	public:
+		typedef uint64 ContentHash;
+
+		// The index file is the pack file with the extension .rd8idx
+		RD8PatternStore(BehringerRD8 const *rd8, File const &packFile);
+		~RD8PatternStore(); // Writes the index
+
+		// Creates the pack if it does not exist. Pack entries not covered by the index (e.g. after a crash) are read from the pack
+		bool open();
+		void flush(); // Write the index
+
+		// Adds the payload of a stored pattern or song unless it is already known. Returns false for other data files
+		bool add(RD8DataFile const &dataFile, ContentHash &outHash);
+		bool contains(ContentHash hash) const;
+		size_t numberOfEntries() const;
+
+		// The unescaped payload
+		bool contentOf(ContentHash hash, std::vector<uint8> &outPayload, int &outDataTypeID) const;
+
+		// Builds the data file to send the content to a slot, songNo * 16 + patternNo for patterns and songNo for songs
+		std::shared_ptr<RD8DataFile> load(ContentHash hash, int slotNo) const;
+
+		static ContentHash contentHash(int dataTypeID, uint8 const *payload, size_t size);
+
+	private:
+		struct IndexEntry {
+			uint64 hash;
+			uint64 position; // Of the payload in the pack file
+			uint32 size;
+			uint8 dataTypeID;
+			uint8 reserved[3];
+		};
+
+		bool find(ContentHash hash, IndexEntry &outEntry) const;
+		bool scanPack(int64 fromPosition);
+		void mapIndex();
+
+		BehringerRD8 const *rd8_;
+		File packFile_;
+		File indexFile_;
+		int64 packSize_ = 0;
+
+		CriticalSection lock_;
+		std::unique_ptr<MemoryMappedFile> mappedIndex_;
+		IndexEntry const *sortedEntries_ = nullptr; // Points into the mapped index
+		size_t numberOfSortedEntries_ = 0;
+		std::unordered_map<ContentHash, IndexEntry> recentEntries_;
+	};
+
+}
@@ -0,0 +1,207 @@
+#include "RD8RequestMultiplexer.h"
+
+#include "RD8.h"
+
+#include <tuple>
+
+namespace midikraft {
+
+	bool RD8RequestMultiplexer::CorrelationKey::operator<(CorrelationKey const &other) const
+	{
+		return std::tie(messageType, messageID, numberOfItemBytes, itemBytes[0], itemBytes[1]) <
+			std::tie(other.messageType, other.messageID, other.numberOfItemBytes, other.itemBytes[0], other.itemBytes[1]);
+	}
+
+	bool RD8RequestMultiplexer::CorrelationKey::operator==(CorrelationKey const &other) const
+	{
+		return !(*this < other) && !(other < *this);
+	}
+
+	RD8RequestMultiplexer::CorrelationKey RD8RequestMultiplexer::CorrelationKey::forResponse(uint8 const *sysexData, size_t size)
+	{
+		CorrelationKey key = { 0xff, 0xff, 0, { 0, 0 } };
+		if (size > 6) {
+			key.messageType = sysexData[5];
+			key.messageID = sysexData[6];
+			// The data responses repeat the item bytes of the request after the 14 bytes header
+			if (key.messageType == RD8_DATA_MESSAGE) {
+				if (key.messageID == RD8_STORED_PATTERN_RESPONSE && size > 15) {
+					key.numberOfItemBytes = 2;
+					key.itemBytes[0] = sysexData[14];
+					key.itemBytes[1] = sysexData[15];
+				}
+				else if (key.messageID == RD8_STORED_SONG_RESPONSE && size > 14) {
+					key.numberOfItemBytes = 1;
+					key.itemBytes[0] = sysexData[14];
+				}
+			}
+		}
+		return key;
+	}
+
+	RD8RequestMultiplexer::CorrelationKey RD8RequestMultiplexer::CorrelationKey::forDataItem(int dataTypeID, int itemNo)
+	{
+		switch (dataTypeID) {
+		case BehringerRD8::STORED_PATTERN:
+			return { RD8_DATA_MESSAGE, RD8_STORED_PATTERN_RESPONSE, 2, { (uint8) (itemNo / 16), (uint8) (itemNo % 16) } };
+		case BehringerRD8::STORED_SONG:
+			return { RD8_DATA_MESSAGE, RD8_STORED_SONG_RESPONSE, 1, { (uint8) itemNo, 0 } };
+		case BehringerRD8::LIVE_PATTERN:
+			return { RD8_DATA_MESSAGE, RD8_LIVE_PATTERN_RESPONSE, 0, { 0, 0 } };
+		case BehringerRD8::LIVE_SONG:
+			return { RD8_DATA_MESSAGE, RD8_LIVE_SONG_RESPONSE, 0, { 0, 0 } };
+		case BehringerRD8::SETTINGS:
+			return { RD8_DATA_MESSAGE, RD8_GLOBAL_SETTINGS_RESPONSE, 0, { 0, 0 } };
+		default:
+			jassertfalse;
+			return { 0xff, 0xff, 0, { 0, 0 } };
+		}
+	}
+
+	RD8RequestMultiplexer::CorrelationKey RD8RequestMultiplexer::CorrelationKey::forFirmware()
+	{
+		return { RD8_FIRMWARE_MESSAGE, RD8_REPLY, 0, { 0, 0 } };
+	}
+
+	RD8RequestMultiplexer::RD8RequestMultiplexer(BehringerRD8 *rd8) : Thread("RD8RequestMultiplexer"), rd8_(rd8), liveness_(std::make_shared<Liveness>())
+	{
+	}
+
+	RD8RequestMultiplexer::~RD8RequestMultiplexer()
+	{
+		{
+			ScopedWriteLock write(liveness_->lock);
+			liveness_->alive = false;
+		}
+		stopThread(1000);
+		ScopedLock lock(lock_);
+		if (transport_) {
+			transport_->removeReceiver(receiverID_);
+		}
+		pending_.clear();
+	}
+
+	RD8RequestMultiplexer::RequestID RD8RequestMultiplexer::send(std::vector<MidiMessage> const &request, CorrelationKey const &key, int timeoutMS, Callback onComplete)
+	{
+		RequestID requestID;
+		auto transport = rd8_->transport();
+		{
+			ScopedLock lock(lock_);
+			if (transport_ != transport) {
+				// One receiver for all transactions of this device, follow if the device got a new transport
+				if (transport_) {
+					transport_->removeReceiver(receiverID_);
+				}
+				transport_ = transport;
+				auto liveness = liveness_;
+				receiverID_ = transport_->addReceiver([this, liveness](const MidiMessage &message) {
+					ScopedReadLock read(liveness->lock);
+					if (liveness->alive) {
+						handleMessage(message);
+					}
+				});
+			}
+			if (!isThreadRunning()) {
+				startThread();
+			}
+			requestID = nextRequestID_++;
+			pending_.emplace(key, PendingRequest({ requestID, Time::getMillisecondCounter() + (uint32) timeoutMS, RD8Metrics::nowMicroseconds(), onComplete }));
+		}
+		// The new deadline might be the earliest
+		notify();
+
+		auto &metrics = rd8_->metrics();
+		metrics.count(RD8Metrics::RequestsSent);
+		for (auto const &message : request) {
+			metrics.count(RD8Metrics::BytesOut, (uint64) message.getRawDataSize());
+		}
+
+		// The receiver is registered before sending, so even the fastest reply is caught
+		transport->send(request);
+		return requestID;
+	}
+
+	void RD8RequestMultiplexer::cancel(RequestID requestID)
+	{
+		ScopedLock lock(lock_);
+		for (auto it = pending_.begin(); it != pending_.end(); it++) {
+			if (it->second.requestID == requestID) {
+				pending_.erase(it);
+				return;
+			}
+		}
+	}
+
+	void RD8RequestMultiplexer::cancelAll()
+	{
+		ScopedLock lock(lock_);
+		pending_.clear();
+	}
+
+	int RD8RequestMultiplexer::numberOfPendingRequests() const
+	{
+		ScopedLock lock(lock_);
+		return (int) pending_.size();
+	}
+
+	void RD8RequestMultiplexer::handleMessage(MidiMessage const &message)
+	{
+		if (!rd8_->isOwnSysex(message)) {
+			return;
+		}
+		auto &metrics = rd8_->metrics();
+		metrics.count(RD8Metrics::BytesIn, (uint64) message.getRawDataSize());
+		Callback callback;
+		{
+			ScopedLock lock(lock_);
+			auto key = CorrelationKey::forResponse(message.getSysExData(), (size_t) message.getSysExDataSize());
+			auto found = pending_.find(key);
+			if (found == pending_.end()) {
+				return;
+			}
+			// find returns the first, i.e. oldest, of the requests with that key
+			callback = found->second.callback;
+			metrics.count(RD8Metrics::ResponsesMatched);
+			metrics.recordRoundtrip(key.messageType, key.messageID, RD8Metrics::nowMicroseconds() - found->second.sentAtMicroseconds);
+			pending_.erase(found);
+		}
+		if (callback) {
+			callback(Result::Success, message);
+		}
+	}
+
+	void RD8RequestMultiplexer::run()
+	{
+		while (!threadShouldExit()) {
+			std::vector<Callback> timedOut;
+			int waitMS = -1; // Until the next request is sent
+			{
+				ScopedLock lock(lock_);
+				uint32 now = Time::getMillisecondCounter();
+				for (auto it = pending_.begin(); it != pending_.end();) {
+					int32 remaining = (int32) (it->second.deadlineMS - now);
+					if (remaining <= 0) {
+						timedOut.push_back(it->second.callback);
+						it = pending_.erase(it);
+					}
+					else {
+						waitMS = waitMS < 0 ? remaining : jmin(waitMS, (int) remaining);
+						it++;
+					}
+				}
+			}
+			if (!timedOut.empty()) {
+				rd8_->metrics().count(RD8Metrics::Timeouts, timedOut.size());
+				for (auto const &callback : timedOut) {
+					if (callback) {
+						callback(Result::Timeout, MidiMessage());
+					}
+				}
+				// Time has passed, look again before waiting
+				continue;
+			}
+			wait(waitMS);
+		}
+	}
+
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "JuceHeader.h"
+#include "RD8MidiTransport.h"
+
+namespace midikraft {
+
+	class BehringerRD8;
+
+	// Allows many request/response transactions with the RD8 to be in flight at the same time.
+	// Each request names the response it waits for by a correlation key (message ID plus item bytes), has its own timeout,
+	// and gets a completion callback. Requests with the same key are answered in the order they were sent.
+	// The callbacks are called from the MIDI input thread (responses) or from a thread of the multiplexer (timeouts), without any
+	// lock held. Timeouts don't need a message loop, so they also fire in command line tools and tests.
+	// A callback may still be running when cancel returns, so it must not refer to anything by raw pointer that might be gone by then.
+	class RD8RequestMultiplexer : private Thread {
+	public:
+		enum class Result { Success, Timeout };
+
+		struct CorrelationKey {
+			uint8 messageType;
+			uint8 messageID;
+			int numberOfItemBytes;
+			uint8 itemBytes[2];
+
+			bool operator<(CorrelationKey const &other) const;
+			bool operator==(CorrelationKey const &other) const;
+
+			static CorrelationKey forResponse(uint8 const *sysexData, size_t size);
+			static CorrelationKey forDataItem(int dataTypeID, int itemNo); // The key of the response to requestDataItem
+			static CorrelationKey forFirmware();
+		};
+
+		typedef uint64 RequestID;
+		typedef std::function<void(Result result, MidiMessage const &response)> Callback;
+
+		explicit RD8RequestMultiplexer(BehringerRD8 *rd8);
+		virtual ~RD8RequestMultiplexer() override;
+
+		RequestID send(std::vector<MidiMessage> const &request, CorrelationKey const &key, int timeoutMS, Callback onComplete);
+
+		// Forget the requests without calling their callbacks
+		void cancel(RequestID requestID);
+		void cancelAll();
+
+		int numberOfPendingRequests() const;
+
+	private:
+		struct PendingRequest {
+			RequestID requestID;
+			uint32 deadlineMS;
+			int64 sentAtMicroseconds;
+			Callback callback;
+		};
+
+		// Shared with our receiver. The transport may still be delivering a message when we remove the receiver, so the destructor
+		// clears alive under the write lock, which waits for deliveries in progress
+		struct Liveness {
+			ReadWriteLock lock;
+			bool alive = true;
+		};
+
+		void run() override; // Expires the requests at their deadline
+		void handleMessage(MidiMessage const &message);
+
+		BehringerRD8 *rd8_;
+		CriticalSection lock_;
+		std::multimap<CorrelationKey, PendingRequest> pending_; // Equal keys keep their insertion order
+		RequestID nextRequestID_ = 1;
+		std::shared_ptr<RD8MidiTransport> transport_; // The transport our receiver is registered with
+		RD8MidiTransport::ReceiverID receiverID_ = 0;
+		std::shared_ptr<Liveness> liveness_;
+	};
+
+}
@@ -0,0 +1,44 @@
+#include "RD8SettingsTransaction.h"
+
+#include "RD8.h"
+
+namespace midikraft {
+
+	RD8SettingsTransaction::RD8SettingsTransaction(BehringerRD8 *rd8, RD8GlobalSettings const &deviceState) :
+		rd8_(rd8), deviceState_(deviceState.data()), working_(std::make_shared<RD8GlobalSettings>(deviceState))
+	{
+	}
+
+	bool RD8SettingsTransaction::set(RD8GlobalSettings::Setting setting, uint8 newValue)
+	{
+		jassert(!committed_);
+		return working_->poke(setting, newValue);
+	}
+
+	uint8 RD8SettingsTransaction::get(RD8GlobalSettings::Setting setting) const
+	{
+		return working_->peek(setting);
+	}
+
+	bool RD8SettingsTransaction::hasChanges() const
+	{
+		return working_->data() != deviceState_;
+	}
+
+	std::shared_ptr<RD8GlobalSettings> RD8SettingsTransaction::settings() const
+	{
+		return working_;
+	}
+
+	bool RD8SettingsTransaction::commit()
+	{
+		jassert(!committed_);
+		committed_ = true;
+		if (!hasChanges()) {
+			return false;
+		}
+		rd8_->sendGlobalSettings(*working_, false);
+		return true;
+	}
+
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "RD8Pattern.h"
+
+namespace midikraft {
+
+	// Collects edits to the global settings on a working copy, and sends them to the device as one settings dump on commit.
+	// The RD8 only accepts the whole settings page, so the commit is skipped entirely if the edits didn't change anything
+	// compared to the state the device is known to have.
+	class RD8SettingsTransaction {
+	public:
+		RD8SettingsTransaction(BehringerRD8 *rd8, RD8GlobalSettings const &deviceState);
+
+		bool set(RD8GlobalSettings::Setting setting, uint8 newValue);
+		uint8 get(RD8GlobalSettings::Setting setting) const;
+
+		bool hasChanges() const;
+		std::shared_ptr<RD8GlobalSettings> settings() const;
+
+		// Returns true if a message was sent to the device
+		bool commit();
+
+	private:
+		BehringerRD8 *rd8_;
+		Synth::PatchData deviceState_;
+		std::shared_ptr<RD8GlobalSettings> working_;
+		bool committed_ = false;
+	};
+
+}
@@ -0,0 +1,170 @@
+#include "RD8SimilarityIndex.h"
+
+#include "RD8PatternArchive.h"
+
+namespace midikraft {
+
+	namespace {
+		const size_t kTracks = RD8StepPlanes::kNumberOfTracks;
+		const size_t kPositions = kTracks * RD8StepPlanes::kNumberOfSteps;
+		const int kBitsPerHash = 10; // Enough for the 768 step positions
+		const uint16 kNoStep = (1 << kBitsPerHash) - 1;
+	}
+
+	RD8SimilarityIndex::Options::Options()
+	{
+		trackWeights.fill(1.0f);
+	}
+
+	RD8SimilarityIndex::RD8SimilarityIndex(Options options) : options_(options)
+	{
+		jassert(options_.hashesPerKey > 0 && options_.hashesPerKey <= 3);
+	}
+
+	void RD8SimilarityIndex::add(RD8StepPlanes const &planes)
+	{
+		onOff_.insert(onOff_.end(), planes.onOff.begin(), planes.onOff.end());
+	}
+
+	void RD8SimilarityIndex::add(RD8PatternArchive const &archive)
+	{
+		// The on/off column of the archive already has our layout
+		auto column = archive.planeColumn(RD8PatternArchive::OnOff);
+		onOff_.insert(onOff_.end(), column, column + archive.numberOfPatterns() * kTracks);
+	}
+
+	size_t RD8SimilarityIndex::numberOfPatterns() const
+	{
+		return onOff_.size() / kTracks;
+	}
+
+	void RD8SimilarityIndex::build()
+	{
+		// Find the steps that vary across the library. With 16 step patterns and a few tracks in use, most steps are never on,
+		// and a step on in all patterns would make every pattern collide
+		size_t n = numberOfPatterns();
+		std::vector<size_t> onCount(kPositions, 0);
+		for (size_t patternNo = 0; patternNo < n; patternNo++) {
+			for (size_t track = 0; track < kTracks; track++) {
+				for (uint64 word = onOff_[patternNo * kTracks + track]; word != 0; word &= word - 1) {
+					uint64 lowestBit = word & (~word + 1);
+					onCount[track * RD8StepPlanes::kNumberOfSteps + (size_t) popcount64(lowestBit - 1)]++;
+				}
+			}
+		}
+
+		// For each hash, order the varying steps by an exponentially distributed rank with the track weight as rate. The first step
+		// of that order that is on in both patterns is the same with a probability of their weighted Jaccard similarity
+		Random random((int64) options_.seed);
+		size_t numberOfHashes = (size_t) (options_.numberOfTables * options_.hashesPerKey);
+		stepOrders_.assign(numberOfHashes, std::vector<uint16>());
+		std::vector<std::pair<float, uint16>> ranked;
+		for (auto &order : stepOrders_) {
+			ranked.clear();
+			for (size_t position = 0; position < kPositions; position++) {
+				float weight = options_.trackWeights[position / RD8StepPlanes::kNumberOfSteps];
+				if (weight > 0.0f && onCount[position] > 0 && onCount[position] < n) {
+					ranked.emplace_back(-std::log(1.0f - random.nextFloat()) / weight, (uint16) position);
+				}
+			}
+			std::sort(ranked.begin(), ranked.end());
+			for (auto const &rank : ranked) {
+				order.push_back(rank.second);
+			}
+		}
+
+		// One sorted array of (key, pattern number) per table
+		tables_.assign((size_t) options_.numberOfTables, std::vector<uint64>());
+		for (int tableNo = 0; tableNo < options_.numberOfTables; tableNo++) {
+			auto &table = tables_[(size_t) tableNo];
+			table.resize(n);
+			for (size_t patternNo = 0; patternNo < n; patternNo++) {
+				table[patternNo] = ((uint64) keyOf(onOff_.data() + patternNo * kTracks, tableNo) << 32) | (uint64) patternNo;
+			}
+			std::sort(table.begin(), table.end());
+		}
+	}
+
+	uint16 RD8SimilarityIndex::minHash(uint64 const *onOff, size_t hashNo) const
+	{
+		for (auto position : stepOrders_[hashNo]) {
+			if ((onOff[position / RD8StepPlanes::kNumberOfSteps] >> (position % RD8StepPlanes::kNumberOfSteps)) & 1) {
+				return position;
+			}
+		}
+		return kNoStep; // None of the varying steps is on
+	}
+
+	uint32 RD8SimilarityIndex::keyOf(uint64 const *onOff, int tableNo) const
+	{
+		uint32 key = 0;
+		for (int i = 0; i < options_.hashesPerKey; i++) {
+			key = (key << kBitsPerHash) | minHash(onOff, (size_t) (tableNo * options_.hashesPerKey + i));
+		}
+		return key;
+	}
+
+	float RD8SimilarityIndex::distance(uint64 const *onOff, RD8StepPlanes::Plane const &query) const
+	{
+		float result = 0.0f;
+		for (size_t track = 0; track < kTracks; track++) {
+			result += options_.trackWeights[track] * (float) popcount64(onOff[track] ^ query[track]);
+		}
+		return result;
+	}
+
+	float RD8SimilarityIndex::distance(size_t patternNo, RD8StepPlanes const &query) const
+	{
+		jassert(patternNo < numberOfPatterns());
+		return distance(onOff_.data() + patternNo * kTracks, query.onOff);
+	}
+
+	void RD8SimilarityIndex::collect(int tableNo, uint32 key, std::vector<uint32> &candidates) const
+	{
+		auto const &table = tables_[(size_t) tableNo];
+		auto first = std::lower_bound(table.begin(), table.end(), (uint64) key << 32);
+		for (auto it = first; it != table.end() && (uint32) (*it >> 32) == key; ++it) {
+			candidates.push_back((uint32) *it);
+		}
+	}
+
+	std::vector<RD8SimilarityIndex::Match> RD8SimilarityIndex::topK(std::vector<Match> &scored, int k)
+	{
+		auto byDistance = [](Match const &a, Match const &b) { return a.distance < b.distance || (a.distance == b.distance && a.patternNo < b.patternNo); };
+		size_t count = std::min(scored.size(), (size_t) jmax(0, k));
+		std::partial_sort(scored.begin(), scored.begin() + (ptrdiff_t) count, scored.end(), byDistance);
+		scored.resize(count);
+		return scored;
+	}
+
+	std::vector<RD8SimilarityIndex::Match> RD8SimilarityIndex::nearest(RD8StepPlanes const &query, int k) const
+	{
+		jassert(tables_.size() == (size_t) options_.numberOfTables); // Call build() first
+
+		std::vector<uint32> candidates;
+		for (int tableNo = 0; tableNo < (int) tables_.size(); tableNo++) {
+			uint32 key = keyOf(query.onOff.data(), tableNo);
+			collect(tableNo, key, candidates);
+		}
+		std::sort(candidates.begin(), candidates.end());
+		candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+		std::vector<Match> scored;
+		scored.reserve(candidates.size());
+		for (auto patternNo : candidates) {
+			scored.push_back({ patternNo, distance(onOff_.data() + (size_t) patternNo * kTracks, query.onOff) });
+		}
+		return topK(scored, k);
+	}
+
+	std::vector<RD8SimilarityIndex::Match> RD8SimilarityIndex::nearestExact(RD8StepPlanes const &query, int k) const
+	{
+		size_t n = numberOfPatterns();
+		std::vector<Match> scored(n);
+		for (size_t patternNo = 0; patternNo < n; patternNo++) {
+			scored[patternNo] = { patternNo, distance(onOff_.data() + patternNo * kTracks, query.onOff) };
+		}
+		return topK(scored, k);
+	}
+
+}
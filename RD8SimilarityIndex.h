@@ -0,0 +1,59 @@
+#pragma once
+
+#include "RD8StepPlanes.h"
+
+namespace midikraft {
+
+	class RD8PatternArchive;
+
+	// Nearest neighbour search over the step on/off masks (12 tracks * 64 steps = 768 bits) of a pattern library.
+	// The distance is the number of differing steps, weighted per track. Candidates are found with locality sensitive hashing
+	// on the steps that are switched on: each key is made of weighted MinHashes, i.e. the first switched on step of the pattern
+	// in a random order of the steps, steps of heavier tracks coming first more often. Two patterns get the same MinHash with
+	// a probability equal to their weighted Jaccard similarity, so this works for sparse 16 step patterns as well as for dense ones.
+	// Only steps that vary across the library take part, steps never or always on don't tell the patterns apart.
+	// Only the candidates are scored with the exact distance.
+	class RD8SimilarityIndex {
+	public:
+		struct Options {
+			Options();
+
+			int numberOfTables = 16;
+			int hashesPerKey = 3; // A hash is a step position of 10 bits, so at most 3 fit the key
+			uint32 seed = 0x52443821;
+			std::array<float, RD8StepPlanes::kNumberOfTracks> trackWeights; // Track 0 is the accent track
+		};
+
+		struct Match {
+			size_t patternNo; // In the order the patterns were added
+			float distance;
+		};
+
+		explicit RD8SimilarityIndex(Options options);
+
+		// Add all patterns, then build the index once
+		void add(RD8StepPlanes const &planes);
+		void add(RD8PatternArchive const &archive);
+		void build();
+		size_t numberOfPatterns() const;
+
+		// The k nearest patterns, closest first
+		std::vector<Match> nearest(RD8StepPlanes const &query, int k) const;
+		std::vector<Match> nearestExact(RD8StepPlanes const &query, int k) const; // Linear scan, for small libraries and for checking
+
+		float distance(size_t patternNo, RD8StepPlanes const &query) const;
+
+	private:
+		uint32 keyOf(uint64 const *onOff, int tableNo) const;
+		uint16 minHash(uint64 const *onOff, size_t hashNo) const;
+		float distance(uint64 const *onOff, RD8StepPlanes::Plane const &query) const;
+		void collect(int tableNo, uint32 key, std::vector<uint32> &candidates) const;
+		static std::vector<Match> topK(std::vector<Match> &scored, int k);
+
+		Options options_;
+		std::vector<uint64> onOff_; // 12 words per pattern
+		std::vector<std::vector<uint16>> stepOrders_; // Per hash, the varying step positions (track * 64 + step) in random weighted order
+		std::vector<std::vector<uint64>> tables_; // Per table, key in the upper and pattern number in the lower 32 bits, sorted
+	};
+
+}
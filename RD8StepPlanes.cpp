@@ -0,0 +1,223 @@
+#include "RD8StepPlanes.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RD8_USE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace midikraft {
+
+	namespace {
+		// Must match RD8Pattern::BitPatterns
+		const int kOnOffBit = 0;
+		const int kProbabilityBit = 2;
+		const int kFlamBit = 3;
+		const int kRepeatOnOffBit = 4;
+		const int kRepeatLoBit = 5;
+		const int kRepeatHiBit = 6;
+
+#ifdef RD8_USE_SSE2
+		// Move the given bit of each of the 16 bytes into the sign position and collect them
+		template<int bit>
+		inline uint64 movemaskBit(__m128i bytes) {
+			return (uint64) (uint32) _mm_movemask_epi8(_mm_slli_epi16(bytes, 7 - bit));
+		}
+
+		template<int bit>
+		inline uint64 trackMask(__m128i const (&chunks)[4]) {
+			return movemaskBit<bit>(chunks[0]) | (movemaskBit<bit>(chunks[1]) << 16) | (movemaskBit<bit>(chunks[2]) << 32) | (movemaskBit<bit>(chunks[3]) << 48);
+		}
+#else
+		// Collect the given bit of 8 consecutive bytes into one byte with a multiplication
+		inline uint64 gatherBit(uint8 const *bytes, int bit) {
+			uint64 word = 0;
+			for (int i = 0; i < 8; i++) {
+				word |= ((uint64) bytes[i]) << (8 * i);
+			}
+			return (((word >> bit) & 0x0101010101010101ULL) * 0x0102040810204080ULL) >> 56;
+		}
+
+		inline uint64 trackMask(uint8 const *trackBytes, int bit) {
+			uint64 result = 0;
+			for (int i = 0; i < 8; i++) {
+				result |= gatherBit(trackBytes + 8 * i, bit) << (8 * i);
+			}
+			return result;
+		}
+#endif
+	}
+
+	int popcount64(uint64 word)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		return __builtin_popcountll(word);
+#elif defined(_MSC_VER) && defined(_M_X64)
+		return (int) __popcnt64(word);
+#else
+		word = word - ((word >> 1) & 0x5555555555555555ULL);
+		word = (word & 0x3333333333333333ULL) + ((word >> 2) & 0x3333333333333333ULL);
+		word = (word + (word >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+		return (int) ((word * 0x0101010101010101ULL) >> 56);
+#endif
+	}
+
+	uint64 RD8StepPlanes::onOffMask(uint8 const *trackStepBytes)
+	{
+#ifdef RD8_USE_SSE2
+		__m128i chunks[4];
+		for (int i = 0; i < 4; i++) {
+			chunks[i] = _mm_loadu_si128(reinterpret_cast<__m128i const *>(trackStepBytes + 16 * i));
+		}
+		return trackMask<kOnOffBit>(chunks);
+#else
+		return trackMask(trackStepBytes, kOnOffBit);
+#endif
+	}
+
+	void RD8StepPlanes::fromStepBytes(uint8 const *stepBytes)
+	{
+		for (int track = 0; track < kNumberOfTracks; track++) {
+			uint8 const *trackBytes = stepBytes + track * kNumberOfSteps;
+#ifdef RD8_USE_SSE2
+			__m128i chunks[4];
+			for (int i = 0; i < 4; i++) {
+				chunks[i] = _mm_loadu_si128(reinterpret_cast<__m128i const *>(trackBytes + 16 * i));
+			}
+			onOff[track] = trackMask<kOnOffBit>(chunks);
+			probability[track] = trackMask<kProbabilityBit>(chunks);
+			flam[track] = trackMask<kFlamBit>(chunks);
+			repeatOnOff[track] = trackMask<kRepeatOnOffBit>(chunks);
+			repeatLo[track] = trackMask<kRepeatLoBit>(chunks);
+			repeatHi[track] = trackMask<kRepeatHiBit>(chunks);
+#else
+			onOff[track] = trackMask(trackBytes, kOnOffBit);
+			probability[track] = trackMask(trackBytes, kProbabilityBit);
+			flam[track] = trackMask(trackBytes, kFlamBit);
+			repeatOnOff[track] = trackMask(trackBytes, kRepeatOnOffBit);
+			repeatLo[track] = trackMask(trackBytes, kRepeatLoBit);
+			repeatHi[track] = trackMask(trackBytes, kRepeatHiBit);
+#endif
+		}
+	}
+
+	void RD8StepPlanes::toStepBytes(uint8 *stepBytes) const
+	{
+#if JUCE_LITTLE_ENDIAN
+		// Spread 8 bits of each plane into the given bit of 8 step bytes at once, the reverse of the gather in fromStepBytes
+		auto spread = [](uint64 planeWord, int group, int bit) {
+			uint64 bits = ((planeWord >> (8 * group)) & 0xff) * 0x0101010101010101ULL & 0x8040201008040201ULL;
+			uint64 msbs = ((bits + 0x7f7f7f7f7f7f7f7fULL) | bits) & 0x8080808080808080ULL;
+			return msbs >> (7 - bit);
+		};
+		for (int track = 0; track < kNumberOfTracks; track++) {
+			for (int group = 0; group < kNumberOfSteps / 8; group++) {
+				uint8 *groupBytes = stepBytes + track * kNumberOfSteps + group * 8;
+				uint64 word;
+				memcpy(&word, groupBytes, 8);
+				word &= ~(kModelledBits * 0x0101010101010101ULL);
+				word |= spread(onOff[track], group, kOnOffBit) | spread(probability[track], group, kProbabilityBit) | spread(flam[track], group, kFlamBit)
+					| spread(repeatOnOff[track], group, kRepeatOnOffBit) | spread(repeatLo[track], group, kRepeatLoBit) | spread(repeatHi[track], group, kRepeatHiBit);
+				memcpy(groupBytes, &word, 8);
+			}
+		}
+#else
+		for (int track = 0; track < kNumberOfTracks; track++) {
+			for (int step = 0; step < kNumberOfSteps; step++) {
+				uint8 &byte = stepBytes[track * kNumberOfSteps + step];
+				byte = (uint8) ((byte & ~kModelledBits) | stepByte(track, step));
+			}
+		}
+#endif
+	}
+
+	uint8 RD8StepPlanes::stepByte(int trackNo, int stepNo) const
+	{
+		auto bit = [trackNo, stepNo](Plane const &plane, int position) {
+			return (uint8) (((plane[trackNo] >> stepNo) & 1) << position);
+		};
+		return bit(onOff, kOnOffBit) | bit(probability, kProbabilityBit) | bit(flam, kFlamBit) | bit(repeatOnOff, kRepeatOnOffBit)
+			| bit(repeatLo, kRepeatLoBit) | bit(repeatHi, kRepeatHiBit);
+	}
+
+	void RD8StepPlanes::setStepByte(int trackNo, int stepNo, uint8 stepByte)
+	{
+		auto setBit = [trackNo, stepNo, stepByte](Plane &plane, int position) {
+			uint64 mask = 1ULL << stepNo;
+			plane[trackNo] = (plane[trackNo] & ~mask) | ((uint64) ((stepByte >> position) & 1) << stepNo);
+		};
+		setBit(onOff, kOnOffBit);
+		setBit(probability, kProbabilityBit);
+		setBit(flam, kFlamBit);
+		setBit(repeatOnOff, kRepeatOnOffBit);
+		setBit(repeatLo, kRepeatLoBit);
+		setBit(repeatHi, kRepeatHiBit);
+	}
+
+	int RD8StepPlanes::density(int trackNo) const
+	{
+		return popcount64(onOff[trackNo]);
+	}
+
+	int RD8StepPlanes::totalDensity() const
+	{
+		int result = 0;
+		for (auto mask : onOff) {
+			result += popcount64(mask);
+		}
+		return result;
+	}
+
+	int RD8StepPlanes::usedLength(int trackNo) const
+	{
+		int length = 0;
+		while (length < kNumberOfSteps && (onOff[trackNo] >> length) != 0) {
+			length++;
+		}
+		return length;
+	}
+
+	int RD8StepPlanes::usedLength() const
+	{
+		int result = 0;
+		for (int track = 0; track < kNumberOfTracks; track++) {
+			result = std::max(result, usedLength(track));
+		}
+		return result;
+	}
+
+	int RD8StepPlanes::hammingDistance(RD8StepPlanes const &a, RD8StepPlanes const &b)
+	{
+		int result = 0;
+		for (int track = 0; track < kNumberOfTracks; track++) {
+			result += popcount64(a.onOff[track] ^ b.onOff[track]);
+		}
+		return result;
+	}
+
+	float RD8StepPlanes::jaccardSimilarity(RD8StepPlanes const &a, RD8StepPlanes const &b)
+	{
+		int intersection = 0;
+		int unification = 0;
+		for (int track = 0; track < kNumberOfTracks; track++) {
+			intersection += popcount64(a.onOff[track] & b.onOff[track]);
+			unification += popcount64(a.onOff[track] | b.onOff[track]);
+		}
+		return unification == 0 ? 1.0f : intersection / (float) unification;
+	}
+
+	bool RD8StepPlanes::operator==(RD8StepPlanes const &other) const
+	{
+		return onOff == other.onOff && probability == other.probability && flam == other.flam && repeatOnOff == other.repeatOnOff
+			&& repeatLo == other.repeatLo && repeatHi == other.repeatHi;
+	}
+
+	bool RD8StepPlanes::operator!=(RD8StepPlanes const &other) const
+	{
+		return !(*this == other);
+	}
+
+}
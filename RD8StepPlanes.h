@@ -0,0 +1,48 @@
+#pragma once
+
+#include "JuceHeader.h"
+
+#include <array>
+
+namespace midikraft {
+
+	// The steps of the 12 RD8 tracks stored as bitplanes, one 64 bit mask per track and step attribute, bit n being step n.
+	// This allows queries over whole tracks or patterns with a few popcounts
+	struct RD8StepPlanes {
+		static constexpr int kNumberOfTracks = 12;
+		static constexpr int kNumberOfSteps = 64;
+
+		static constexpr uint8 kModelledBits = 0x7d; // The bits of a step byte held in the planes, bits 1 and 7 are not known
+
+		typedef std::array<uint64, kNumberOfTracks> Plane;
+
+		Plane onOff;
+		Plane probability;
+		Plane flam;
+		Plane repeatOnOff;
+		Plane repeatLo; // The 2 bit note repeat value, low and high bit
+		Plane repeatHi;
+
+		// Build the planes from the 12 * 64 step bytes of the pattern data, and back. toStepBytes writes only the kModelledBits
+		// and keeps the other bits of the step bytes, so decoding and encoding over the original data is lossless
+		void fromStepBytes(uint8 const *stepBytes);
+		void toStepBytes(uint8 *stepBytes) const;
+		uint8 stepByte(int trackNo, int stepNo) const;
+		void setStepByte(int trackNo, int stepNo, uint8 stepByte);
+		static uint64 onOffMask(uint8 const *trackStepBytes); // The on/off plane of a single track from its 64 step bytes
+
+		// Queries
+		int density(int trackNo) const; // Number of steps switched on in this track
+		int totalDensity() const;
+		int usedLength(int trackNo) const; // The last step switched on plus one, 0 for an empty track
+		int usedLength() const; // The same over all tracks
+		static int hammingDistance(RD8StepPlanes const &a, RD8StepPlanes const &b); // Number of steps differing in their on/off state
+		static float jaccardSimilarity(RD8StepPlanes const &a, RD8StepPlanes const &b); // Shared on steps divided by steps on in either, 1.0 for two empty patterns
+
+		bool operator==(RD8StepPlanes const &other) const;
+		bool operator!=(RD8StepPlanes const &other) const;
+	};
+
+	int popcount64(uint64 word);
+
+}
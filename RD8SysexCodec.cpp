@@ -0,0 +1,124 @@
+#include "RD8SysexCodec.h"
+
+namespace midikraft {
+
+	namespace {
+		const uint64 kBytesLow7 = 0x7f7f7f7f7f7f7f7fULL;
+		const uint64 kBytesHigh = 0x8080808080808080ULL;
+		const uint64 kBroadcast = 0x0101010101010101ULL;
+		const uint64 kBitPerByte = 0x8040201008040201ULL; // Byte i selects bit i
+		const uint64 kGatherMsb = 0x0102040810204000ULL; // Moves bit 8 * i + 7 to bit 56 + i
+
+		// Spread the bits of the msb byte into the top bit of each byte of the word, bit i going to byte i
+		inline uint64 spreadMsbs(uint8 msbs) {
+			return (((msbs * kBroadcast) & kBitPerByte) + kBytesLow7) & kBytesHigh;
+		}
+
+		// The inverse - collect the top bit of byte i into bit i of the result. Byte 7 must be clear
+		inline uint8 gatherMsbs(uint64 word) {
+			return (uint8) ((((word & kBytesHigh) >> 7) * kGatherMsb) >> 56);
+		}
+
+		inline uint64 load(uint8 const *input, size_t bytes) {
+			uint64 word = 0;
+			memcpy(&word, input, bytes);
+			return word;
+		}
+
+		inline void store(uint8 *output, uint64 word, size_t bytes) {
+			memcpy(output, &word, bytes);
+		}
+	}
+
+	size_t RD8SysexCodec::unescapedSize(size_t escapedSize)
+	{
+		size_t remainder = escapedSize % 8;
+		return (escapedSize / 8) * 7 + (remainder > 0 ? remainder - 1 : 0);
+	}
+
+	size_t RD8SysexCodec::escapedSize(size_t unescapedSize)
+	{
+		size_t remainder = unescapedSize % 7;
+		return (unescapedSize / 7) * 8 + (remainder > 0 ? remainder + 1 : 0);
+	}
+
+	size_t RD8SysexCodec::unescape(uint8 const *input, size_t inputSize, uint8 *output)
+	{
+		size_t fullGroups = inputSize / 8;
+#if JUCE_LITTLE_ENDIAN
+		for (size_t group = 0; group < fullGroups; group++) {
+			uint64 word = load(input + group * 8, 8);
+			uint64 data = word >> 8;
+			store(output + group * 7, data | spreadMsbs((uint8) word), 7);
+		}
+#else
+		for (size_t group = 0; group < fullGroups; group++) {
+			uint8 msbs = input[group * 8];
+			for (int i = 0; i < 7; i++) {
+				output[group * 7 + i] = input[group * 8 + 1 + i] | ((msbs & (1 << i)) << (7 - i));
+			}
+		}
+#endif
+		// The trailing partial group, if any
+		size_t remainder = inputSize % 8;
+		if (remainder > 1) {
+			uint8 const *tail = input + fullGroups * 8;
+			for (size_t i = 0; i < remainder - 1; i++) {
+				output[fullGroups * 7 + i] = tail[1 + i] | ((tail[0] & (1 << i)) << (7 - i));
+			}
+		}
+		return unescapedSize(inputSize);
+	}
+
+	size_t RD8SysexCodec::escape(uint8 const *input, size_t inputSize, uint8 *output)
+	{
+		size_t fullGroups = inputSize / 7;
+#if JUCE_LITTLE_ENDIAN
+		for (size_t group = 0; group < fullGroups; group++) {
+			uint64 word = load(input + group * 7, 7);
+			store(output + group * 8, ((word & kBytesLow7) << 8) | gatherMsbs(word), 8);
+		}
+#else
+		for (size_t group = 0; group < fullGroups; group++) {
+			uint8 msb = 0;
+			for (int i = 0; i < 7; i++) {
+				uint8 byte = input[group * 7 + i];
+				output[group * 8 + 1 + i] = byte & 0x7f;
+				msb |= (byte & 0x80) >> (7 - i);
+			}
+			output[group * 8] = msb;
+		}
+#endif
+		size_t remainder = inputSize % 7;
+		if (remainder > 0) {
+			uint8 const *tail = input + fullGroups * 7;
+			uint8 *out = output + fullGroups * 8;
+			uint8 msb = 0;
+			for (size_t i = 0; i < remainder; i++) {
+				out[1 + i] = tail[i] & 0x7f;
+				msb |= (tail[i] & 0x80) >> (7 - i);
+			}
+			out[0] = msb;
+		}
+		return escapedSize(inputSize);
+	}
+
+	std::vector<uint8> RD8SysexCodec::unescape(uint8 const *input, size_t inputSize)
+	{
+		std::vector<uint8> result(unescapedSize(inputSize));
+		if (!result.empty()) {
+			unescape(input, inputSize, result.data());
+		}
+		return result;
+	}
+
+	std::vector<uint8> RD8SysexCodec::escape(uint8 const *input, size_t inputSize)
+	{
+		std::vector<uint8> result(escapedSize(inputSize));
+		if (!result.empty()) {
+			escape(input, inputSize, result.data());
+		}
+		return result;
+	}
+
+}
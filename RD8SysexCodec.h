@@ -0,0 +1,24 @@
+#pragma once
+
+#include "JuceHeader.h"
+
+namespace midikraft {
+
+	// The RD8 transports its 8 bit data in groups of 7 bytes, each group preceded by one byte carrying the 7 most significant bits.
+	// This codec processes a complete group per step with 64 bit word operations, and writes into caller provided memory.
+	class RD8SysexCodec {
+	public:
+		// Exact output sizes. Note that a trailing partial group of r escaped bytes carries only r - 1 data bytes
+		static size_t unescapedSize(size_t escapedSize);
+		static size_t escapedSize(size_t unescapedSize);
+
+		// Both functions require the output to hold exactly the number of bytes given by the size functions above, and return that number
+		static size_t unescape(uint8 const *input, size_t inputSize, uint8 *output);
+		static size_t escape(uint8 const *input, size_t inputSize, uint8 *output);
+
+		// Convenience versions that allocate the result once at its exact size
+		static std::vector<uint8> unescape(uint8 const *input, size_t inputSize);
+		static std::vector<uint8> escape(uint8 const *input, size_t inputSize);
+	};
+
+}
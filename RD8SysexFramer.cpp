@@ -0,0 +1,113 @@
+#include "RD8SysexFramer.h"
+
+#include "RD8.h"
+
+namespace midikraft {
+
+	namespace {
+		// The header checked by isOwnSysex
+		const uint8 kRD8Header[] = { 0x00, 0x20, BEHRINGER_ID, RD8_ID };
+	}
+
+	RD8SysexFramer::RD8SysexFramer(BehringerRD8 const *rd8, DataFileCallback onDataFile, int dataTypeID, size_t capacity) :
+		rd8_(rd8), onDataFile_(onDataFile), dataTypeID_(dataTypeID), frame_(capacity)
+	{
+		jassert(capacity > sizeof(kRD8Header));
+	}
+
+	void RD8SysexFramer::push(uint8 const *data, size_t size)
+	{
+		statistics_.bytes += size;
+		for (size_t i = 0; i < size; i++) {
+			uint8 byte = data[i];
+			if (byte >= 0xf8) {
+				// Realtime messages may appear anywhere, even inside sysex
+				continue;
+			}
+			if (byte == 0xf0) {
+				// A skipped frame has been counted as foreign or too long already
+				if (state_ == State::Collecting) {
+					statistics_.truncatedFrames++;
+				}
+				statistics_.frames++;
+				state_ = State::Collecting;
+				frameLength_ = 0;
+			}
+			else if (byte == 0xf7) {
+				if (state_ == State::Collecting) {
+					frameComplete();
+				}
+				state_ = State::Idle;
+			}
+			else if (byte & 0x80) {
+				// Any other status byte ends a sysex message without F7
+				if (state_ == State::Collecting) {
+					statistics_.truncatedFrames++;
+				}
+				state_ = State::Idle;
+			}
+			else if (state_ == State::Collecting) {
+				collect(byte);
+			}
+		}
+	}
+
+	void RD8SysexFramer::collect(uint8 byte)
+	{
+		if (frameLength_ < sizeof(kRD8Header) && byte != kRD8Header[frameLength_]) {
+			// Not ours, no need to keep the rest
+			statistics_.foreignFrames++;
+			state_ = State::Skipping;
+			return;
+		}
+		if (frameLength_ == frame_.size()) {
+			statistics_.truncatedFrames++;
+			state_ = State::Skipping;
+			return;
+		}
+		frame_[frameLength_++] = byte;
+	}
+
+	void RD8SysexFramer::frameComplete()
+	{
+		uint8 const *sysexData = frame_.data();
+		int dataType = BehringerRD8::dataTypeOfSysex(sysexData, frameLength_);
+		if (dataType == -1 || (dataTypeID_ != -1 && dataType != dataTypeID_)) {
+			return;
+		}
+		auto dataFile = rd8_->dataFileFromSysex(sysexData, frameLength_);
+		if (dataFile) {
+			statistics_.dataFiles++;
+			onDataFile_(dataFile);
+		}
+	}
+
+	bool RD8SysexFramer::pushFile(File const &file, size_t chunkSize)
+	{
+		FileInputStream in(file);
+		if (!in.openedOk()) {
+			return false;
+		}
+		std::vector<uint8> chunk(chunkSize);
+		while (!in.isExhausted()) {
+			int bytesRead = in.read(chunk.data(), (int) chunk.size());
+			if (bytesRead <= 0) {
+				break;
+			}
+			push(chunk.data(), (size_t) bytesRead);
+		}
+		return true;
+	}
+
+	void RD8SysexFramer::reset()
+	{
+		state_ = State::Idle;
+		frameLength_ = 0;
+	}
+
+	RD8SysexFramer::Statistics const & RD8SysexFramer::statistics() const
+	{
+		return statistics_;
+	}
+
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "RD8Pattern.h"
+
+namespace midikraft {
+
+	class BehringerRD8;
+
+	// Incremental parser for raw MIDI byte streams, e.g. captured logs, pipes or sockets. Push chunks of any size, and each
+	// complete RD8 data dump is decoded and handed to the callback as soon as its F7 arrives.
+	// Sysex messages of other devices are recognized by their first header bytes and skipped without being buffered.
+	// Memory use is fixed: a frame is collected in a buffer of the given capacity that starts over at each F0, longer frames are dropped.
+	class RD8SysexFramer {
+	public:
+		typedef std::function<void(std::shared_ptr<RD8DataFile> dataFile)> DataFileCallback;
+
+		struct Statistics {
+			uint64 bytes = 0;
+			uint64 frames = 0; // All sysex messages seen
+			uint64 foreignFrames = 0; // Not from an RD8
+			uint64 truncatedFrames = 0; // RD8 frames interrupted by a status byte, or too long for the buffer
+			uint64 dataFiles = 0; // Decoded and passed to the callback
+		};
+
+		// Pass a data type ID to only receive data files of that type, or -1 for all
+		RD8SysexFramer(BehringerRD8 const *rd8, DataFileCallback onDataFile, int dataTypeID = -1, size_t capacity = 65536);
+
+		void push(uint8 const *data, size_t size);
+		bool pushFile(File const &file, size_t chunkSize = 65536); // Streams the file through push()
+		void reset(); // Drop a partial frame
+
+		Statistics const &statistics() const;
+
+	private:
+		enum class State { Idle, Collecting, Skipping };
+
+		void collect(uint8 byte);
+		void frameComplete();
+
+		BehringerRD8 const *rd8_;
+		DataFileCallback onDataFile_;
+		int dataTypeID_;
+
+		State state_ = State::Idle;
+		std::vector<uint8> frame_; // Allocated once
+		size_t frameLength_ = 0;
+		Statistics statistics_;
+	};
+
+}
@@ -0,0 +1,282 @@
+#include "RD8VirtualDevice.h"
+
+#include "RD8.h"
+#include "RD8SysexCodec.h"
+
+#include <tuple>
+
+namespace midikraft {
+
+	namespace {
+		const uint8 kFirmware[3] = { 1, 0, 4 };
+
+		// An empty pattern the device would report after a factory reset
+		std::vector<uint8> emptyPattern()
+		{
+			std::vector<uint8> result(RD8Pattern::kPatternDataSize, 0);
+			result[1] = 0x08; // Product variant
+			result[804] = 120; // Tempo
+			result[805] = 50; // Swing
+			result[806] = 100; // Probability
+			return result;
+		}
+
+		std::vector<uint8> defaultSettings()
+		{
+			std::vector<uint8> result(128, 0);
+			result[1] = 0x08; // Product variant
+			for (int i = 0; i < 11; i++) {
+				result[14 + i] = (uint8) (36 + i); // Note mapping
+			}
+			result[40] = 120; // Global tempo
+			result[41] = 50; // Global swing
+			return result;
+		}
+	}
+
+	bool RD8VirtualDevice::ScheduledReply::operator>(ScheduledReply const &other) const
+	{
+		return std::tie(dueMS, sequence) > std::tie(other.dueMS, other.sequence);
+	}
+
+	RD8VirtualDevice::RD8VirtualDevice(uint8 deviceID, Behaviour behaviour, int64 randomSeed) : Thread("RD8VirtualDevice"),
+		deviceID_(deviceID), behaviour_(behaviour), random_(randomSeed),
+		storedPatterns_(256, emptyPattern()), storedSongs_(16, std::vector<uint8>(64, 0)), livePattern_(emptyPattern()), liveSong_(64, 0), settings_(defaultSettings())
+	{
+		startThread();
+	}
+
+	RD8VirtualDevice::~RD8VirtualDevice()
+	{
+		stopThread(1000);
+	}
+
+	void RD8VirtualDevice::setBehaviour(Behaviour behaviour)
+	{
+		ScopedLock lock(lock_);
+		behaviour_ = behaviour;
+	}
+
+	RD8VirtualDevice::Statistics RD8VirtualDevice::statistics() const
+	{
+		ScopedLock lock(lock_);
+		return statistics_;
+	}
+
+	void RD8VirtualDevice::setStoredPattern(int itemNo, std::vector<uint8> const &patternData)
+	{
+		ScopedLock lock(lock_);
+		storedPatterns_.at((size_t) itemNo) = patternData;
+	}
+
+	std::vector<uint8> RD8VirtualDevice::storedPattern(int itemNo) const
+	{
+		ScopedLock lock(lock_);
+		return storedPatterns_.at((size_t) itemNo);
+	}
+
+	void RD8VirtualDevice::setStoredSong(int songNo, std::vector<uint8> const &songData)
+	{
+		ScopedLock lock(lock_);
+		storedSongs_.at((size_t) songNo) = songData;
+	}
+
+	std::vector<uint8> RD8VirtualDevice::storedSong(int songNo) const
+	{
+		ScopedLock lock(lock_);
+		return storedSongs_.at((size_t) songNo);
+	}
+
+	void RD8VirtualDevice::setLivePattern(std::vector<uint8> const &patternData)
+	{
+		ScopedLock lock(lock_);
+		livePattern_ = patternData;
+	}
+
+	void RD8VirtualDevice::setSettings(std::vector<uint8> const &settingsData)
+	{
+		ScopedLock lock(lock_);
+		settings_ = settingsData;
+	}
+
+	std::vector<uint8> RD8VirtualDevice::settings() const
+	{
+		ScopedLock lock(lock_);
+		return settings_;
+	}
+
+	RD8MidiTransport::ReceiverID RD8VirtualDevice::addReceiver(Receiver receiver)
+	{
+		ScopedLock lock(lock_);
+		ReceiverID receiverID = nextReceiverID_++;
+		receivers_[receiverID] = receiver;
+		return receiverID;
+	}
+
+	void RD8VirtualDevice::removeReceiver(ReceiverID receiverID)
+	{
+		ScopedLock lock(lock_);
+		receivers_.erase(receiverID);
+	}
+
+	void RD8VirtualDevice::send(std::vector<MidiMessage> const &messages)
+	{
+		ScopedLock lock(lock_);
+		for (auto const &message : messages) {
+			if (message.isSysEx()) {
+				handleMessage(message.getSysExData(), (size_t) message.getSysExDataSize());
+			}
+		}
+		notify();
+	}
+
+	void RD8VirtualDevice::sendDebounced(MidiMessage const &message, int milliseconds)
+	{
+		// Nothing to debounce in the simulation
+		ignoreUnused(milliseconds);
+		send({ message });
+	}
+
+	void RD8VirtualDevice::handleMessage(uint8 const *sysexData, size_t size)
+	{
+		if (size < 7 || sysexData[0] != 0x00 || sysexData[1] != 0x20 || sysexData[2] != BEHRINGER_ID || sysexData[3] != RD8_ID || sysexData[4] != deviceID_) {
+			// Not for us
+			return;
+		}
+		uint8 messageType = sysexData[5];
+		uint8 messageID = sysexData[6];
+		if (messageType == RD8_FIRMWARE_MESSAGE && messageID == RD8_REQUEST) {
+			statistics_.requestsReceived++;
+			// Bytes 7 to 10 are reserved, followed by the firmware version
+			auto firmware = header(RD8_FIRMWARE_MESSAGE, RD8_REPLY);
+			firmware.insert(firmware.end(), { 0, 0, 0, 0, kFirmware[0], kFirmware[1], kFirmware[2] });
+			schedule(std::move(firmware));
+			return;
+		}
+		if (messageType != RD8_DATA_MESSAGE || size < 14) {
+			return;
+		}
+		uint8 const *payload = sysexData + 14;
+		size_t payloadSize = size - 14;
+		switch (messageID) {
+		case RD8_STORED_PATTERN_REQUEST:
+			statistics_.requestsReceived++;
+			if (payloadSize >= 2 && sysexData[14] < 16 && sysexData[15] < 16) {
+				replyData(RD8_STORED_PATTERN_RESPONSE, { sysexData[14], sysexData[15] }, storedPatterns_[sysexData[14] * 16 + sysexData[15]]);
+			}
+			break;
+		case RD8_STORED_SONG_REQUEST:
+			statistics_.requestsReceived++;
+			if (payloadSize >= 1 && sysexData[14] < 16) {
+				replyData(RD8_STORED_SONG_RESPONSE, { sysexData[14] }, storedSongs_[sysexData[14]]);
+			}
+			break;
+		case RD8_LIVE_PATTERN_REQUEST:
+			statistics_.requestsReceived++;
+			replyData(RD8_LIVE_PATTERN_RESPONSE, {}, livePattern_);
+			break;
+		case RD8_LIVE_SONG_REQUEST:
+			statistics_.requestsReceived++;
+			replyData(RD8_LIVE_SONG_RESPONSE, {}, liveSong_);
+			break;
+		case RD8_GLOBAL_SETTINGS_REQUEST:
+			statistics_.requestsReceived++;
+			replyData(RD8_GLOBAL_SETTINGS_RESPONSE, {}, settings_);
+			break;
+		// Dumps sent to the device are stored
+		case RD8_STORED_PATTERN_RESPONSE:
+			if (payloadSize >= 2 && payload[0] < 16 && payload[1] < 16) {
+				statistics_.dumpsReceived++;
+				storedPatterns_[payload[0] * 16 + payload[1]] = RD8SysexCodec::unescape(payload + 2, payloadSize - 2);
+			}
+			break;
+		case RD8_STORED_SONG_RESPONSE:
+			if (payloadSize >= 1 && payload[0] < 16) {
+				statistics_.dumpsReceived++;
+				storedSongs_[payload[0]] = RD8SysexCodec::unescape(payload + 1, payloadSize - 1);
+			}
+			break;
+		case RD8_LIVE_PATTERN_RESPONSE:
+			statistics_.dumpsReceived++;
+			livePattern_ = RD8SysexCodec::unescape(payload, payloadSize);
+			break;
+		case RD8_LIVE_SONG_RESPONSE:
+			statistics_.dumpsReceived++;
+			liveSong_ = RD8SysexCodec::unescape(payload, payloadSize);
+			break;
+		case RD8_GLOBAL_SETTINGS_RESPONSE:
+			statistics_.dumpsReceived++;
+			settings_ = RD8SysexCodec::unescape(payload, payloadSize);
+			break;
+		default:
+			break;
+		}
+	}
+
+	void RD8VirtualDevice::replyData(uint8 messageID, std::vector<uint8> const &itemBytes, std::vector<uint8> const &data)
+	{
+		auto sysexData = header(RD8_DATA_MESSAGE, messageID);
+		sysexData.insert(sysexData.end(), itemBytes.begin(), itemBytes.end());
+		size_t headerSize = sysexData.size();
+		sysexData.resize(headerSize + RD8SysexCodec::escapedSize(data.size()));
+		RD8SysexCodec::escape(data.data(), data.size(), sysexData.data() + headerSize);
+		schedule(std::move(sysexData));
+	}
+
+	void RD8VirtualDevice::schedule(std::vector<uint8> &&sysexData)
+	{
+		if (behaviour_.dropRate > 0.0f && random_.nextFloat() < behaviour_.dropRate) {
+			statistics_.repliesDropped++;
+			return;
+		}
+		double delay = behaviour_.latencyMS + (behaviour_.jitterMS > 0 ? random_.nextInt(behaviour_.jitterMS + 1) : 0);
+		replies_.push({ Time::getMillisecondCounterHiRes() + delay, nextSequence_++, std::move(sysexData) });
+	}
+
+	std::vector<uint8> RD8VirtualDevice::header(uint8 messageType, uint8 messageID) const
+	{
+		std::vector<uint8> result({ 0x00, 0x20, BEHRINGER_ID, RD8_ID, deviceID_, messageType, messageID });
+		if (messageType == RD8_DATA_MESSAGE) {
+			result.insert(result.end(), { 0x30, 0x00, 0x00, 0x00, kFirmware[0], kFirmware[1], kFirmware[2] });
+		}
+		return result;
+	}
+
+	void RD8VirtualDevice::run()
+	{
+		while (!threadShouldExit()) {
+			std::vector<uint8> due;
+			std::vector<Receiver> receivers;
+			int waitMS = 50;
+			{
+				ScopedLock lock(lock_);
+				if (!replies_.empty()) {
+					double now = Time::getMillisecondCounterHiRes();
+					if (replies_.top().dueMS <= now) {
+						due = replies_.top().sysexData;
+						replies_.pop();
+						statistics_.repliesSent++;
+						for (auto const &receiver : receivers_) {
+							receivers.push_back(receiver.second);
+						}
+						waitMS = 0;
+					}
+					else {
+						waitMS = jmax(1, (int) (replies_.top().dueMS - now));
+					}
+				}
+			}
+			if (!due.empty()) {
+				// Deliver outside of the lock, the receivers will likely send the next request right away
+				auto message = MidiMessage::createSysExMessage(due.data(), (int) due.size());
+				for (auto const &receiver : receivers) {
+					receiver(message);
+				}
+			}
+			if (waitMS > 0) {
+				wait(waitMS);
+			}
+		}
+	}
+
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "RD8MidiTransport.h"
+
+#include <queue>
+
+namespace midikraft {
+
+	// An in-process simulation of an RD8, answering firmware, pattern, song and settings requests like the device does.
+	// Use it as the transport of a BehringerRD8 to run and load test the transaction code without hardware, e.g. on a CI machine.
+	// Replies are delivered from a background thread after the configured latency, like MIDI input would be.
+	class RD8VirtualDevice : public RD8MidiTransport, private Thread {
+	public:
+		struct Behaviour {
+			int latencyMS = 5; // Time from request to reply
+			int jitterMS = 0; // Random additional latency between 0 and this
+			float dropRate = 0.0f; // Probability that a reply gets lost
+		};
+
+		struct Statistics {
+			int requestsReceived;
+			int repliesSent;
+			int repliesDropped;
+			int dumpsReceived; // Data sent to the device
+		};
+
+		RD8VirtualDevice(uint8 deviceID, Behaviour behaviour, int64 randomSeed = 1);
+		virtual ~RD8VirtualDevice() override;
+
+		void setBehaviour(Behaviour behaviour);
+		Statistics statistics() const;
+
+		// The memory of the simulated device, as unescaped data
+		void setStoredPattern(int itemNo, std::vector<uint8> const &patternData);
+		std::vector<uint8> storedPattern(int itemNo) const;
+		void setStoredSong(int songNo, std::vector<uint8> const &songData);
+		std::vector<uint8> storedSong(int songNo) const;
+		void setLivePattern(std::vector<uint8> const &patternData);
+		void setSettings(std::vector<uint8> const &settingsData);
+		std::vector<uint8> settings() const;
+
+		// RD8MidiTransport, this is the host side talking to the simulated device
+		virtual ReceiverID addReceiver(Receiver receiver) override;
+		virtual void removeReceiver(ReceiverID receiverID) override;
+		virtual void send(std::vector<MidiMessage> const &messages) override;
+		virtual void sendDebounced(MidiMessage const &message, int milliseconds) override;
+
+	private:
+		struct ScheduledReply {
+			double dueMS;
+			uint64 sequence; // Keep the order of replies due at the same time
+			std::vector<uint8> sysexData;
+
+			bool operator>(ScheduledReply const &other) const;
+		};
+
+		void run() override;
+		void handleMessage(uint8 const *sysexData, size_t size); // Call with lock held
+		void replyData(uint8 messageID, std::vector<uint8> const &itemBytes, std::vector<uint8> const &data); // Call with lock held
+		void schedule(std::vector<uint8> &&sysexData); // Call with lock held
+		std::vector<uint8> header(uint8 messageType, uint8 messageID) const;
+
+		uint8 deviceID_;
+		Behaviour behaviour_;
+		Random random_;
+
+		CriticalSection lock_;
+		Statistics statistics_ = { 0, 0, 0, 0 };
+		std::vector<std::vector<uint8>> storedPatterns_;
+		std::vector<std::vector<uint8>> storedSongs_;
+		std::vector<uint8> livePattern_;
+		std::vector<uint8> liveSong_;
+		std::vector<uint8> settings_;
+
+		std::priority_queue<ScheduledReply, std::vector<ScheduledReply>, std::greater<ScheduledReply>> replies_;
+		uint64 nextSequence_ = 0;
+		std::map<ReceiverID, Receiver> receivers_;
+		ReceiverID nextReceiverID_ = 1;
+	};
+
+}
@@ -0,0 +1,303 @@
+#include "RD8.h"
+#include "RD8Pattern.h"
+#include "RD8PatternEncoder.h"
+#include "RD8SimilarityIndex.h"
+#include "RD8SysexCodec.h"
+#include "RD8TestData.h"
+#include "RD8VirtualDevice.h"
+
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <random>
+
+using namespace midikraft;
+
+namespace {
+
+	// Synthetic, but realistic data: a pattern with about a quarter of the steps set, and typical parameter values
+	std::vector<uint8> makePatternData(uint32 seed)
+	{
+		std::mt19937 random(seed);
+		std::vector<uint8> data(RD8Pattern::kPatternDataSize, 0);
+		data[0] = 0x00; // Data version
+		data[1] = 0x08; // Product variant
+		for (int i = 0; i < RD8Pattern::kNumberOfTracks * RD8Pattern::kNumberOfSteps; i++) {
+			uint32 bits = random();
+			uint8 step = (bits & 3) == 0 ? 0x01 : 0x00;
+			if (step && (bits & 0x30) == 0) step |= 0x04; // probability
+			if (step && (bits & 0xc0) == 0) step |= 0x08; // flam
+			if (step && (bits & 0x300) == 0) step |= 0x10 | (uint8) (((bits >> 10) & 3) << 5); // note repeat
+			data[2 + i] = step;
+		}
+		data[804] = (uint8) (90 + random() % 60); // Tempo
+		data[805] = 50; // Swing
+		data[806] = 100; // Probability
+		data[807] = 12; // Flam level
+		for (int i = 0; i < 64; i++) data[811 + i] = (uint8) (random() & 0x7f); // Filter steps
+		return data;
+	}
+
+	std::vector<uint8> makeStoredPatternSysex(BehringerRD8 const &rd8, int itemNo)
+	{
+		auto message = rd8.createRequestMessage(BehringerRD8::MessageID({ RD8_DATA_MESSAGE, RD8_STORED_PATTERN_RESPONSE }));
+		message.push_back((uint8) (itemNo / 16));
+		message.push_back((uint8) (itemNo % 16));
+		auto data = makePatternData((uint32) itemNo);
+		auto escaped = RD8SysexCodec::escape(data.data(), data.size());
+		message.insert(message.end(), escaped.begin(), escaped.end());
+		return message;
+	}
+
+	std::vector<uint8> makeSettingsSysex(BehringerRD8 const &rd8)
+	{
+		auto message = rd8.createRequestMessage(BehringerRD8::MessageID({ RD8_DATA_MESSAGE, RD8_GLOBAL_SETTINGS_RESPONSE }));
+		std::vector<uint8> data(128);
+		for (size_t i = 0; i < data.size(); i++) data[i] = (uint8) (i * 37);
+		auto escaped = RD8SysexCodec::escape(data.data(), data.size());
+		message.insert(message.end(), escaped.begin(), escaped.end());
+		return message;
+	}
+
+	// A backup of all 256 stored patterns plus the settings
+	std::vector<MidiMessage> makeArchive(BehringerRD8 const &rd8)
+	{
+		std::vector<MidiMessage> result;
+		for (int i = 0; i < 256; i++) {
+			auto sysex = makeStoredPatternSysex(rd8, i);
+			result.push_back(MidiMessage::createSysExMessage(sysex.data(), (int) sysex.size()));
+		}
+		auto settings = makeSettingsSysex(rd8);
+		result.push_back(MidiMessage::createSysExMessage(settings.data(), (int) settings.size()));
+		return result;
+	}
+
+	// A library of random step masks, and queries that are library patterns with some steps changed. Either masks over all 64 steps
+	// with about a quarter of them on and 15 steps changed, or sparse 16 step patterns with 3 steps changed
+	struct SimilarityLibrary {
+		std::vector<RD8StepPlanes> patterns;
+		std::vector<RD8StepPlanes> queries;
+	};
+
+	SimilarityLibrary makeSimilarityLibrary(size_t numberOfPatterns, bool sparse)
+	{
+		std::mt19937 random(7);
+		SimilarityLibrary result;
+		for (size_t i = 0; i < numberOfPatterns; i++) {
+			result.patterns.push_back(sparse ? RD8TestData::sparsePlanes(random) : RD8TestData::randomPlanes(random));
+		}
+		for (int i = 0; i < 100; i++) {
+			auto const &pattern = result.patterns[random() % numberOfPatterns];
+			result.queries.push_back(sparse ? RD8TestData::changeSteps(pattern, 3, random, 16) : RD8TestData::changeSteps(pattern, 15, random));
+		}
+		return result;
+	}
+
+	std::vector<uint8> randomBytes(size_t size)
+	{
+		std::mt19937 random(42);
+		std::vector<uint8> result(size);
+		for (auto &byte : result) byte = (uint8) random();
+		return result;
+	}
+
+}
+
+static void BM_Escape(benchmark::State &state)
+{
+	auto input = randomBytes((size_t) state.range(0));
+	std::vector<uint8> output(RD8SysexCodec::escapedSize(input.size()));
+	for (auto _ : state) {
+		RD8SysexCodec::escape(input.data(), input.size(), output.data());
+		benchmark::DoNotOptimize(output.data());
+	}
+	state.SetBytesProcessed((int64_t) state.iterations() * (int64_t) input.size());
+}
+BENCHMARK(BM_Escape)->Arg(128)->Arg(889)->Arg(1 << 16);
+
+static void BM_Unescape(benchmark::State &state)
+{
+	auto input = randomBytes((size_t) state.range(0));
+	for (auto &byte : input) byte &= 0x7f;
+	std::vector<uint8> output(RD8SysexCodec::unescapedSize(input.size()));
+	for (auto _ : state) {
+		RD8SysexCodec::unescape(input.data(), input.size(), output.data());
+		benchmark::DoNotOptimize(output.data());
+	}
+	state.SetBytesProcessed((int64_t) state.iterations() * (int64_t) input.size());
+}
+BENCHMARK(BM_Unescape)->Arg(147)->Arg(1016)->Arg(1 << 16);
+
+static void BM_GetPattern(benchmark::State &state)
+{
+	BehringerRD8 rd8;
+	auto sysex = makeStoredPatternSysex(rd8, 17);
+	RD8StoredPattern pattern(&rd8);
+	pattern.dataFromSysexData(sysex.data(), sysex.size());
+	for (auto _ : state) {
+		auto decoded = pattern.getPattern();
+		benchmark::DoNotOptimize(decoded.get());
+	}
+}
+BENCHMARK(BM_GetPattern);
+
+static void BM_GetPatternInto(benchmark::State &state)
+{
+	BehringerRD8 rd8;
+	auto sysex = makeStoredPatternSysex(rd8, 17);
+	RD8StoredPattern pattern(&rd8);
+	pattern.dataFromSysexData(sysex.data(), sysex.size());
+	RD8Pattern::PatternData decoded;
+	for (auto _ : state) {
+		pattern.getPattern(decoded);
+		benchmark::DoNotOptimize(&decoded);
+	}
+}
+BENCHMARK(BM_GetPatternInto);
+
+static void BM_EncodeStoredPattern(benchmark::State &state)
+{
+	BehringerRD8 rd8;
+	auto sysex = makeStoredPatternSysex(rd8, 17);
+	RD8StoredPattern pattern(&rd8);
+	pattern.dataFromSysexData(sysex.data(), sysex.size());
+	RD8Pattern::PatternData decoded;
+	pattern.getPattern(decoded);
+	RD8PatternEncoder encoder(&rd8);
+	std::vector<uint8> buffer(RD8PatternEncoder::storedPatternSysexSize());
+	for (auto _ : state) {
+		size_t size = encoder.encodeStoredPattern(decoded, 17, buffer);
+		benchmark::DoNotOptimize(buffer.data());
+		benchmark::DoNotOptimize(size);
+	}
+}
+BENCHMARK(BM_EncodeStoredPattern);
+
+static void BM_IsDataFile(benchmark::State &state)
+{
+	BehringerRD8 rd8;
+	auto archive = makeArchive(rd8);
+	for (auto _ : state) {
+		int found = 0;
+		for (auto const &message : archive) {
+			found += rd8.isDataFile(message, BehringerRD8::STORED_PATTERN) ? 1 : 0;
+		}
+		benchmark::DoNotOptimize(found);
+	}
+	state.SetItemsProcessed((int64_t) state.iterations() * (int64_t) archive.size());
+}
+BENCHMARK(BM_IsDataFile);
+
+static void BM_LoadData(benchmark::State &state)
+{
+	BehringerRD8 rd8;
+	auto archive = makeArchive(rd8);
+	for (auto _ : state) {
+		auto loaded = rd8.loadData(archive, BehringerRD8::STORED_PATTERN);
+		benchmark::DoNotOptimize(loaded.data());
+	}
+	state.SetItemsProcessed((int64_t) state.iterations() * (int64_t) archive.size());
+}
+BENCHMARK(BM_LoadData);
+
+static void BM_PatchFromPatchData(benchmark::State &state)
+{
+	BehringerRD8 rd8;
+	auto sysex = makeStoredPatternSysex(rd8, 200);
+	for (auto _ : state) {
+		auto patch = rd8.patchFromPatchData(sysex, MidiProgramNumber::fromZeroBase(0));
+		benchmark::DoNotOptimize(patch.get());
+	}
+}
+BENCHMARK(BM_PatchFromPatchData);
+
+static void BM_SimilarityNearest(benchmark::State &state)
+{
+	auto library = makeSimilarityLibrary((size_t) state.range(0), state.range(1) != 0);
+	RD8SimilarityIndex index{ RD8SimilarityIndex::Options() };
+	for (auto const &pattern : library.patterns) {
+		index.add(pattern);
+	}
+	index.build();
+	size_t query = 0;
+	for (auto _ : state) {
+		auto matches = index.nearest(library.queries[query++ % library.queries.size()], 10);
+		benchmark::DoNotOptimize(matches.data());
+	}
+}
+BENCHMARK(BM_SimilarityNearest)->ArgsProduct({ { 10000, 100000 }, { 0, 1 } })->Unit(benchmark::kMicrosecond);
+
+// The linear scan nearest has to beat
+static void BM_SimilarityNearestExact(benchmark::State &state)
+{
+	auto library = makeSimilarityLibrary((size_t) state.range(0), state.range(1) != 0);
+	RD8SimilarityIndex index{ RD8SimilarityIndex::Options() };
+	for (auto const &pattern : library.patterns) {
+		index.add(pattern);
+	}
+	index.build();
+	size_t query = 0;
+	for (auto _ : state) {
+		auto matches = index.nearestExact(library.queries[query++ % library.queries.size()], 10);
+		benchmark::DoNotOptimize(matches.data());
+	}
+}
+BENCHMARK(BM_SimilarityNearestExact)->ArgsProduct({ { 10000, 100000 }, { 0, 1 } })->Unit(benchmark::kMicrosecond);
+
+// Both searches on the same queries: the speedup of nearest over the scan, and how often it found the exact nearest
+static void BM_SimilarityNearestVsScan(benchmark::State &state)
+{
+	auto library = makeSimilarityLibrary((size_t) state.range(0), state.range(1) != 0);
+	RD8SimilarityIndex index{ RD8SimilarityIndex::Options() };
+	for (auto const &pattern : library.patterns) {
+		index.add(pattern);
+	}
+	index.build();
+	double approximateSeconds = 0.0;
+	double scanSeconds = 0.0;
+	int found = 0;
+	int queries = 0;
+	for (auto _ : state) {
+		for (auto const &query : library.queries) {
+			auto start = std::chrono::steady_clock::now();
+			auto approximate = index.nearest(query, 10);
+			auto middle = std::chrono::steady_clock::now();
+			auto exact = index.nearestExact(query, 10);
+			auto end = std::chrono::steady_clock::now();
+			approximateSeconds += std::chrono::duration<double>(middle - start).count();
+			scanSeconds += std::chrono::duration<double>(end - middle).count();
+			if (!approximate.empty() && !exact.empty() && approximate[0].distance == exact[0].distance) {
+				found++;
+			}
+			queries++;
+		}
+	}
+	state.counters["speedup"] = approximateSeconds > 0.0 ? scanSeconds / approximateSeconds : 0.0;
+	state.counters["recall"] = queries > 0 ? (double) found / queries : 0.0;
+}
+BENCHMARK(BM_SimilarityNearestVsScan)->ArgsProduct({ { 100000 }, { 0, 1 } })->Unit(benchmark::kMillisecond);
+
+// End to end: back up all 256 stored patterns from a simulated device with 2 ms latency and some jitter
+static void BM_BulkFetchVirtualDevice(benchmark::State &state)
+{
+	BehringerRD8 rd8;
+	auto device = std::make_shared<RD8VirtualDevice>((uint8) 0, RD8VirtualDevice::Behaviour({ 2, 1, 0.0f }));
+	rd8.setTransport(device);
+	RD8BulkFetch::Options options;
+	options.windowSize = (int) state.range(0);
+	for (auto _ : state) {
+		WaitableEvent done;
+		size_t fetched = 0;
+		auto fetch = rd8.fetchAllDataItems(BehringerRD8::STORED_PATTERN, nullptr, [&](std::vector<std::shared_ptr<DataFile>> const &result, std::vector<int> const &failed) {
+			ignoreUnused(failed);
+			fetched = result.size();
+			done.signal();
+		}, options);
+		done.wait();
+		benchmark::DoNotOptimize(fetched);
+	}
+	state.SetItemsProcessed((int64_t) state.iterations() * 256);
+}
+BENCHMARK(BM_BulkFetchVirtualDevice)->Arg(1)->Arg(4)->Arg(16)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,90 @@
+#include "RD8Diff.h"
+
+#include "RD8TestData.h"
+
+#include <gtest/gtest.h>
+
+using namespace midikraft;
+
+namespace {
+
+	bool sameScript(RD8Diff::EditScript const &a, RD8Diff::EditScript const &b)
+	{
+		return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](RD8Diff::Edit const &x, RD8Diff::Edit const &y) {
+			return x.index == y.index && x.from == y.from && x.to == y.to;
+		});
+	}
+
+}
+
+TEST(RD8Diff, SerializeDeserializeRoundTrip)
+{
+	// Two unrelated patterns differ nearly everywhere, a pattern and a slightly edited copy only in a few bytes with long gaps
+	auto a = RD8TestData::patternData(1);
+	auto b = RD8TestData::patternData(2);
+	auto edited = a;
+	edited[3] ^= 0x01;
+	edited[500] ^= 0x01;
+	edited[RD8Pattern::kPatternDataSize - 1] ^= 0x01;
+
+	for (auto const &to : { b, edited }) {
+		auto script = RD8Diff::diff(a.data(), to.data(), a.size());
+		ASSERT_FALSE(script.empty());
+		auto serialized = RD8Diff::serialize(script);
+		RD8Diff::EditScript deserialized;
+		ASSERT_TRUE(RD8Diff::deserialize(serialized.data(), serialized.size(), deserialized));
+		EXPECT_TRUE(sameScript(script, deserialized));
+
+		// Cut off in the middle of an edit
+		RD8Diff::EditScript truncated;
+		EXPECT_FALSE(RD8Diff::deserialize(serialized.data(), serialized.size() - 1, truncated));
+	}
+}
+
+TEST(RD8Diff, ApplyIsAllOrNothing)
+{
+	auto from = RD8TestData::patternData(3);
+	auto to = RD8TestData::patternData(4);
+	auto script = RD8Diff::diff(from.data(), to.data(), from.size());
+	ASSERT_GT(script.size(), 2u);
+
+	auto data = from;
+	ASSERT_TRUE(RD8Diff::apply(script, data.data(), data.size()));
+	EXPECT_EQ(data, to);
+
+	// The last edited byte does not have the value the script expects, so nothing must be changed
+	auto modified = from;
+	modified[script.back().index] = (uint8) ~script.back().from;
+	auto before = modified;
+	EXPECT_FALSE(RD8Diff::apply(script, modified.data(), modified.size()));
+	EXPECT_EQ(modified, before);
+
+	// Same if the script reaches beyond the data
+	auto tooShort = from;
+	tooShort.resize(script.back().index);
+	auto shortBefore = tooShort;
+	EXPECT_FALSE(RD8Diff::apply(script, tooShort.data(), tooShort.size()));
+	EXPECT_EQ(tooShort, shortBefore);
+}
+
+TEST(RD8Diff, MergeConflictPolicies)
+{
+	std::vector<uint8> base = { 10, 20, 30, 40, 50, 60 };
+	std::vector<uint8> ours = { 11, 21, 30, 40, 55, 60 }; // 0 only ours, 1 both differently, 4 both the same
+	std::vector<uint8> theirs = { 10, 22, 33, 40, 55, 60 }; // 2 only theirs
+
+	struct Expected {
+		RD8Diff::ConflictPolicy policy;
+		uint8 conflicting;
+	};
+	for (auto expected : { Expected({ RD8Diff::ConflictPolicy::KeepOurs, 21 }), Expected({ RD8Diff::ConflictPolicy::KeepTheirs, 22 }),
+		Expected({ RD8Diff::ConflictPolicy::KeepBase, 20 }) }) {
+		auto result = RD8Diff::merge(base.data(), ours.data(), theirs.data(), base.size(), expected.policy);
+		EXPECT_EQ(result.merged, std::vector<uint8>({ 11, expected.conflicting, 33, 40, 55, 60 }));
+		ASSERT_EQ(result.conflicts.size(), 1u);
+		EXPECT_EQ(result.conflicts[0].index, 1);
+		EXPECT_EQ(result.conflicts[0].base, 20);
+		EXPECT_EQ(result.conflicts[0].ours, 21);
+		EXPECT_EQ(result.conflicts[0].theirs, 22);
+	}
+}
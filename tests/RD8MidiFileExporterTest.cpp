@@ -0,0 +1,99 @@
+#include "RD8MidiFileExporter.h"
+
+#include "RD8TestData.h"
+
+#include <gtest/gtest.h>
+
+#include <tuple>
+
+using namespace midikraft;
+
+namespace {
+
+	typedef std::tuple<int, int, int> Note; // Note number, tick, velocity
+
+	const int kBassDrumTrack = 1;
+	const int kSnareTrack = 2;
+	const int kClosedHatTrack = 11;
+
+	// An empty pattern, played straight at 120 bpm in sixteenths
+	RD8Pattern::PatternData emptyPattern()
+	{
+		std::vector<uint8> data(RD8Pattern::kPatternDataSize, 0);
+		data[1] = 0x08;
+		RD8Pattern::PatternData pattern;
+		EXPECT_TRUE(RD8Pattern::decodePatternData(data.data(), data.size(), pattern));
+		pattern.tempo = 120;
+		pattern.swing = 50;
+		pattern.probability = 100;
+		pattern.flamLevel = 0;
+		pattern.stepSize = 0;
+		pattern.polymeterOnOff = false;
+		return pattern;
+	}
+
+	void setStep(RD8StepPlanes::Plane &plane, int trackNo, int stepNo)
+	{
+		plane[(size_t) trackNo] |= (uint64) 1 << stepNo;
+	}
+
+	// The note ons of the MIDI track of an instrument, the tempo track comes first
+	std::vector<Note> notesOf(MidiFile const &file, int trackNo)
+	{
+		std::vector<Note> result;
+		auto track = file.getTrack(trackNo);
+		for (int i = 0; i < track->getNumEvents(); i++) {
+			auto const &message = track->getEventPointer(i)->message;
+			if (message.isNoteOn()) {
+				result.emplace_back(message.getNoteNumber(), roundToInt(message.getTimeStamp()), (int) message.getVelocity());
+			}
+		}
+		return result;
+	}
+
+	MidiFile render(RD8Pattern::PatternData const &pattern)
+	{
+		RD8MidiFileExporter::Options options; // 96 ticks per quarter note, so 24 per sixteenth
+		RD8MidiFileExporter exporter(RD8MidiFileExporter::defaultNoteMapping(), options);
+		MidiFile file;
+		exporter.renderPattern(pattern, file);
+		return file;
+	}
+
+}
+
+TEST(RD8MidiFileExporter, RendersNotesTicksAndVelocities)
+{
+	auto pattern = emptyPattern();
+	for (int step : { 0, 4, 8, 12 }) {
+		setStep(pattern.planes.onOff, kBassDrumTrack, step);
+	}
+	setStep(pattern.planes.onOff, 0, 4); // Accent
+	setStep(pattern.planes.onOff, kSnareTrack, 6);
+
+	auto file = render(pattern);
+	ASSERT_EQ(file.getNumTracks(), 1 + RD8MidiFileExporter::kNumberOfInstruments);
+	EXPECT_EQ(file.getTimeFormat(), 96);
+	EXPECT_EQ(notesOf(file, kBassDrumTrack), std::vector<Note>({ Note(36, 0, 100), Note(36, 96, 127), Note(36, 192, 100), Note(36, 288, 100) }));
+	EXPECT_EQ(notesOf(file, kSnareTrack), std::vector<Note>({ Note(38, 144, 100) }));
+	EXPECT_TRUE(notesOf(file, kClosedHatTrack).empty());
+}
+
+TEST(RD8MidiFileExporter, RendersSwingFlamAndRepeats)
+{
+	auto pattern = emptyPattern();
+	pattern.swing = 75; // Every second step is half a step late
+	pattern.flamLevel = 12; // Grace note a quarter step early, see the class comment
+	setStep(pattern.planes.onOff, kBassDrumTrack, 0);
+	setStep(pattern.planes.onOff, kBassDrumTrack, 1);
+	setStep(pattern.planes.onOff, kClosedHatTrack, 2);
+	setStep(pattern.planes.flam, kClosedHatTrack, 2);
+	setStep(pattern.planes.onOff, kSnareTrack, 4);
+	setStep(pattern.planes.repeatOnOff, kSnareTrack, 4);
+	setStep(pattern.planes.repeatLo, kSnareTrack, 4); // 3 hits, see the class comment
+
+	auto file = render(pattern);
+	EXPECT_EQ(notesOf(file, kBassDrumTrack), std::vector<Note>({ Note(36, 0, 100), Note(36, 36, 100) }));
+	EXPECT_EQ(notesOf(file, kClosedHatTrack), std::vector<Note>({ Note(42, 42, 50), Note(42, 48, 100) }));
+	EXPECT_EQ(notesOf(file, kSnareTrack), std::vector<Note>({ Note(38, 96, 100), Note(38, 104, 100), Note(38, 112, 100) }));
+}
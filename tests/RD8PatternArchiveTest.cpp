@@ -0,0 +1,138 @@
+#include "RD8PatternArchive.h"
+
+#include "RD8TestData.h"
+
+#include <gtest/gtest.h>
+
+using namespace midikraft;
+
+namespace {
+
+	// Where the fields are in the archive header, see RD8PatternArchive.cpp
+	const size_t kByteOrderAt = 8;
+	const size_t kColumnOffsetsAt = 24;
+
+	std::vector<RD8Pattern::PatternData> makePatterns(uint32 count)
+	{
+		std::vector<RD8Pattern::PatternData> patterns(count);
+		for (uint32 seed = 0; seed < count; seed++) {
+			auto data = RD8TestData::patternData(seed);
+			EXPECT_TRUE(RD8Pattern::decodePatternData(data.data(), data.size(), patterns[seed]));
+		}
+		return patterns;
+	}
+
+	bool writeArchive(std::vector<RD8Pattern::PatternData> const &patterns, File const &file)
+	{
+		RD8PatternArchive::Writer writer;
+		for (auto const &pattern : patterns) {
+			writer.add(pattern);
+		}
+		return writer.writeTo(file);
+	}
+
+	std::vector<uint8> readBytes(File const &file)
+	{
+		MemoryBlock block;
+		EXPECT_TRUE(file.loadFileAsData(block));
+		auto data = static_cast<uint8 const *>(block.getData());
+		return std::vector<uint8>(data, data + block.getSize());
+	}
+
+	uint64 columnOffset(std::vector<uint8> const &bytes, int column)
+	{
+		uint64 offset;
+		memcpy(&offset, bytes.data() + kColumnOffsetsAt + (size_t) column * sizeof(uint64), sizeof(offset));
+		return offset;
+	}
+
+	// Writes the archive with one column offset replaced and tries to open it
+	bool opensWithColumnOffset(std::vector<uint8> bytes, int column, uint64 offset, File const &file)
+	{
+		memcpy(bytes.data() + kColumnOffsetsAt + (size_t) column * sizeof(uint64), &offset, sizeof(offset));
+		EXPECT_TRUE(file.replaceWithData(bytes.data(), bytes.size()));
+		RD8PatternArchive archive;
+		return archive.open(file);
+	}
+
+}
+
+TEST(RD8PatternArchive, WriteOpenGetPatternRoundTrip)
+{
+	TemporaryFile temporary(".rd8a");
+	auto patterns = makePatterns(20);
+	ASSERT_TRUE(writeArchive(patterns, temporary.getFile()));
+
+	RD8PatternArchive archive;
+	ASSERT_TRUE(archive.open(temporary.getFile()));
+	ASSERT_EQ(archive.numberOfPatterns(), patterns.size());
+	for (size_t rowNo = 0; rowNo < patterns.size(); rowNo++) {
+		RD8Pattern::PatternData read;
+		archive.row(rowNo).getPattern(read);
+		EXPECT_TRUE(RD8TestData::samePattern(read, patterns[rowNo])) << "row " << rowNo;
+
+		// The column view sees the same rows
+		auto onOff = archive.planeColumn(RD8PatternArchive::OnOff) + rowNo * RD8Pattern::kNumberOfTracks;
+		EXPECT_TRUE(std::equal(patterns[rowNo].planes.onOff.begin(), patterns[rowNo].planes.onOff.end(), onOff)) << "row " << rowNo;
+		EXPECT_EQ(archive.byteColumn(RD8PatternArchive::Tempo)[rowNo], patterns[rowNo].tempo) << "row " << rowNo;
+	}
+	archive.close();
+}
+
+TEST(RD8PatternArchive, EmptyArchiveOpens)
+{
+	TemporaryFile temporary(".rd8a");
+	ASSERT_TRUE(writeArchive({}, temporary.getFile()));
+	RD8PatternArchive archive;
+	ASSERT_TRUE(archive.open(temporary.getFile()));
+	EXPECT_EQ(archive.numberOfPatterns(), 0u);
+}
+
+TEST(RD8PatternArchive, RejectsTheOtherByteOrder)
+{
+	TemporaryFile temporary(".rd8a");
+	ASSERT_TRUE(writeArchive(makePatterns(3), temporary.getFile()));
+	auto bytes = readBytes(temporary.getFile());
+
+	// As written by a host with the other byte order
+	std::reverse(bytes.begin() + (long) kByteOrderAt, bytes.begin() + (long) kByteOrderAt + 4);
+	ASSERT_TRUE(temporary.getFile().replaceWithData(bytes.data(), bytes.size()));
+	RD8PatternArchive archive;
+	EXPECT_FALSE(archive.open(temporary.getFile()));
+	EXPECT_EQ(archive.numberOfPatterns(), 0u);
+}
+
+TEST(RD8PatternArchive, RejectsTruncatedFiles)
+{
+	TemporaryFile temporary(".rd8a");
+	ASSERT_TRUE(writeArchive(makePatterns(3), temporary.getFile()));
+	auto bytes = readBytes(temporary.getFile());
+
+	// The last column is one byte short, then the header itself is cut off
+	for (size_t size : { bytes.size() - 1, bytes.size() - RD8Pattern::kNumberOfSteps, kColumnOffsetsAt, (size_t) 3 }) {
+		ASSERT_TRUE(temporary.getFile().replaceWithData(bytes.data(), size));
+		RD8PatternArchive archive;
+		EXPECT_FALSE(archive.open(temporary.getFile())) << "size " << size;
+	}
+}
+
+TEST(RD8PatternArchive, RejectsColumnOffsetsOutOfRange)
+{
+	TemporaryFile temporary(".rd8a");
+	// Enough rows that no column fits into the last 8 bytes
+	ASSERT_TRUE(writeArchive(makePatterns(10), temporary.getFile()));
+	auto bytes = readBytes(temporary.getFile());
+	uint64 size = bytes.size();
+	ASSERT_TRUE(opensWithColumnOffset(bytes, RD8PatternArchive::OnOff, columnOffset(bytes, RD8PatternArchive::OnOff), temporary.getFile()));
+
+	for (int column : { (int) RD8PatternArchive::OnOff, (int) RD8PatternArchive::Tempo, (int) RD8PatternArchive::FilterSteps }) {
+		// Behind the end of the file
+		EXPECT_FALSE(opensWithColumnOffset(bytes, column, (size + 8) & ~(uint64) 7, temporary.getFile())) << "column " << column;
+		// Inside, but the rows run over the end
+		EXPECT_FALSE(opensWithColumnOffset(bytes, column, (size - 1) & ~(uint64) 7, temporary.getFile())) << "column " << column;
+		// So large that offset plus rows would wrap around
+		EXPECT_FALSE(opensWithColumnOffset(bytes, column, ~(uint64) 7, temporary.getFile())) << "column " << column;
+		// Not 8 byte aligned
+		EXPECT_FALSE(opensWithColumnOffset(bytes, column, columnOffset(bytes, column) + 1, temporary.getFile())) << "column " << column;
+	}
+}
@@ -0,0 +1,100 @@
+#include "RD8PatternEncoder.h"
+
+#include "RD8TestData.h"
+
+#include <gtest/gtest.h>
+
+using namespace midikraft;
+
+TEST(RD8PatternEncoder, DecodeEncodeDecodeIsIdentity)
+{
+	BehringerRD8 rd8;
+	for (uint32 seed = 0; seed < 16; seed++) {
+		int itemNo = (int) (seed * 17 % 256);
+		auto dump = RD8TestData::storedPatternSysex(rd8, itemNo, RD8TestData::patternData(seed));
+		RD8StoredPattern original(&rd8);
+		ASSERT_TRUE(original.dataFromSysexData(dump.data(), dump.size()));
+		RD8Pattern::PatternData decoded;
+		ASSERT_TRUE(original.getPattern(decoded));
+		std::array<uint8, RD8Pattern::kPatternDataSize> templateData;
+		ASSERT_TRUE(original.getPatternData(templateData.data()));
+
+		RD8PatternEncoder encoder(&rd8);
+		std::vector<uint8> encoded;
+		size_t size = encoder.encodeStoredPattern(decoded, itemNo, encoded, templateData.data());
+		ASSERT_EQ(size, dump.size());
+		encoded.resize(size);
+		EXPECT_EQ(encoded, dump) << "seed " << seed;
+
+		RD8StoredPattern reloaded(&rd8);
+		ASSERT_TRUE(reloaded.dataFromSysexData(encoded.data(), encoded.size()));
+		RD8Pattern::PatternData redecoded;
+		ASSERT_TRUE(reloaded.getPattern(redecoded));
+		EXPECT_TRUE(RD8TestData::samePattern(decoded, redecoded)) << "seed " << seed;
+		EXPECT_EQ(reloaded.itemNo(), itemNo);
+	}
+}
+
+TEST(RD8PatternEncoder, StepBitsOutsideThePlanesComeFromTheTemplate)
+{
+	auto data = RD8TestData::patternData(7);
+	RD8Pattern::PatternData decoded;
+	ASSERT_TRUE(RD8Pattern::decodePatternData(data.data(), data.size(), decoded));
+
+	std::array<uint8, RD8Pattern::kPatternDataSize> encoded;
+	RD8Pattern::encodePatternData(decoded, data.data(), encoded.data());
+	EXPECT_TRUE(std::equal(encoded.begin(), encoded.end(), data.begin()));
+
+	// Without a template, only the modelled bits survive
+	RD8Pattern::encodePatternData(decoded, nullptr, encoded.data());
+	for (size_t i = 0; i < RD8Pattern::kPatternDataSize; i++) {
+		if (RD8Pattern::fieldAt(i).field == RD8Pattern::FieldLocation::Step) {
+			EXPECT_EQ(encoded[i], data[i] & RD8StepPlanes::kModelledBits) << "byte " << i;
+		}
+	}
+}
+
+TEST(RD8PatternEncoder, UndecodedBytesComeFromTheTemplateOrAreZero)
+{
+	auto data = RD8TestData::patternData(3);
+	RD8Pattern::PatternData decoded;
+	ASSERT_TRUE(RD8Pattern::decodePatternData(data.data(), data.size(), decoded));
+
+	// The template is kept as it is, including its product variant
+	auto templateData = data;
+	templateData[1] = 0x09;
+	std::array<uint8, RD8Pattern::kPatternDataSize> encoded;
+	RD8Pattern::encodePatternData(decoded, templateData.data(), encoded.data());
+	EXPECT_EQ(encoded[1], 0x09);
+
+	RD8Pattern::encodePatternData(decoded, nullptr, encoded.data());
+	EXPECT_EQ(encoded[0], 0x00);
+	EXPECT_EQ(encoded[1], 0x08);
+	for (size_t i = 2; i < RD8Pattern::kPatternDataSize; i++) {
+		if (RD8Pattern::fieldAt(i).field == RD8Pattern::FieldLocation::Other) {
+			EXPECT_EQ(encoded[i], 0) << "byte " << i;
+		}
+	}
+}
+
+TEST(RD8PatternEncoder, BatchUsesOneTemplatePerPattern)
+{
+	BehringerRD8 rd8;
+	auto first = RD8TestData::patternData(1);
+	auto second = RD8TestData::patternData(2);
+	RD8Pattern::PatternData a, b;
+	ASSERT_TRUE(RD8Pattern::decodePatternData(first.data(), first.size(), a));
+	ASSERT_TRUE(RD8Pattern::decodePatternData(second.data(), second.size(), b));
+
+	RD8PatternEncoder encoder(&rd8);
+	auto messages = encoder.storedPatternMessages({ &a, &b }, 30, { first.data(), nullptr });
+	ASSERT_EQ(messages.size(), 2u);
+
+	std::vector<uint8> expected;
+	size_t size = encoder.encodeStoredPattern(a, 30, expected, first.data());
+	ASSERT_EQ((size_t) messages[0].getSysExDataSize(), size);
+	EXPECT_TRUE(std::equal(expected.begin(), expected.begin() + (long) size, messages[0].getSysExData()));
+	size = encoder.encodeStoredPattern(b, 31, expected);
+	ASSERT_EQ((size_t) messages[1].getSysExDataSize(), size);
+	EXPECT_TRUE(std::equal(expected.begin(), expected.begin() + (long) size, messages[1].getSysExData()));
+}
@@ -0,0 +1,180 @@
+#include "RD8PatternStore.h"
+
+#include "RD8TestData.h"
+
+#include <gtest/gtest.h>
+
+using namespace midikraft;
+
+namespace {
+
+	// A pack and its index in a fresh directory
+	class RD8PatternStoreTest : public ::testing::Test {
+	protected:
+		void SetUp() override
+		{
+			directory_ = File::getSpecialLocation(File::tempDirectory).getNonexistentChildFile("rd8-store-test", "");
+			ASSERT_TRUE(directory_.createDirectory().wasOk());
+			packFile_ = directory_.getChildFile("patterns.rd8pack");
+			indexFile_ = packFile_.withFileExtension(".rd8idx");
+		}
+
+		void TearDown() override
+		{
+			directory_.deleteRecursively();
+		}
+
+		std::vector<uint8> dump(uint32 seed, int itemNo = 0)
+		{
+			return RD8TestData::storedPatternSysex(rd8_, itemNo, RD8TestData::patternData(seed));
+		}
+
+		RD8PatternStore::ContentHash add(RD8PatternStore &store, uint32 seed)
+		{
+			auto data = dump(seed);
+			RD8StoredPattern pattern(&rd8_);
+			EXPECT_TRUE(pattern.dataFromSysexData(data.data(), data.size()));
+			RD8PatternStore::ContentHash hash = 0;
+			EXPECT_TRUE(store.add(pattern, hash));
+			return hash;
+		}
+
+		std::vector<uint8> readBytes(File const &file)
+		{
+			MemoryBlock block;
+			EXPECT_TRUE(file.loadFileAsData(block));
+			auto data = static_cast<uint8 const *>(block.getData());
+			return std::vector<uint8>(data, data + block.getSize());
+		}
+
+		void writeBytes(File const &file, std::vector<uint8> const &bytes, size_t size)
+		{
+			ASSERT_TRUE(file.replaceWithData(bytes.data(), size));
+		}
+
+		void expectContent(RD8PatternStore const &store, RD8PatternStore::ContentHash hash, uint32 seed)
+		{
+			std::vector<uint8> payload;
+			int dataTypeID = -1;
+			ASSERT_TRUE(store.contentOf(hash, payload, dataTypeID)) << "seed " << seed;
+			EXPECT_EQ(payload, RD8TestData::patternData(seed)) << "seed " << seed;
+			EXPECT_EQ(dataTypeID, BehringerRD8::STORED_PATTERN);
+		}
+
+		BehringerRD8 rd8_;
+		File directory_;
+		File packFile_;
+		File indexFile_;
+	};
+
+}
+
+TEST_F(RD8PatternStoreTest, AddFlushReopen)
+{
+	std::vector<RD8PatternStore::ContentHash> hashes;
+	{
+		RD8PatternStore store(&rd8_, packFile_);
+		ASSERT_TRUE(store.open());
+		for (uint32 seed = 0; seed < 4; seed++) {
+			hashes.push_back(add(store, seed));
+		}
+		// The same content in another slot is stored once
+		RD8PatternStore::ContentHash again;
+		auto data = dump(0, 37);
+		RD8StoredPattern pattern(&rd8_);
+		ASSERT_TRUE(pattern.dataFromSysexData(data.data(), data.size()));
+		ASSERT_TRUE(store.add(pattern, again));
+		EXPECT_EQ(again, hashes[0]);
+		EXPECT_EQ(store.numberOfEntries(), 4u);
+	}
+
+	RD8PatternStore store(&rd8_, packFile_);
+	ASSERT_TRUE(store.open());
+	EXPECT_EQ(store.numberOfEntries(), 4u);
+	for (uint32 seed = 0; seed < 4; seed++) {
+		expectContent(store, hashes[seed], seed);
+	}
+	auto loaded = store.load(hashes[2], 37);
+	ASSERT_TRUE(loaded);
+	EXPECT_EQ(loaded->data(), dump(2, 37));
+}
+
+TEST_F(RD8PatternStoreTest, ReopensWithAnIndexWrittenBeforeACrash)
+{
+	std::vector<RD8PatternStore::ContentHash> hashes;
+	std::vector<uint8> indexBeforeCrash;
+	{
+		RD8PatternStore store(&rd8_, packFile_);
+		ASSERT_TRUE(store.open());
+		hashes.push_back(add(store, 1));
+		hashes.push_back(add(store, 2));
+		store.flush();
+		indexBeforeCrash = readBytes(indexFile_);
+
+		// Appended to the pack, but the index is not written again
+		hashes.push_back(add(store, 3));
+		hashes.push_back(add(store, 4));
+	}
+	writeBytes(indexFile_, indexBeforeCrash, indexBeforeCrash.size());
+
+	{
+		RD8PatternStore store(&rd8_, packFile_);
+		ASSERT_TRUE(store.open());
+		EXPECT_EQ(store.numberOfEntries(), 4u);
+		for (uint32 i = 0; i < hashes.size(); i++) {
+			EXPECT_TRUE(store.contains(hashes[i]));
+			expectContent(store, hashes[i], i + 1);
+		}
+	}
+
+	// And no index at all, everything comes from the pack
+	ASSERT_TRUE(indexFile_.deleteFile());
+	RD8PatternStore withoutIndex(&rd8_, packFile_);
+	ASSERT_TRUE(withoutIndex.open());
+	EXPECT_EQ(withoutIndex.numberOfEntries(), 4u);
+	expectContent(withoutIndex, hashes[3], 4);
+}
+
+TEST_F(RD8PatternStoreTest, CutsOffAPartiallyWrittenRecord)
+{
+	RD8PatternStore::ContentHash first, second;
+	std::vector<uint8> indexBeforeCrash;
+	int64 sizeBeforeCrash;
+	{
+		RD8PatternStore store(&rd8_, packFile_);
+		ASSERT_TRUE(store.open());
+		first = add(store, 1);
+		store.flush();
+		indexBeforeCrash = readBytes(indexFile_);
+		sizeBeforeCrash = packFile_.getSize();
+		second = add(store, 2);
+	}
+
+	// The crash happened in the middle of writing the second record
+	auto pack = readBytes(packFile_);
+	size_t cutAt = (size_t) sizeBeforeCrash + (pack.size() - (size_t) sizeBeforeCrash) / 2;
+	writeBytes(packFile_, pack, cutAt);
+	writeBytes(indexFile_, indexBeforeCrash, indexBeforeCrash.size());
+	{
+		RD8PatternStore store(&rd8_, packFile_);
+		ASSERT_TRUE(store.open());
+		EXPECT_EQ(packFile_.getSize(), sizeBeforeCrash);
+		EXPECT_EQ(store.numberOfEntries(), 1u);
+		EXPECT_TRUE(store.contains(first));
+		EXPECT_FALSE(store.contains(second));
+
+		// The next record starts at the record boundary again
+		EXPECT_EQ(add(store, 2), second);
+		expectContent(store, second, 2);
+	}
+
+	// Cut inside the record header, and with no index to start from
+	ASSERT_TRUE(indexFile_.deleteFile());
+	pack = readBytes(packFile_);
+	writeBytes(packFile_, pack, (size_t) sizeBeforeCrash + 6);
+	RD8PatternStore store(&rd8_, packFile_);
+	ASSERT_TRUE(store.open());
+	EXPECT_EQ(packFile_.getSize(), sizeBeforeCrash);
+	EXPECT_EQ(store.numberOfEntries(), 1u);
+	expectContent(store, first, 1);
+}
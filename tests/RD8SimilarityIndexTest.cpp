@@ -0,0 +1,102 @@
+#include "RD8SimilarityIndex.h"
+
+#include "RD8TestData.h"
+
+#include <gtest/gtest.h>
+
+using namespace midikraft;
+
+namespace {
+
+	// A library of random patterns, and queries that are copies of library patterns with some steps changed
+	struct Library {
+		std::vector<RD8StepPlanes> patterns;
+		std::vector<RD8StepPlanes> queries;
+	};
+
+	Library makeLibrary(size_t numberOfPatterns, int numberOfQueries, int changedSteps)
+	{
+		std::mt19937 random(7);
+		Library result;
+		for (size_t i = 0; i < numberOfPatterns; i++) {
+			result.patterns.push_back(RD8TestData::randomPlanes(random));
+		}
+		for (int i = 0; i < numberOfQueries; i++) {
+			result.queries.push_back(RD8TestData::changeSteps(result.patterns[random() % numberOfPatterns], changedSteps, random));
+		}
+		return result;
+	}
+
+	// The same with 16 step patterns using about 5 tracks, the changes stay within the 16 steps
+	Library makeSparseLibrary(size_t numberOfPatterns, int numberOfQueries, int changedSteps)
+	{
+		std::mt19937 random(7);
+		Library result;
+		for (size_t i = 0; i < numberOfPatterns; i++) {
+			result.patterns.push_back(RD8TestData::sparsePlanes(random));
+		}
+		for (int i = 0; i < numberOfQueries; i++) {
+			result.queries.push_back(RD8TestData::changeSteps(result.patterns[random() % numberOfPatterns], changedSteps, random, 16));
+		}
+		return result;
+	}
+
+	RD8SimilarityIndex buildIndex(Library const &library)
+	{
+		RD8SimilarityIndex index{ RD8SimilarityIndex::Options() };
+		for (auto const &pattern : library.patterns) {
+			index.add(pattern);
+		}
+		index.build();
+		return index;
+	}
+
+	int countExactNearestFound(RD8SimilarityIndex const &index, Library const &library)
+	{
+		int found = 0;
+		for (auto const &query : library.queries) {
+			auto exact = index.nearestExact(query, 1);
+			auto approximate = index.nearest(query, 1);
+			EXPECT_EQ(exact.size(), 1u);
+			if (!approximate.empty() && !exact.empty() && approximate[0].distance == exact[0].distance) {
+				found++;
+			}
+		}
+		return found;
+	}
+
+}
+
+TEST(RD8SimilarityIndex, NearestFindsTheExactNearest)
+{
+	// The speed against the linear scan is measured by BM_SimilarityNearestVsScan, with 100000 patterns
+	auto library = makeLibrary(10000, 100, 15);
+	auto index = buildIndex(library);
+	// Locality sensitive hashing may miss, but with the default options it practically never does at this distance
+	EXPECT_GE(countExactNearestFound(index, library), 98);
+}
+
+TEST(RD8SimilarityIndex, NearestFindsTheExactNearestInSparsePatterns)
+{
+	// Most steps of sparse patterns are off, which must not let all patterns end up in the same few buckets
+	auto library = makeSparseLibrary(10000, 100, 3);
+	auto index = buildIndex(library);
+	EXPECT_GE(countExactNearestFound(index, library), 95);
+}
+
+TEST(RD8SimilarityIndex, MatchesAreSortedAndScoredExactly)
+{
+	auto library = makeLibrary(2000, 10, 15);
+	auto index = buildIndex(library);
+
+	for (auto const &query : library.queries) {
+		auto matches = index.nearest(query, 5);
+		ASSERT_FALSE(matches.empty());
+		for (size_t i = 0; i < matches.size(); i++) {
+			EXPECT_EQ(matches[i].distance, index.distance(matches[i].patternNo, query));
+			if (i > 0) {
+				EXPECT_LE(matches[i - 1].distance, matches[i].distance);
+			}
+		}
+	}
+}
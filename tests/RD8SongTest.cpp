@@ -0,0 +1,74 @@
+#include "RD8PatternCache.h"
+
+#include "RD8TestData.h"
+
+#include <gtest/gtest.h>
+
+using namespace midikraft;
+
+// The song dumps here are synthesized in the assumed layout, so these tests check the decoder and the cache, not the layout
+
+TEST(RD8Song, UnverifiedLayoutIsOnlyDecodedOnRequest)
+{
+	BehringerRD8 rd8;
+	auto dump = RD8TestData::storedSongSysex(rd8, 3, { 0x30, 0x31, 0x31, 0xf2 });
+	RD8StoredSong song(&rd8);
+	ASSERT_TRUE(song.dataFromSysexData(dump.data(), dump.size()));
+
+	RD8Song::SongData decoded;
+	if constexpr (!RD8Song::kSongLayoutVerified) {
+		EXPECT_FALSE(song.getSong(decoded));
+		EXPECT_FALSE(song.getSong());
+	}
+	ASSERT_TRUE(song.getSong(decoded, RD8Song::Layout::AllowUnverified));
+	ASSERT_EQ(decoded.chain.size(), 4u);
+	EXPECT_EQ(decoded.chain[0].songNo, 3);
+	EXPECT_EQ(decoded.chain[0].patternNo, 0);
+	EXPECT_EQ(decoded.chain[2].itemNo(), 0x31);
+	EXPECT_EQ(decoded.chain[3].songNo, 15);
+	EXPECT_EQ(decoded.chain[3].patternNo, 2);
+}
+
+TEST(RD8Song, DecodeRejectsChainsOutsideTheData)
+{
+	RD8Song::SongData decoded;
+	std::vector<uint8> songData = { 3, 0x01, 0x02 };
+	EXPECT_FALSE(RD8Song::decodeSongData(songData.data(), songData.size(), decoded));
+	EXPECT_TRUE(decoded.chain.empty());
+	EXPECT_FALSE(RD8Song::decodeSongData(songData.data(), 0, decoded));
+
+	songData.assign(1 + RD8Song::kMaxChainLength + 1, 0);
+	songData[0] = (uint8) (RD8Song::kMaxChainLength + 1);
+	EXPECT_FALSE(RD8Song::decodeSongData(songData.data(), songData.size(), decoded));
+	songData[0] = (uint8) RD8Song::kMaxChainLength;
+	EXPECT_TRUE(RD8Song::decodeSongData(songData.data(), songData.size(), decoded));
+	EXPECT_EQ(decoded.chain.size(), (size_t) RD8Song::kMaxChainLength);
+}
+
+TEST(RD8Song, ResolveSharesTheCachedPatterns)
+{
+	BehringerRD8 rd8;
+	RD8PatternCache cache;
+	for (int itemNo : { 0x10, 0x11 }) {
+		auto dump = RD8TestData::storedPatternSysex(rd8, itemNo, RD8TestData::patternData((uint32) itemNo));
+		RD8StoredPattern pattern(&rd8);
+		ASSERT_TRUE(pattern.dataFromSysexData(dump.data(), dump.size()));
+		ASSERT_TRUE(cache.add(pattern));
+	}
+
+	// With padding behind the chain, as a real dump would have
+	auto dump = RD8TestData::storedSongSysex(rd8, 1, { 0x10, 0x11, 0x10, 0x12 }, 100);
+	RD8StoredSong song(&rd8);
+	ASSERT_TRUE(song.dataFromSysexData(dump.data(), dump.size()));
+	auto decoded = song.getSong(RD8Song::Layout::AllowUnverified);
+	ASSERT_TRUE(decoded);
+
+	int missing = -1;
+	auto chain = cache.resolve(*decoded, missing);
+	ASSERT_EQ(chain.size(), 4u);
+	EXPECT_EQ(missing, 1);
+	EXPECT_EQ(chain[0], cache.get(0x10).get());
+	EXPECT_EQ(chain[1], cache.get(0x11).get());
+	EXPECT_EQ(chain[2], chain[0]); // The same decoded pattern, not a copy
+	EXPECT_EQ(chain[3], nullptr);
+}
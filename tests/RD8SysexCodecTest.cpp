@@ -0,0 +1,114 @@
+#include "RD8SysexCodec.h"
+
+#include <gtest/gtest.h>
+
+#include <random>
+
+using namespace midikraft;
+
+namespace {
+
+	// The byte loops the codec replaced, kept as the reference
+	std::vector<uint8> referenceUnescape(std::vector<uint8> const &input)
+	{
+		std::vector<uint8> result;
+		size_t dataIndex = 0;
+		while (dataIndex < input.size()) {
+			uint8 ms_bits = input[dataIndex];
+			dataIndex++;
+			for (int i = 0; i < 7; i++) {
+				if (dataIndex < input.size()) {
+					result.push_back((uint8) (input[dataIndex] | ((ms_bits & (1 << i)) << (7 - i))));
+				}
+				dataIndex++;
+			}
+		}
+		return result;
+	}
+
+	std::vector<uint8> referenceEscape(std::vector<uint8> const &input)
+	{
+		std::vector<uint8> result;
+		size_t readIndex = 0;
+		while (readIndex < input.size()) {
+			result.push_back(0);
+			size_t msbIndex = result.size() - 1;
+			uint8 msb = 0;
+			for (int i = 0; i < 7; i++) {
+				if (readIndex < input.size()) {
+					result.push_back(input[readIndex] & 0x7f);
+					msb |= (input[readIndex] & 0x80) >> (7 - i);
+				}
+				readIndex++;
+			}
+			result[msbIndex] = msb;
+		}
+		return result;
+	}
+
+	std::vector<uint8> randomBytes(size_t size, std::mt19937 &random, uint8 mask)
+	{
+		std::vector<uint8> result(size);
+		for (auto &byte : result) {
+			byte = (uint8) (random() & mask);
+		}
+		return result;
+	}
+
+	const size_t kMaxLength = 80; // All group phases several times, beyond the 8 byte words of the codec
+
+}
+
+TEST(RD8SysexCodec, EscapeMatchesTheByteLoops)
+{
+	std::mt19937 random(1);
+	for (size_t length = 0; length <= kMaxLength; length++) {
+		// Random bytes, then all with the most significant bit set, then all without
+		for (uint8 fill : { (uint8) 0, (uint8) 0xff, (uint8) 0x7f }) {
+			auto input = fill == 0 ? randomBytes(length, random, 0xff) : std::vector<uint8>(length, fill);
+			auto expected = referenceEscape(input);
+			ASSERT_EQ(RD8SysexCodec::escapedSize(length), expected.size()) << "length " << length;
+			EXPECT_EQ(RD8SysexCodec::escape(input.data(), input.size()), expected) << "length " << length << " fill " << (int) fill;
+
+			// Writing into caller memory, without touching the bytes behind
+			std::vector<uint8> output(expected.size() + 1, 0xaa);
+			EXPECT_EQ(RD8SysexCodec::escape(input.data(), input.size(), output.data()), expected.size());
+			EXPECT_TRUE(std::equal(expected.begin(), expected.end(), output.begin())) << "length " << length;
+			EXPECT_EQ(output.back(), 0xaa) << "length " << length;
+		}
+	}
+}
+
+TEST(RD8SysexCodec, UnescapeMatchesTheByteLoops)
+{
+	std::mt19937 random(2);
+	for (size_t length = 0; length <= kMaxLength; length++) {
+		// Valid sysex data bytes, including trailing partial groups of every size
+		auto input = randomBytes(length, random, 0x7f);
+		auto expected = referenceUnescape(input);
+		ASSERT_EQ(RD8SysexCodec::unescapedSize(length), expected.size()) << "length " << length;
+		EXPECT_EQ(RD8SysexCodec::unescape(input.data(), input.size()), expected) << "length " << length;
+
+		std::vector<uint8> output(expected.size() + 1, 0xaa);
+		EXPECT_EQ(RD8SysexCodec::unescape(input.data(), input.size(), output.data()), expected.size());
+		EXPECT_TRUE(std::equal(expected.begin(), expected.end(), output.begin())) << "length " << length;
+		EXPECT_EQ(output.back(), 0xaa) << "length " << length;
+
+		// All most significant bits set in the msb bytes
+		std::vector<uint8> allHigh(length, 0x7f);
+		EXPECT_EQ(RD8SysexCodec::unescape(allHigh.data(), allHigh.size()), referenceUnescape(allHigh)) << "length " << length;
+	}
+}
+
+TEST(RD8SysexCodec, RoundTrip)
+{
+	std::mt19937 random(3);
+	for (size_t length = 0; length <= kMaxLength; length++) {
+		auto input = randomBytes(length, random, 0xff);
+		auto escaped = RD8SysexCodec::escape(input.data(), input.size());
+		for (auto byte : escaped) {
+			EXPECT_EQ(byte & 0x80, 0) << "length " << length;
+		}
+		EXPECT_EQ(RD8SysexCodec::unescape(escaped.data(), escaped.size()), input) << "length " << length;
+	}
+}
@@ -0,0 +1,133 @@
+#include "RD8SysexFramer.h"
+
+#include "RD8TestData.h"
+
+#include <gtest/gtest.h>
+
+using namespace midikraft;
+
+namespace {
+
+	// A stored pattern dump as it appears on the wire, with F0 and F7
+	std::vector<uint8> framed(std::vector<uint8> const &sysexData)
+	{
+		std::vector<uint8> result;
+		result.push_back(0xf0);
+		result.insert(result.end(), sysexData.begin(), sysexData.end());
+		result.push_back(0xf7);
+		return result;
+	}
+
+	void append(std::vector<uint8> &stream, std::vector<uint8> const &bytes)
+	{
+		stream.insert(stream.end(), bytes.begin(), bytes.end());
+	}
+
+	struct Received {
+		std::vector<std::shared_ptr<RD8DataFile>> dataFiles;
+
+		RD8SysexFramer::DataFileCallback callback()
+		{
+			return [this](std::shared_ptr<RD8DataFile> dataFile) { dataFiles.push_back(dataFile); };
+		}
+	};
+
+}
+
+TEST(RD8SysexFramer, FramesSplitAcrossChunks)
+{
+	BehringerRD8 rd8;
+	auto first = RD8TestData::storedPatternSysex(rd8, 17, RD8TestData::patternData(1));
+	auto second = RD8TestData::storedPatternSysex(rd8, 18, RD8TestData::patternData(2));
+	std::vector<uint8> stream;
+	append(stream, framed(first));
+	append(stream, framed(second));
+
+	for (size_t chunkSize : { (size_t) 1, (size_t) 2, (size_t) 7, (size_t) 100, first.size() + 2, stream.size() }) {
+		Received received;
+		RD8SysexFramer framer(&rd8, received.callback());
+		for (size_t position = 0; position < stream.size(); position += chunkSize) {
+			framer.push(stream.data() + position, std::min(chunkSize, stream.size() - position));
+		}
+		ASSERT_EQ(received.dataFiles.size(), 2u) << "chunk size " << chunkSize;
+		EXPECT_EQ(received.dataFiles[0]->data(), first) << "chunk size " << chunkSize;
+		EXPECT_EQ(received.dataFiles[1]->data(), second) << "chunk size " << chunkSize;
+		EXPECT_EQ(framer.statistics().bytes, stream.size());
+		EXPECT_EQ(framer.statistics().frames, 2u);
+		EXPECT_EQ(framer.statistics().dataFiles, 2u);
+		EXPECT_EQ(framer.statistics().truncatedFrames, 0u);
+	}
+}
+
+TEST(RD8SysexFramer, IgnoresRealtimeBytesInsideSysex)
+{
+	BehringerRD8 rd8;
+	auto dump = RD8TestData::storedPatternSysex(rd8, 5, RD8TestData::patternData(3));
+	std::vector<uint8> stream;
+	auto wire = framed(dump);
+	for (size_t i = 0; i < wire.size(); i++) {
+		// Clock, active sensing, start and stop, also right after F0 and before F7
+		if (i % 5 == 1) {
+			stream.push_back((uint8) (0xf8 + i % 8));
+		}
+		stream.push_back(wire[i]);
+	}
+	stream.push_back(0xfe);
+
+	Received received;
+	RD8SysexFramer framer(&rd8, received.callback());
+	framer.push(stream.data(), stream.size());
+	ASSERT_EQ(received.dataFiles.size(), 1u);
+	EXPECT_EQ(received.dataFiles[0]->data(), dump);
+	EXPECT_EQ(framer.statistics().truncatedFrames, 0u);
+}
+
+TEST(RD8SysexFramer, DropsFramesLongerThanTheBuffer)
+{
+	BehringerRD8 rd8;
+	auto dump = RD8TestData::storedPatternSysex(rd8, 5, RD8TestData::patternData(4));
+	auto tooLong = dump;
+	tooLong.push_back(0x00);
+	std::vector<uint8> stream;
+	append(stream, framed(tooLong));
+	append(stream, framed(dump));
+
+	// The buffer holds exactly one dump, the longer frame is dropped and the buffer starts over at the next F0
+	Received received;
+	RD8SysexFramer framer(&rd8, received.callback(), -1, dump.size());
+	framer.push(stream.data(), stream.size());
+	ASSERT_EQ(received.dataFiles.size(), 1u);
+	EXPECT_EQ(received.dataFiles[0]->data(), dump);
+	EXPECT_EQ(framer.statistics().frames, 2u);
+	EXPECT_EQ(framer.statistics().truncatedFrames, 1u);
+}
+
+TEST(RD8SysexFramer, FiltersByHeaderAndDataType)
+{
+	BehringerRD8 rd8;
+	auto pattern = RD8TestData::storedPatternSysex(rd8, 5, RD8TestData::patternData(5));
+	auto song = RD8TestData::storedSongSysex(rd8, 2, { 0x20, 0x21 });
+	std::vector<uint8> stream;
+	append(stream, { 0xf0, 0x43, 0x10, 0x4c, 0x00, 0x00, 0x7e, 0x00, 0xf7 }); // Another manufacturer
+	append(stream, { 0xf0, 0x00, 0x20, 0x32, 0x7f, 0x01, 0x02, 0xf7 }); // Behringer, but another device
+	append(stream, framed(song));
+	// An RD8 frame cut off by a note on, then the complete pattern
+	append(stream, { 0xf0, pattern[0], pattern[1], pattern[2], pattern[3], pattern[4], 0x90, 0x24, 0x64 });
+	append(stream, framed(pattern));
+
+	Received all;
+	RD8SysexFramer framer(&rd8, all.callback());
+	framer.push(stream.data(), stream.size());
+	ASSERT_EQ(all.dataFiles.size(), 2u);
+	EXPECT_EQ(all.dataFiles[0]->dataTypeID(), BehringerRD8::STORED_SONG);
+	EXPECT_EQ(all.dataFiles[1]->data(), pattern);
+	EXPECT_EQ(framer.statistics().frames, 5u);
+	EXPECT_EQ(framer.statistics().foreignFrames, 2u);
+	EXPECT_EQ(framer.statistics().truncatedFrames, 1u);
+
+	Received patternsOnly;
+	RD8SysexFramer patternFramer(&rd8, patternsOnly.callback(), BehringerRD8::STORED_PATTERN);
+	patternFramer.push(stream.data(), stream.size());
+	ASSERT_EQ(patternsOnly.dataFiles.size(), 1u);
+	EXPECT_EQ(patternsOnly.dataFiles[0]->dataTypeID(), BehringerRD8::STORED_PATTERN);
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "RD8.h"
+#include "RD8Pattern.h"
+#include "RD8SysexCodec.h"
+
+#include <random>
+
+namespace midikraft {
+
+	namespace RD8TestData {
+
+		// Pattern data as the device sends it, with every byte filled: all 8 bits of the step bytes, including the bits the planes
+		// don't model, the undecoded bytes after the steps, random settings and FX sends. Only the bools are kept at 0 or 1, as the
+		// decoder expects
+		inline std::vector<uint8> patternData(uint32 seed)
+		{
+			std::mt19937 random(seed);
+			std::vector<uint8> data(RD8Pattern::kPatternDataSize);
+			for (size_t i = 0; i < data.size(); i++) {
+				auto location = RD8Pattern::fieldAt(i);
+				uint32 bits = random();
+				switch (location.field) {
+				case RD8Pattern::FieldLocation::Step:
+					data[i] = (bits & 3) == 0 ? (uint8) (bits >> 8) : (uint8) ((bits >> 8) & 0x82); // Mostly off, but with the unknown bits
+					break;
+				case RD8Pattern::FieldLocation::FilterStep:
+					data[i] = (uint8) (bits & 0x7f);
+					break;
+				default:
+					data[i] = (uint8) bits;
+				}
+			}
+			data[0] = 0x00; // Data version
+			data[1] = 0x08; // Product variant
+			for (size_t i = 0; i < data.size(); i++) {
+				auto location = RD8Pattern::fieldAt(i);
+				std::string name(location.name);
+				if (name == "Filter Enable" || name == "Filter Automation" || name == "Polymeter" || name == "Auto Advance") {
+					data[i] &= 1;
+				}
+			}
+			return data;
+		}
+
+		inline std::vector<uint8> storedPatternSysex(BehringerRD8 const &rd8, int itemNo, std::vector<uint8> const &patternData)
+		{
+			auto message = rd8.createRequestMessage(BehringerRD8::MessageID({ RD8_DATA_MESSAGE, RD8_STORED_PATTERN_RESPONSE }));
+			message.push_back((uint8) (itemNo / 16));
+			message.push_back((uint8) (itemNo % 16));
+			auto escaped = RD8SysexCodec::escape(patternData.data(), patternData.size());
+			message.insert(message.end(), escaped.begin(), escaped.end());
+			return message;
+		}
+
+		// A stored song dump in the layout RD8Song assumes, see RD8Song::kSongLayoutVerified. Synthesized, not captured from a device
+		inline std::vector<uint8> storedSongSysex(BehringerRD8 const &rd8, int songNo, std::vector<int> const &chainItemNos, size_t padTo = 0)
+		{
+			std::vector<uint8> songData;
+			songData.push_back((uint8) chainItemNos.size());
+			for (int itemNo : chainItemNos) {
+				songData.push_back((uint8) (((itemNo / 16) << 4) | (itemNo % 16)));
+			}
+			if (songData.size() < padTo) {
+				songData.resize(padTo, 0);
+			}
+			auto message = rd8.createRequestMessage(BehringerRD8::MessageID({ RD8_DATA_MESSAGE, RD8_STORED_SONG_RESPONSE }));
+			message.push_back((uint8) songNo);
+			auto escaped = RD8SysexCodec::escape(songData.data(), songData.size());
+			message.insert(message.end(), escaped.begin(), escaped.end());
+			return message;
+		}
+
+		// Step masks with about a quarter of the steps switched on
+		inline RD8StepPlanes randomPlanes(std::mt19937 &random)
+		{
+			RD8StepPlanes planes = {};
+			for (auto &mask : planes.onOff) {
+				uint64 a = ((uint64) random() << 32) | random();
+				uint64 b = ((uint64) random() << 32) | random();
+				mask = a & b;
+			}
+			return planes;
+		}
+
+		// Step masks as patterns mostly are: the default length of 16 steps, about 5 of the 12 tracks in use, and those with
+		// about a quarter of their steps on
+		inline RD8StepPlanes sparsePlanes(std::mt19937 &random, int usedLength = 16)
+		{
+			RD8StepPlanes planes = {};
+			uint64 usedSteps = usedLength < RD8StepPlanes::kNumberOfSteps ? ((uint64) 1 << usedLength) - 1 : ~(uint64) 0;
+			for (auto &mask : planes.onOff) {
+				if (random() % 12 < 5) {
+					uint64 a = ((uint64) random() << 32) | random();
+					uint64 b = ((uint64) random() << 32) | random();
+					mask = a & b & usedSteps;
+				}
+			}
+			return planes;
+		}
+
+		// Toggles the given number of randomly chosen steps among the first usedLength steps of each track
+		inline RD8StepPlanes changeSteps(RD8StepPlanes planes, int numberOfSteps, std::mt19937 &random, int usedLength = RD8StepPlanes::kNumberOfSteps)
+		{
+			for (int i = 0; i < numberOfSteps; i++) {
+				uint32 bit = random() % (uint32) (RD8StepPlanes::kNumberOfTracks * usedLength);
+				planes.onOff[bit / (uint32) usedLength] ^= (uint64) 1 << (bit % (uint32) usedLength);
+			}
+			return planes;
+		}
+
+		inline bool samePattern(RD8Pattern::PatternData const &a, RD8Pattern::PatternData const &b)
+		{
+			return a.planes == b.planes && a.tempo == b.tempo && a.swing == b.swing && a.probability == b.probability && a.flamLevel == b.flamLevel
+				&& a.filterMode == b.filterMode && a.filterOnOff == b.filterOnOff && a.filterAutomationOnOff == b.filterAutomationOnOff
+				&& a.filterSteps == b.filterSteps && a.polymeterOnOff == b.polymeterOnOff && a.stepSize == b.stepSize && a.autoAdvanceOnOff == b.autoAdvanceOnOff;
+		}
+
+	}
+
+}